@@ -0,0 +1,85 @@
+#include "./bench.hpp"
+
+#include <chrono>
+
+namespace kappa::bench {
+
+namespace {
+
+constexpr u32 ARENA_FRAMES = 2000;
+constexpr u32 ARENA_LISTS = 256; // Temporary lists per frame
+constexpr u32 ARENA_LIST_SIZE = 24;
+
+struct FrameResult {
+  BenchStats stats; // Per frame
+  f64 allocs;
+  u64 checksum;
+};
+
+// Builds a bunch of short lived lists each frame, like descriptor writes or pool sizes
+template<typename MakeList, typename EndFrame>
+fn run_frames(MakeList&& make_list, EndFrame&& end_frame) -> FrameResult {
+  u64 checksum = 0;
+  u64 allocs = 0;
+  const u32 frames = scaled_reps(ARENA_FRAMES) + 1;
+  Vec<f64> samples;
+  samples.reserve(frames);
+  for (u32 frame = 0; frame < frames; ++frame) {
+    const u64 start_allocs = alloc_stats().count;
+    const auto start = std::chrono::steady_clock::now();
+    for (u32 list_idx = 0; list_idx < ARENA_LISTS; ++list_idx) {
+      auto list = make_list();
+      list.reserve(ARENA_LIST_SIZE);
+      for (u32 i = 0; i < ARENA_LIST_SIZE; ++i) {
+        list.push_back(frame ^ (list_idx * i));
+      }
+      for (const u64 value : list) {
+        checksum += value;
+      }
+    }
+    end_frame();
+    const auto end = std::chrono::steady_clock::now();
+    // The first frame warms the arena up, don't count it
+    if (frame) {
+      samples.push_back(std::chrono::duration<f64, std::nano>(end - start).count());
+      allocs += alloc_stats().count - start_allocs;
+    }
+  }
+  return {compute_stats({samples.data(), samples.size()}, 1), (f64)allocs / (frames - 1),
+          checksum};
+}
+
+} // namespace
+
+fn bench_arena() -> bool {
+  const auto heap = run_frames(
+    []() {
+      return Vec<u64>();
+    },
+    []() {});
+
+  LinearArena arena;
+  const auto linear = run_frames(
+    [&]() {
+      return ArenaVec<u64>(arena);
+    },
+    [&]() {
+      arena.reset();
+    });
+
+  fmt::print("arena ({} lists of {} per frame):\n", ARENA_LISTS, ARENA_LIST_SIZE);
+  report("arena", "heap", heap.stats, ARENA_LISTS, "lists");
+  report("arena", "arena", linear.stats, ARENA_LISTS, "lists");
+  fmt::print("  allocations/frame: heap {:.1f}, arena {:.1f}\n", heap.allocs, linear.allocs);
+  if (heap.checksum != linear.checksum) {
+    fmt::print("  arena results don't match!\n");
+    return false;
+  }
+  if (linear.allocs > 0.) {
+    fmt::print("  arena still allocates after warming up!\n");
+    return false;
+  }
+  return true;
+}
+
+} // namespace kappa::bench
@@ -0,0 +1,252 @@
+#include "./bench.hpp"
+#include "assets/cache.hpp"
+#include "assets/model.hpp"
+#include "assets/texture.hpp"
+
+#include <array>
+#include <cstdio>
+#include <filesystem>
+
+namespace kappa::bench {
+
+using namespace kappa::assets;
+
+namespace {
+
+constexpr u32 LOADER_WARMUP = 1;
+constexpr u32 MODEL_REPS = 20;
+constexpr u32 IMAGE_REPS = 20;
+
+fn bench_dir() -> std::filesystem::path {
+  auto dir = std::filesystem::temp_directory_path() / "kappa_bench";
+  std::filesystem::create_directories(dir);
+  return dir;
+}
+
+fn write_file(const std::filesystem::path& path, const void* data, size_t size) -> bool {
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    fmt::print("  failed to write \"{}\"\n", path.c_str());
+    return false;
+  }
+  const bool ok = std::fwrite(data, 1, size, file) == size;
+  std::fclose(file);
+  return ok;
+}
+
+// Flat grid of quads with normals and uvs, big enough to make assimp sweat
+fn write_grid_obj(const std::filesystem::path& path, u32 quads) -> bool {
+  fmt::memory_buffer out;
+  const auto inserter = std::back_inserter(out);
+  const u32 side = quads + 1;
+  for (u32 y = 0; y < side; ++y) {
+    for (u32 x = 0; x < side; ++x) {
+      const f32 u = (f32)x / quads;
+      const f32 v = (f32)y / quads;
+      fmt::format_to(inserter, "v {:.5f} {:.5f} {:.5f}\nvt {:.5f} {:.5f}\n", u * 2.f - 1.f,
+                     v * 2.f - 1.f, (x ^ y) % 3 * .01f, u, v);
+    }
+  }
+  fmt::format_to(inserter, "vn 0 0 1\n");
+  for (u32 y = 0; y < quads; ++y) {
+    for (u32 x = 0; x < quads; ++x) {
+      // One based
+      const u32 a = y * side + x + 1;
+      const u32 b = a + 1;
+      const u32 c = a + side + 1;
+      const u32 d = a + side;
+      fmt::format_to(inserter, "f {0}/{0}/1 {1}/{1}/1 {2}/{2}/1 {3}/{3}/1\n", a, b, c, d);
+    }
+  }
+  return write_file(path, out.data(), out.size());
+}
+
+fn crc32(const u8* data, size_t size, u32 crc = 0) -> u32 {
+  static constexpr auto table = []() {
+    std::array<u32, 256> table{};
+    for (u32 i = 0; i < 256; ++i) {
+      u32 c = i;
+      for (u32 k = 0; k < 8; ++k) {
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+    return table;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// RGBA8 PNG with stored deflate blocks, no zlib needed to write it. Decoding still goes through
+// inflate and the row filters, but real textures spend more time inflating
+fn write_png(const std::filesystem::path& path, u32 width, u32 height) -> bool {
+  Vec<u8> raw;
+  raw.reserve((size_t)(width * 4 + 1) * height);
+  for (u32 y = 0; y < height; ++y) {
+    raw.push_back((u8)(y % 2)); // Alternate between no filter and sub
+    for (u32 x = 0; x < width; ++x) {
+      raw.push_back((u8)(x * 255 / width));
+      raw.push_back((u8)(y * 255 / height));
+      raw.push_back((u8)((x * 7) ^ (y * 13)));
+      raw.push_back(255);
+    }
+  }
+
+  Vec<u8> zlib{0x78, 0x01};
+  u32 adler_a = 1, adler_b = 0;
+  for (size_t offset = 0; offset < raw.size();) {
+    const u16 len = (u16)std::min<size_t>(raw.size() - offset, 0xFFFF);
+    const bool last = offset + len == raw.size();
+    zlib.insert(zlib.end(), {(u8)last, (u8)len, (u8)(len >> 8), (u8)~len, (u8)(~len >> 8)});
+    zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + len);
+    for (size_t i = offset; i < offset + len; ++i) {
+      adler_a = (adler_a + raw[i]) % 65521;
+      adler_b = (adler_b + adler_a) % 65521;
+    }
+    offset += len;
+  }
+  const u32 adler = (adler_b << 16) | adler_a;
+  zlib.insert(zlib.end(), {(u8)(adler >> 24), (u8)(adler >> 16), (u8)(adler >> 8), (u8)adler});
+
+  Vec<u8> png{0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  const fn push_u32 = [&](u32 value) {
+    png.insert(png.end(), {(u8)(value >> 24), (u8)(value >> 16), (u8)(value >> 8), (u8)value});
+  };
+  const fn push_chunk = [&](const char* type, const u8* data, size_t size) {
+    push_u32((u32)size);
+    const size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data, data + size);
+    push_u32(crc32(png.data() + start, size + 4));
+  };
+  const u8 ihdr[] = {
+    (u8)(width >> 24), (u8)(width >> 16), (u8)(width >> 8), (u8)width,
+    (u8)(height >> 24), (u8)(height >> 16), (u8)(height >> 8), (u8)height,
+    8, 6, 0, 0, 0, // 8 bits, RGBA, deflate, no interlacing
+  };
+  push_chunk("IHDR", ihdr, sizeof(ihdr));
+  push_chunk("IDAT", zlib.data(), zlib.size());
+  push_chunk("IEND", nullptr, 0);
+  return write_file(path, png.data(), png.size());
+}
+
+// Loads through assimp, then cooks it and loads the .kmdl the same way. Last goes
+// Model3DLoader again with the cook cache on, the warmup load misses and fills it
+fn run_model(const char* path, std::string_view name) -> bool {
+  bool ok = true;
+  size_t vertices = 0;
+  const auto stats = measure(LOADER_WARMUP, MODEL_REPS, [&]() {
+    auto model = Model3DLoader(path, "bench")();
+    if (!model) {
+      ok = false;
+      return;
+    }
+    vertices = model->mesh_positions().size();
+    model->destroy();
+  });
+  if (!ok) {
+    fmt::print("  failed to load \"{}\"\n", path);
+    return false;
+  }
+  report("model_loader", name, stats, (f64)vertices, "vertices");
+
+  const auto kmdl_path = bench_dir() / fmt::format("{}.kmdl", name);
+  {
+    auto model = Model3DLoader(path, "bench")();
+    ok = model && model->cook(kmdl_path.c_str());
+    if (model) {
+      model->destroy();
+    }
+  }
+  if (!ok) {
+    fmt::print("  failed to cook \"{}\"\n", path);
+    return false;
+  }
+  const auto cooked_stats = measure(LOADER_WARMUP, MODEL_REPS, [&]() {
+    auto model = CookedModelLoader(kmdl_path.c_str(), "bench")();
+    if (!model) {
+      ok = false;
+      return;
+    }
+    model->destroy();
+  });
+  if (!ok) {
+    fmt::print("  failed to load \"{}\"\n", kmdl_path.c_str());
+    return false;
+  }
+  report("model_loader", buffer_str_fmt<64>("{}.kmdl", name).as_view(), cooked_stats,
+         (f64)vertices, "vertices");
+
+  cache::initialize((bench_dir() / "cache").c_str());
+  const DeferFn cache_defer = []() {
+    cache::shutdown();
+  };
+  const auto cache_stats = measure(LOADER_WARMUP, MODEL_REPS, [&]() {
+    auto model = Model3DLoader(path, "bench")();
+    if (!model) {
+      ok = false;
+      return;
+    }
+    model->destroy();
+  });
+  if (!ok) {
+    fmt::print("  failed to load \"{}\" through the cache\n", path);
+    return false;
+  }
+  report("model_loader", buffer_str_fmt<64>("{}/cached", name).as_view(), cache_stats,
+         (f64)vertices, "vertices");
+  return true;
+}
+
+} // namespace
+
+fn bench_model_loader() -> bool {
+  fmt::print("model_loader:\n");
+  bool ok = run_model(KA_RES_DIR "/models/suzanne.glb", "suzanne.glb");
+
+  const auto dir = bench_dir();
+  for (const u32 quads : {128u, 512u}) {
+    const auto path = dir / fmt::format("grid_{}.obj", quads);
+    if (!write_grid_obj(path, quads)) {
+      ok = false;
+      continue;
+    }
+    ok &= run_model(path.c_str(), buffer_str_fmt<64>("grid_{}x{}.obj", quads, quads).as_view());
+  }
+  return ok;
+}
+
+fn bench_image_loader() -> bool {
+  fmt::print("image_loader:\n");
+  const auto dir = bench_dir();
+  bool ok = true;
+  for (const u32 size : {512u, 2048u}) {
+    const auto path = dir / fmt::format("image_{}.png", size);
+    if (!write_png(path, size, size)) {
+      ok = false;
+      continue;
+    }
+    bool loaded = true;
+    const auto stats = measure(LOADER_WARMUP, IMAGE_REPS, [&]() {
+      auto image = ImageLoader(path.c_str(), "bench")();
+      if (!image) {
+        loaded = false;
+        return;
+      }
+      image->destroy();
+    });
+    if (!loaded) {
+      fmt::print("  failed to load \"{}\"\n", path.c_str());
+      ok = false;
+      continue;
+    }
+    report("image_loader", buffer_str_fmt<64>("png_rgba8/{}x{}", size, size).as_view(), stats,
+           (f64)size * size, "pixels");
+  }
+  return ok;
+}
+
+} // namespace kappa::bench
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <chrono>
+
+namespace kappa::bench {
+
+// Nanoseconds per repetition, warmup runs aren't part of it
+struct BenchStats {
+  u32 warmup;
+  u32 reps;
+  f64 mean;
+  f64 stddev;
+  f64 min;
+  f64 median;
+  f64 max;
+};
+
+struct BenchOpts {
+  const char* json_path; // nullptr to skip the JSON report
+  const char* filter;    // Only groups containing it run, nullptr for everything
+  f64 rep_scale;         // --quick runs fewer repetitions
+};
+
+fn parse_opts(int argc, char* argv[]) -> bool;
+fn opts() -> const BenchOpts&;
+
+// Whether a group passes --filter
+fn group_enabled(std::string_view group) -> bool;
+
+// Scaled by --quick, never below one
+fn scaled_reps(u32 reps) -> u32;
+
+// Sorts the samples
+fn compute_stats(Span<f64> samples, u32 warmup) -> BenchStats;
+
+template<typename F>
+fn measure(u32 warmup, u32 reps, F&& func) -> BenchStats {
+  reps = scaled_reps(reps);
+  for (u32 i = 0; i < warmup; ++i) {
+    func();
+  }
+  Vec<f64> samples;
+  samples.reserve(reps);
+  for (u32 i = 0; i < reps; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    func();
+    const auto end = std::chrono::steady_clock::now();
+    samples.push_back(std::chrono::duration<f64, std::nano>(end - start).count());
+  }
+  return compute_stats({samples.data(), samples.size()}, warmup);
+}
+
+// Prints a line and keeps it for the JSON report. items is the work done by one repetition,
+// zero if throughput makes no sense
+fn report(std::string_view group, std::string_view name, const BenchStats& stats,
+          f64 items = 0., std::string_view unit = "items") -> void;
+
+fn write_report(const char* path) -> bool;
+
+fn bench_culling() -> bool;
+fn bench_logging() -> bool;
+fn bench_jobs() -> bool;
+fn bench_arena() -> bool;
+fn bench_model_loader() -> bool;
+fn bench_image_loader() -> bool;
+fn bench_particles() -> bool;
+fn bench_render() -> bool;
+
+} // namespace kappa::bench
@@ -0,0 +1,86 @@
+#include "./bench.hpp"
+#include "render/culling.hpp"
+
+#include <random>
+
+namespace kappa::bench {
+
+using namespace kappa::render;
+
+namespace {
+
+constexpr u32 CULL_WARMUP = 10;
+constexpr u32 CULL_REPS = 200;
+
+// Roughly a 90 degree cone looking down -z, 0.1 to 500 units deep
+fn make_frustum() -> Frustum {
+  constexpr f32 s = .70710678f;
+  Frustum frustum;
+  frustum.planes[0] = ran::Vec4f32(s, 0.f, -s, 0.f);
+  frustum.planes[1] = ran::Vec4f32(-s, 0.f, -s, 0.f);
+  frustum.planes[2] = ran::Vec4f32(0.f, s, -s, 0.f);
+  frustum.planes[3] = ran::Vec4f32(0.f, -s, -s, 0.f);
+  frustum.planes[4] = ran::Vec4f32(0.f, 0.f, -1.f, -.1f);
+  frustum.planes[5] = ran::Vec4f32(0.f, 0.f, 1.f, 500.f);
+  return frustum;
+}
+
+fn make_boxes(u32 count) -> AabbSoA {
+  std::mt19937 rng(0x6b617070);
+  std::uniform_real_distribution<f32> pos(-500.f, 500.f);
+  std::uniform_real_distribution<f32> extent(.5f, 4.f);
+  AabbSoA boxes;
+  boxes.reserve(count);
+  for (u32 i = 0; i < count; ++i) {
+    const ran::Vec3f32 center(pos(rng), pos(rng), pos(rng));
+    const ran::Vec3f32 half(extent(rng), extent(rng), extent(rng));
+    boxes.push(i, ran::Vec3f32(center.x - half.x, center.y - half.y, center.z - half.z),
+               ran::Vec3f32(center.x + half.x, center.y + half.y, center.z + half.z));
+  }
+  return boxes;
+}
+
+template<typename F>
+fn time_cull(F&& cull, const Frustum& frustum, const AabbSoA& boxes, Vec<u32>& visible)
+  -> std::pair<BenchStats, CullStats> {
+  CullStats stats{};
+  const auto timing = measure(CULL_WARMUP, CULL_REPS, [&]() {
+    stats = cull(frustum, boxes, visible);
+  });
+  return {timing, stats};
+}
+
+fn run(u32 count) -> bool {
+  const auto frustum = make_frustum();
+  const auto boxes = make_boxes(count);
+  Vec<u32> scalar_visible, simd_visible;
+  scalar_visible.reserve(count);
+  simd_visible.reserve(count);
+
+  const auto [scalar_time, scalar_stats] =
+    time_cull(cull_aabbs_scalar, frustum, boxes, scalar_visible);
+  const auto [simd_time, simd_stats] = time_cull(cull_aabbs, frustum, boxes, simd_visible);
+
+  report("culling", buffer_str_fmt<64>("scalar/{}", count).as_view(), scalar_time, count,
+         "boxes");
+  report("culling", buffer_str_fmt<64>("simd/{}", count).as_view(), simd_time, count, "boxes");
+  fmt::print("  {} boxes: {:.2f}x, {} visible\n", count, scalar_time.mean / simd_time.mean,
+             simd_stats.visible);
+  if (scalar_visible != simd_visible) {
+    fmt::print("  mismatch! scalar found {} visible\n", scalar_stats.visible);
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+fn bench_culling() -> bool {
+  fmt::print("culling:\n");
+  bool ok = true;
+  ok &= run(10000);
+  ok &= run(100000);
+  return ok;
+}
+
+} // namespace kappa::bench
@@ -0,0 +1,67 @@
+#include "./bench.hpp"
+#include "jobs.hpp"
+
+#include <cmath>
+#include <thread>
+
+namespace kappa::bench {
+
+namespace {
+
+constexpr size_t JOB_ELEMENTS = 1u << 20;
+constexpr u32 JOB_WORK = 64; // Iterations per element, keeps it compute bound
+constexpr u32 JOB_WARMUP = 1;
+constexpr u32 JOB_RUNS = 10;
+
+fn run_workload(Span<const f32> input, Span<f32> output) -> void {
+  jobs::parallel_for(input.size(), 1024, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      f32 x = input[i];
+      for (u32 j = 0; j < JOB_WORK; ++j) {
+        x = std::sin(x) * 1.5f + std::sqrt(std::fabs(x));
+      }
+      output[i] = x;
+    }
+  });
+}
+
+fn time_workload(Span<const f32> input, Span<f32> output, u32 threads) -> BenchStats {
+  const auto stats = measure(JOB_WARMUP, JOB_RUNS, [&]() {
+    run_workload(input, output);
+  });
+  report("jobs", buffer_str_fmt<32>("parallel_for/{}_threads", threads).as_view(), stats,
+         (f64)input.size(), "elements");
+  return stats;
+}
+
+} // namespace
+
+fn bench_jobs() -> bool {
+  Vec<f32> input(JOB_ELEMENTS);
+  for (size_t i = 0; i < JOB_ELEMENTS; ++i) {
+    input[i] = (f32)(i % 1000) * .001f;
+  }
+  Vec<f32> expected(JOB_ELEMENTS), output(JOB_ELEMENTS);
+
+  // Single threaded reference, the job system isn't running yet
+  fmt::print("jobs ({} elements):\n", JOB_ELEMENTS);
+  const auto base =
+    time_workload({input.data(), input.size()}, {expected.data(), expected.size()}, 1);
+
+  bool ok = true;
+  const u32 max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (u32 threads = 2; threads <= max_threads; threads *= 2) {
+    jobs::initialize(threads - 1);
+    const auto stats =
+      time_workload({input.data(), input.size()}, {output.data(), output.size()}, threads);
+    jobs::shutdown();
+    fmt::print("  {:>2} threads: {:.2f}x\n", threads, base.mean / stats.mean);
+    if (output != expected) {
+      fmt::print("  mismatch with {} threads!\n", threads);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+} // namespace kappa::bench
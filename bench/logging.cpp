@@ -0,0 +1,79 @@
+#include "./bench.hpp"
+
+#include <fmt/chrono.h>
+
+#include <chrono>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace kappa::bench {
+
+namespace {
+
+constexpr u32 LOG_BURSTS = 200;
+constexpr u32 LOG_BURST_SIZE = 512;
+
+// What log_at_level used to do, format, stamp and print on the calling thread
+template<typename... Args>
+void legacy_log(std::string_view prefix, fmt::format_string<Args...> fmt, Args&&... args) {
+  const auto str = fmt::format(fmt, std::forward<Args>(args)...);
+  const auto now = std::chrono::system_clock::now();
+  const i64 ms =
+    std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+  const std::time_t time = std::chrono::system_clock::to_time_t(now);
+  const std::tm* time_tm = std::localtime(&time);
+  fmt::print("[{:%H:%M:%S}.{:03d}]\033{}\033[0m{}\n", *time_tm, (int)ms, prefix, str);
+}
+
+// Times every call on its own, bursts fit in the log queue like a noisy frame would
+template<typename F>
+fn measure_calls(F&& log_line) -> std::pair<BenchStats, f64> {
+  Vec<f64> samples;
+  samples.reserve(LOG_BURSTS * LOG_BURST_SIZE);
+  for (u32 burst = 0; burst < LOG_BURSTS; ++burst) {
+    for (u32 i = 0; i < LOG_BURST_SIZE; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      log_line(burst, i);
+      const auto end = std::chrono::steady_clock::now();
+      samples.push_back(std::chrono::duration<f64, std::nano>(end - start).count());
+    }
+    log_flush();
+  }
+  const auto stats = compute_stats({samples.data(), samples.size()}, 0);
+  return {stats, samples[samples.size() * 99 / 100]};
+}
+
+} // namespace
+
+fn bench_logging() -> bool {
+  // Nobody wants to see a hundred thousand lines, send them to /dev/null while timing
+  std::fflush(stdout);
+  const int saved_stdout = dup(STDOUT_FILENO);
+  const int null_fd = open("/dev/null", O_WRONLY);
+  if (saved_stdout < 0 || null_fd < 0) {
+    return false;
+  }
+  dup2(null_fd, STDOUT_FILENO);
+  close(null_fd);
+
+  const auto [legacy, legacy_p99] = measure_calls([](u32 burst, u32 i) {
+    legacy_log("[0;32m[DEBUG]", " Burst {} line {}: {:.3f}", burst, i, i * .5f);
+  });
+  const auto [async, async_p99] = measure_calls([](u32 burst, u32 i) {
+    log_debug(" Burst {} line {}: {:.3f}", burst, i, i * .5f);
+  });
+
+  std::fflush(stdout);
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(saved_stdout);
+
+  fmt::print("logging ({} calls, per call):\n", LOG_BURSTS * LOG_BURST_SIZE);
+  report("logging", "legacy", legacy, 1., "lines");
+  report("logging", "async", async, 1., "lines");
+  fmt::print("  p99: legacy {:.1f}ns, async {:.1f}ns\n", legacy_p99, async_p99);
+  return true;
+}
+
+} // namespace kappa::bench
@@ -0,0 +1,40 @@
+#include "./bench.hpp"
+
+int kappa::g_argc;
+char** kappa::g_argv;
+
+int main(int argc, char* argv[]) {
+  using namespace kappa;
+  g_argc = argc;
+  g_argv = argv;
+  if (!bench::parse_opts(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  struct BenchEntry {
+    const char* group;
+    fn (*func)() -> bool;
+  };
+
+  static constexpr BenchEntry benches[] = {
+    {"culling", bench::bench_culling},
+    {"logging", bench::bench_logging},
+    {"jobs", bench::bench_jobs},
+    {"arena", bench::bench_arena},
+    {"model_loader", bench::bench_model_loader},
+    {"image_loader", bench::bench_image_loader},
+    {"particles", bench::bench_particles},
+    {"render", bench::bench_render},
+  };
+
+  bool ok = true;
+  for (const auto& bench : benches) {
+    if (bench::group_enabled(bench.group)) {
+      ok &= bench.func();
+    }
+  }
+  if (const char* path = bench::opts().json_path) {
+    ok &= bench::write_report(path);
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,69 @@
+#include "./bench.hpp"
+#include "physics/particle.hpp"
+
+#include <algorithm>
+
+namespace kappa::bench {
+
+using namespace kappa::physics;
+
+namespace {
+
+constexpr real PARTICLE_DT = 1.f / 60.f;
+constexpr u32 PARTICLE_WARMUP = 2;
+constexpr u64 PARTICLE_WORK = 10'000'000; // Particle updates per case, spread over the reps
+
+fn particle_reps(u32 count) -> u32 {
+  return (u32)std::clamp<u64>(PARTICLE_WORK / count, 10, 1000);
+}
+
+fn make_particles(u32 count) -> Vec<ParticleEntity> {
+  Vec<ParticleEntity> particles;
+  particles.reserve(count);
+  for (u32 i = 0; i < count; ++i) {
+    const f32 x = (f32)(i % 1000);
+    const f32 y = (f32)(i / 1000 % 1000);
+    particles.emplace_back(ran::Vec3f32(x, y, 0.f), 1.f + (i % 7), ran::Vec3f32(1.f, 2.f, 0.f),
+                           .99f);
+  }
+  return particles;
+}
+
+fn run(u32 count) -> void {
+  auto particles = make_particles(count);
+  const auto integrate = measure(PARTICLE_WARMUP, particle_reps(count), [&]() {
+    for (auto& particle : particles) {
+      particle.integrate(PARTICLE_DT);
+    }
+  });
+  report("particles", buffer_str_fmt<64>("integrate/{}", count).as_view(), integrate, count,
+         "particles");
+
+  // Gravity and drag on everything, like a basic particle system would
+  particle_gravity gravity;
+  ParticleDrag drag(.1f, .01f);
+  ParticelForceRegistry registry;
+  for (u32 i = 0; i < count; ++i) {
+    registry.add_force(i, 0, gravity);
+    registry.add_force(i, 1, drag);
+  }
+  const auto update = measure(PARTICLE_WARMUP, particle_reps(count), [&]() {
+    registry.update_forces(PARTICLE_DT, [&](u64 particle, u32) -> ParticleEntity& {
+      return particles[particle];
+    });
+  });
+  report("particles", buffer_str_fmt<64>("update_forces/{}", count).as_view(), update, count,
+         "particles");
+}
+
+} // namespace
+
+fn bench_particles() -> bool {
+  fmt::print("particles:\n");
+  for (const u32 count : {1'000u, 10'000u, 100'000u, 1'000'000u}) {
+    run(count);
+  }
+  return true;
+}
+
+} // namespace kappa::bench
@@ -0,0 +1,146 @@
+#include "./bench.hpp"
+#include "jobs.hpp"
+#include "render/context.hpp"
+#include "render/scene.hpp"
+
+namespace kappa::bench {
+
+using namespace kappa::render;
+
+namespace {
+
+constexpr VkExtent2D RENDER_EXTENT{1280, 720};
+constexpr u32 FRAME_WARMUP = 60;
+constexpr u32 FRAME_REPS = 500;
+constexpr u32 UPLOAD_WARMUP = 2;
+constexpr u32 UPLOAD_REPS = 20;
+constexpr f64 FRAME_DT = 1. / 60.;
+
+struct GridMesh {
+  Vec<u32> indices;
+  Vec<ran::Vec3f32> positions;
+  Vec<ran::Vec3f32> normals;
+  Vec<ran::Vec2f32> uvs;
+  Vec<ran::Vec3f32> tangents;
+  Vec<ran::Vec3f32> bitangents;
+
+  fn data() const -> SceneData::MeshData {
+    return {
+      .indices = {indices.data(), indices.size()},
+      .positions = {positions.data(), positions.size()},
+      .normals = {normals.data(), normals.size()},
+      .uvs = {uvs.data(), uvs.size()},
+      .tangents = {tangents.data(), tangents.size()},
+      .bitangents = {bitangents.data(), bitangents.size()},
+      .bbox_min = ran::Vec3f32(-1.f, -1.f, 0.f),
+      .bbox_max = ran::Vec3f32(1.f, 1.f, 0.f),
+    };
+  }
+};
+
+// Flat quad grid spanning [-1, 1] on xy
+fn make_grid(u32 quads) -> GridMesh {
+  GridMesh mesh;
+  const u32 side = quads + 1;
+  for (u32 y = 0; y < side; ++y) {
+    for (u32 x = 0; x < side; ++x) {
+      const f32 u = (f32)x / quads;
+      const f32 v = (f32)y / quads;
+      mesh.positions.emplace_back(u * 2.f - 1.f, v * 2.f - 1.f, 0.f);
+      mesh.normals.emplace_back(0.f, 0.f, 1.f);
+      mesh.uvs.emplace_back(u, v);
+      mesh.tangents.emplace_back(1.f, 0.f, 0.f);
+      mesh.bitangents.emplace_back(0.f, 1.f, 0.f);
+    }
+  }
+  for (u32 y = 0; y < quads; ++y) {
+    for (u32 x = 0; x < quads; ++x) {
+      const u32 a = y * side + x;
+      mesh.indices.insert(mesh.indices.end(), {a, a + 1, a + side + 1, a, a + side + 1, a + side});
+    }
+  }
+  return mesh;
+}
+
+// Small copies scattered over clip space, the view and projection are both identity
+fn instance_transform(u32 idx) -> ran::Mat4f32 {
+  auto transform = ran::Mat4f32::identity();
+  f32* m = transform.data();
+  m[0] = m[5] = m[10] = .05f;
+  m[12] = (f32)(idx % 64) / 32.f - 1.f;
+  m[13] = (f32)(idx / 64 % 64) / 32.f - 1.f;
+  m[14] = .5f;
+  return transform;
+}
+
+fn run_frames(RenderContext& renderer, SceneData& scene, u32 instances) -> void {
+  u64 draws = 0;
+  u64 frames = 0;
+  const auto stats = measure(FRAME_WARMUP, FRAME_REPS, [&]() {
+    renderer.draw_things(scene, FRAME_DT, 0.);
+    draws += scene.draw_count();
+    ++frames;
+  });
+  vkDeviceWaitIdle(renderer.get_vk().device());
+  report("render", buffer_str_fmt<64>("headless_frame/{}_instances", instances).as_view(), stats,
+         (f64)instances, "instances");
+  fmt::print("    {:.1f} draws/frame\n", (f64)draws / frames);
+}
+
+fn run_uploads(RenderContext& renderer, SceneData& scene) -> void {
+  // What soa_to_aos and copy_buffers used to do, the loader streams go straight to staging
+  const auto grid = make_grid(256);
+  const auto data = grid.data();
+  const f64 bytes = (f64)(data.positions.size_bytes() + data.uvs.size_bytes() +
+                          data.indices.size_bytes());
+  const auto stats = measure(UPLOAD_WARMUP, UPLOAD_REPS, [&]() {
+    const auto mesh = scene.add_mesh(data, "upload");
+    // Waits on the transfer queue too
+    vkDeviceWaitIdle(renderer.get_vk().device());
+    scene.remove_mesh(mesh);
+  });
+  report("render", "mesh_upload/256x256", stats, bytes, "bytes");
+}
+
+} // namespace
+
+fn bench_render() -> bool {
+  fmt::print("render ({}x{} headless):\n", RENDER_EXTENT.width, RENDER_EXTENT.height);
+  jobs::initialize();
+  const DeferFn jobs_defer = []() {
+    jobs::shutdown();
+  };
+
+  TypeBuffer<RenderContext> renderer;
+  try {
+    RenderContext::initialize_headless(renderer, RENDER_EXTENT);
+  } catch (const std::exception& ex) {
+    // No Vulkan driver around, not the benchmark's fault
+    fmt::print("  skipped, failed to create a headless context: {}\n", ex.what());
+    return true;
+  }
+  const DeferFn renderer_defer = [&]() {
+    renderer.destroy();
+  };
+
+  TypeBuffer<SceneData> scene;
+  SceneData::initialize(scene, *renderer);
+  const DeferFn scene_defer = [&]() {
+    scene.destroy();
+  };
+
+  run_uploads(*renderer, *scene);
+
+  const auto grid = make_grid(32);
+  const auto mesh = scene->add_mesh(grid.data(), "grid");
+  u32 instances = 0;
+  for (const u32 count : {1u, 256u, 4096u}) {
+    for (; instances < count; ++instances) {
+      scene->add_instance(mesh, instance_transform(instances));
+    }
+    run_frames(*renderer, *scene, instances);
+  }
+  return true;
+}
+
+} // namespace kappa::bench
@@ -0,0 +1,175 @@
+#include "./bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace kappa::bench {
+
+namespace {
+
+struct BenchResult {
+  std::string group;
+  std::string name;
+  BenchStats stats;
+  f64 items;
+  std::string unit;
+};
+
+BenchOpts bench_opts{nullptr, nullptr, 1.};
+Vec<BenchResult> results;
+
+fn write_escaped(fmt::memory_buffer& out, std::string_view str) -> void {
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+    }
+    out.push_back(c);
+  }
+}
+
+// Picks a unit so the number stays readable
+fn format_time(f64 ns) -> BuffStr<32> {
+  if (ns >= 1e9) {
+    return buffer_str_fmt<32>("{:.3f}s", ns / 1e9);
+  } else if (ns >= 1e6) {
+    return buffer_str_fmt<32>("{:.3f}ms", ns / 1e6);
+  } else if (ns >= 1e3) {
+    return buffer_str_fmt<32>("{:.3f}us", ns / 1e3);
+  }
+  return buffer_str_fmt<32>("{:.1f}ns", ns);
+}
+
+} // namespace
+
+fn parse_opts(int argc, char* argv[]) -> bool {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "--json" && i + 1 < argc) {
+      bench_opts.json_path = argv[++i];
+    } else if (arg == "--filter" && i + 1 < argc) {
+      bench_opts.filter = argv[++i];
+    } else if (arg == "--quick") {
+      bench_opts.rep_scale = .1;
+    } else {
+      fmt::print(stderr, "usage: {} [--json path] [--filter group] [--quick]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+fn opts() -> const BenchOpts& {
+  return bench_opts;
+}
+
+fn group_enabled(std::string_view group) -> bool {
+  return !bench_opts.filter || group.find(bench_opts.filter) != std::string_view::npos;
+}
+
+fn scaled_reps(u32 reps) -> u32 {
+  return std::max(1u, (u32)(reps * bench_opts.rep_scale));
+}
+
+fn compute_stats(Span<f64> samples, u32 warmup) -> BenchStats {
+  BenchStats stats{};
+  stats.warmup = warmup;
+  stats.reps = (u32)samples.size();
+  if (samples.empty()) {
+    return stats;
+  }
+  std::sort(samples.begin(), samples.end());
+  f64 total = 0.;
+  for (const f64 sample : samples) {
+    total += sample;
+  }
+  stats.mean = total / samples.size();
+  f64 variance = 0.;
+  for (const f64 sample : samples) {
+    variance += (sample - stats.mean) * (sample - stats.mean);
+  }
+  // Sample variance, a single repetition has none
+  stats.stddev = samples.size() > 1 ? std::sqrt(variance / (samples.size() - 1)) : 0.;
+  stats.min = samples[0];
+  stats.median = samples[samples.size() / 2];
+  stats.max = samples[samples.size() - 1];
+  return stats;
+}
+
+fn report(std::string_view group, std::string_view name, const BenchStats& stats, f64 items,
+          std::string_view unit) -> void {
+  const f64 rel_stddev = stats.mean > 0. ? stats.stddev / stats.mean * 100. : 0.;
+  fmt::print("  {:<32} {:>12} +-{:5.1f}% (median {}, {} reps)", name,
+             format_time(stats.mean).c_str(), rel_stddev, format_time(stats.median).c_str(),
+             stats.reps);
+  if (items > 0. && stats.mean > 0.) {
+    fmt::print(", {:.3g} {}/s", items / (stats.mean / 1e9), unit);
+  }
+  fmt::print("\n");
+  results.push_back({std::string(group), std::string(name), stats, items, std::string(unit)});
+}
+
+fn write_report(const char* path) -> bool {
+  fmt::memory_buffer out;
+  const auto inserter = std::back_inserter(out);
+  fmt::format_to(inserter, "{{\n  \"schema\": 1,\n  \"build\": {{");
+#ifdef NDEBUG
+  fmt::format_to(inserter, "\"debug\": false, ");
+#else
+  fmt::format_to(inserter, "\"debug\": true, ");
+#endif
+  fmt::format_to(inserter, "\"profile\": {}, \"alloc_stats\": {}, \"compiler\": \"",
+                 KA_PROFILE ? "true" : "false", KA_ALLOC_STATS ? "true" : "false");
+  write_escaped(out, __VERSION__);
+  fmt::format_to(inserter, "\"}},\n  \"threads\": {},\n  \"quick\": {},\n  \"results\": [",
+                 std::thread::hardware_concurrency(),
+                 bench_opts.rep_scale < 1. ? "true" : "false");
+
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& result = results[i];
+    const auto& stats = result.stats;
+    fmt::format_to(inserter, "{}\n    {{\"group\": \"", i ? "," : "");
+    write_escaped(out, result.group);
+    fmt::format_to(inserter, "\", \"name\": \"");
+    write_escaped(out, result.name);
+    fmt::format_to(inserter,
+                   "\", \"warmup\": {}, \"reps\": {}, \"mean_ns\": {:.3f}, \"stddev_ns\": {:.3f}, "
+                   "\"variance_ns2\": {:.3f}, \"min_ns\": {:.3f}, \"median_ns\": {:.3f}, "
+                   "\"max_ns\": {:.3f}",
+                   stats.warmup, stats.reps, stats.mean, stats.stddev,
+                   stats.stddev * stats.stddev, stats.min, stats.median, stats.max);
+    if (result.items > 0.) {
+      fmt::format_to(inserter, ", \"items\": {:.0f}, \"unit\": \"", result.items);
+      write_escaped(out, result.unit);
+      fmt::format_to(inserter, "\", \"items_per_sec\": {:.3f}",
+                     stats.mean > 0. ? result.items / (stats.mean / 1e9) : 0.);
+    }
+    fmt::format_to(inserter, "}}");
+  }
+  fmt::format_to(inserter, "\n  ],\n  \"memory\": {{");
+  for (u32 i = 0; i < (u32)MemTag::count; ++i) {
+    const auto mem = mem_tag_stats((MemTag)i);
+    fmt::format_to(inserter,
+                   "{}\n    \"{}\": {{\"current_bytes\": {}, \"peak_bytes\": {}, \"live\": {}, "
+                   "\"total\": {}}}",
+                   i ? "," : "", mem_tag_name((MemTag)i), mem.current, mem.peak, mem.count,
+                   mem.total);
+  }
+  fmt::format_to(inserter, "\n  }}\n}}\n");
+
+  std::FILE* file = std::strcmp(path, "-") == 0 ? stdout : std::fopen(path, "wb");
+  if (!file) {
+    fmt::print(stderr, "Failed to open \"{}\"\n", path);
+    return false;
+  }
+  const bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+  if (file != stdout) {
+    std::fclose(file);
+  }
+  return ok;
+}
+
+} // namespace kappa::bench
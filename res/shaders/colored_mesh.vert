@@ -1,40 +1,45 @@
 #version 460
 #extension GL_EXT_buffer_reference : require
 
-layout (location = 0) out vec3 out_color;
 layout (location = 1) out vec2 out_uv;
 
-struct Vertex {
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	vec4 color;
-}; 
+// Tightly packed streams, read them as plain floats to dodge the vec3 std430 padding
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer PositionBuffer {
+	float positions[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer UvBuffer {
+	float uvs[];
+};
 
-layout(buffer_reference, std430) readonly buffer VertexBuffer {
-	Vertex vertices[];
+layout(buffer_reference, std430) readonly buffer InstanceBuffer {
+	mat4 transforms[];
 };
 
 //push constants block
 layout( push_constant ) uniform constants
 {	
-	mat4 world;
 	mat4 view;
 	mat4 proj;
-	VertexBuffer vertex_buffer;
+	PositionBuffer position_buffer;
+	UvBuffer uv_buffer;
+	InstanceBuffer instance_buffer;
+	uint texture_index;
 } push_constants;
 
 void main() 
 {	
-	Vertex v = push_constants.vertex_buffer.vertices[gl_VertexIndex];
+	uint idx = gl_VertexIndex;
+	vec3 position = vec3(push_constants.position_buffer.positions[3*idx+0],
+	                     push_constants.position_buffer.positions[3*idx+1],
+	                     push_constants.position_buffer.positions[3*idx+2]);
+	mat4 world = push_constants.instance_buffer.transforms[gl_InstanceIndex];
 	gl_Position =
     push_constants.proj *
     push_constants.view *
-    push_constants.world *
-    vec4(v.position, 1.0f);
+    world *
+    vec4(position, 1.0f);
 
-	out_color = v.color.xyz;
-	out_uv.x = v.uv_x;
-	out_uv.y = v.uv_y;
-}
\ No newline at end of file
+	out_uv.x = push_constants.uv_buffer.uvs[2*idx+0];
+	out_uv.y = push_constants.uv_buffer.uvs[2*idx+1];
+}
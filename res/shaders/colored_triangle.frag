@@ -1,12 +1,17 @@
 #version 460
 
-layout (location = 0) in vec3 in_color;
 layout (location = 1) in vec2 in_uv;
 
 layout (location = 0) out vec4 frag_color;
 
-layout (set = 0, binding = 0) uniform sampler2D u_tex;
+// Bindless table, same size as RenderContext::MAX_IMAGES
+layout (set = 0, binding = 0) uniform sampler2D u_textures[512];
+
+layout( push_constant ) uniform constants
+{
+	layout(offset = 152) uint texture_index;
+} push_constants;
 
 void main() {
-  frag_color = vec4(in_color, 1.f)*texture(u_tex, in_uv);
-}
\ No newline at end of file
+  frag_color = texture(u_textures[push_constants.texture_index], in_uv);
+}
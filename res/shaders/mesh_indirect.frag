@@ -0,0 +1,14 @@
+#version 460
+
+layout (location = 1) in vec2 in_uv;
+layout (location = 2) flat in uint in_texture;
+
+layout (location = 0) out vec4 frag_color;
+
+// Bindless table, same size as RenderContext::MAX_IMAGES
+layout (set = 0, binding = 0) uniform sampler2D u_textures[512];
+
+void main() {
+  // Each indirect draw covers a single mesh, so the index is uniform within the draw
+  frag_color = texture(u_textures[in_texture], in_uv);
+}
@@ -0,0 +1,61 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+
+layout (location = 1) out vec2 out_uv;
+layout (location = 2) flat out uint out_texture;
+
+struct Object {
+  mat4 world;
+  vec4 bbox_min;
+  vec4 bbox_max;
+  uint bucket;
+  uint texture_index;
+  uint pad0;
+  uint pad1;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer PositionBuffer {
+	float positions[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer UvBuffer {
+	float uvs[];
+};
+
+layout(buffer_reference, std430) readonly buffer ObjectBuffer {
+	Object objects[];
+};
+
+layout(buffer_reference, std430) readonly buffer VisibleBuffer {
+	uint visible[];
+};
+
+layout( push_constant ) uniform constants
+{
+	mat4 view;
+	mat4 proj;
+	PositionBuffer position_buffer;
+	UvBuffer uv_buffer;
+	ObjectBuffer object_buffer;
+	VisibleBuffer visible_buffer;
+} push_constants;
+
+void main()
+{
+	// Culled instances are packed per mesh, first_instance points at the mesh range
+	uint obj_idx = push_constants.visible_buffer.visible[gl_InstanceIndex];
+	Object obj = push_constants.object_buffer.objects[obj_idx];
+	uint idx = gl_VertexIndex;
+	vec3 position = vec3(push_constants.position_buffer.positions[3*idx+0],
+	                     push_constants.position_buffer.positions[3*idx+1],
+	                     push_constants.position_buffer.positions[3*idx+2]);
+	gl_Position =
+    push_constants.proj *
+    push_constants.view *
+    obj.world *
+    vec4(position, 1.0f);
+
+	out_uv.x = push_constants.uv_buffer.uvs[2*idx+0];
+	out_uv.y = push_constants.uv_buffer.uvs[2*idx+1];
+	out_texture = obj.texture_index;
+}
@@ -0,0 +1,353 @@
+#include "./internal.hpp"
+#include "jobs.hpp"
+#include "profiler.hpp"
+
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#define CACHE_LOG(_level, _fmt, ...) \
+  KA_LOG(_level, "[ASSET_CACHE] " _fmt __VA_OPT__(, ) __VA_ARGS__)
+
+namespace kappa::assets {
+
+bool write_file_atomic(const char* path, const void* data, size_t size) {
+  // Written next to it and renamed, so a crash can't leave half a file behind
+  const auto tmp_path = buffer_str_fmt<264>("{}.tmp", path);
+  std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  const bool written = std::fwrite(data, 1, size, file) == size;
+  const bool closed = std::fclose(file) == 0;
+  if (!written || !closed || std::rename(tmp_path.c_str(), path) != 0) {
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+namespace cache {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr std::string_view DEPS_EXT = ".deps";
+
+struct CacheEntry {
+  u64 size; // Including the .deps file
+  i64 last_used;
+};
+
+struct StoreTask {
+  BufferName file;
+  Vec<u8> blob;
+  Vec<BufferPath> deps;
+};
+
+struct CacheState {
+  BufferPath dir;
+  u64 max_bytes = 0;
+  std::atomic<bool> enabled = false;
+
+  std::mutex lock;
+  std::unordered_map<std::string, CacheEntry> entries; // By file name
+  std::unordered_set<std::string> writing;
+  u64 bytes = 0;
+
+  std::atomic<u64> hits = 0;
+  std::atomic<u64> misses = 0;
+  std::atomic<u64> writes = 0;
+  std::atomic<u64> evictions = 0;
+  jobs::Counter pending;
+};
+
+CacheState state;
+
+fn now_stamp() -> i64 {
+  return fs::file_time_type::clock::now().time_since_epoch().count();
+}
+
+fn entry_path(std::string_view file) -> BufferPath {
+  return buffer_str_fmt<256>("{}/{}", state.dir.as_view(), file);
+}
+
+fn deps_path(std::string_view file) -> BufferPath {
+  return buffer_str_fmt<256>("{}/{}{}", state.dir.as_view(), file, DEPS_EXT);
+}
+
+// Anything else in there isn't ours
+fn is_entry_name(std::string_view name) -> bool {
+  if (name.size() != 21 || name[16] != '.') {
+    return false;
+  }
+  const auto ext = name.substr(17);
+  if (ext != "kmdl" && ext != "kimg") {
+    return false;
+  }
+  for (const char c : name.substr(0, 16)) {
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+fn remove_entry_files(std::string_view file) -> void {
+  std::remove(entry_path(file).c_str());
+  std::remove(deps_path(file).c_str());
+}
+
+// With the lock held
+fn evict() -> void {
+  while (state.bytes > state.max_bytes && !state.entries.empty()) {
+    auto oldest = state.entries.begin();
+    for (auto it = state.entries.begin(); it != state.entries.end(); ++it) {
+      if (it->second.last_used < oldest->second.last_used) {
+        oldest = it;
+      }
+    }
+    CACHE_LOG(verbose, "Evicting \"{}\" ({} bytes)", oldest->first, oldest->second.size);
+    remove_entry_files(oldest->first);
+    state.bytes -= oldest->second.size;
+    state.entries.erase(oldest);
+    state.evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// One "hash path" line per dependency
+fn deps_valid(std::string_view file) -> bool {
+  const auto deps = MappedFile::open(deps_path(file).c_str());
+  std::string_view text{reinterpret_cast<const char*>(deps.data()), deps.size()};
+  while (!text.empty()) {
+    const size_t line_end = std::min(text.find('\n'), text.size());
+    const auto line = text.substr(0, line_end);
+    text.remove_prefix(std::min(line_end + 1, text.size()));
+    if (line.size() < 18 || line[16] != ' ') {
+      return false;
+    }
+    u64 hash = 0;
+    const auto [ptr, ec] = std::from_chars(line.data(), line.data() + 16, hash, 16);
+    if (ec != std::errc{} || ptr != line.data() + 16) {
+      return false;
+    }
+    BufferPath dep_path;
+    dep_path.copy_from(line.data() + 17, line.size() - 17);
+    const auto dep_hash = hash_file(dep_path.c_str());
+    if (!dep_hash.has_value() || *dep_hash != hash) {
+      CACHE_LOG(verbose, "\"{}\" changed, dropping \"{}\"", dep_path.as_view(), file);
+      return false;
+    }
+  }
+  return true;
+}
+
+fn write_entry(StoreTask& task) -> void {
+  KA_PROFILE_ZONE("cache::write_entry");
+  const auto file = task.file.as_view();
+  const DeferFn done = [&]() {
+    std::scoped_lock lock{state.lock};
+    state.writing.erase(std::string{file});
+  };
+
+  fmt::memory_buffer deps;
+  for (const auto& dep : task.deps) {
+    const auto hash = hash_file(dep.c_str());
+    if (!hash.has_value()) {
+      CACHE_LOG(warn, "Failed to read \"{}\", not caching \"{}\"", dep.as_view(), file);
+      return;
+    }
+    fmt::format_to(std::back_inserter(deps), "{:016x} {}\n", *hash, dep.as_view());
+  }
+  // The deps go first, an entry without them would look like it has none
+  if (!write_file_atomic(deps_path(file).c_str(), deps.data(), deps.size()) ||
+      !write_file_atomic(entry_path(file).c_str(), task.blob.data(), task.blob.size())) {
+    CACHE_LOG(warn, "Failed to write \"{}\"", file);
+    remove_entry_files(file);
+    return;
+  }
+
+  std::scoped_lock lock{state.lock};
+  auto& entry = state.entries[std::string{file}];
+  state.bytes -= entry.size;
+  entry.size = task.blob.size() + deps.size();
+  entry.last_used = now_stamp();
+  state.bytes += entry.size;
+  state.writes.fetch_add(1, std::memory_order_relaxed);
+  CACHE_LOG(verbose, "Stored \"{}\" ({} bytes)", file, entry.size);
+  evict();
+}
+
+} // namespace
+
+void initialize(const char* dir, u64 max_bytes) {
+  KA_PROFILE_ZONE("cache::initialize");
+  ka_assert(!is_enabled(), "Asset cache initialized twice");
+  std::error_code err;
+  fs::create_directories(dir, err);
+  if (err) {
+    CACHE_LOG(warn, "Failed to create cache directory \"{}\": {}", dir, err.message());
+    return;
+  }
+
+  std::scoped_lock lock{state.lock};
+  state.dir.format_from("{}", dir);
+  state.max_bytes = max_bytes;
+  state.entries.clear();
+  state.bytes = 0;
+  for (const auto& item : fs::directory_iterator(dir, err)) {
+    if (!item.is_regular_file(err)) {
+      continue;
+    }
+    const auto name = item.path().filename().string();
+    const auto path = item.path().string();
+    if (name.ends_with(".tmp")) {
+      // Left behind by a crash
+      std::remove(path.c_str());
+      continue;
+    }
+    if (name.ends_with(DEPS_EXT)) {
+      if (!fs::exists(path.substr(0, path.size() - DEPS_EXT.size()), err)) {
+        std::remove(path.c_str());
+      }
+      continue;
+    }
+    if (!is_entry_name(name)) {
+      continue;
+    }
+    u64 size = item.file_size(err);
+    if (err) {
+      continue;
+    }
+    if (const u64 deps_size = fs::file_size(deps_path(name).c_str(), err); !err) {
+      size += deps_size;
+    }
+    const i64 last_used = item.last_write_time(err).time_since_epoch().count();
+    state.entries.emplace(name, CacheEntry{size, last_used});
+    state.bytes += size;
+  }
+  evict();
+  state.enabled.store(true, std::memory_order_release);
+  CACHE_LOG(info, "Asset cache \"{}\" ({} entries, {} bytes)", dir, state.entries.size(),
+            state.bytes);
+}
+
+void shutdown() {
+  if (!is_enabled()) {
+    return;
+  }
+  if (!state.pending.done()) {
+    jobs::wait(state.pending);
+  }
+  state.enabled.store(false, std::memory_order_release);
+  const auto info = stats();
+  CACHE_LOG(info, "{} hits, {} misses, {} writes, {} evictions", info.hits, info.misses,
+            info.writes, info.evictions);
+}
+
+bool is_enabled() {
+  return state.enabled.load(std::memory_order_acquire);
+}
+
+CacheStats stats() {
+  std::scoped_lock lock{state.lock};
+  return {
+    .hits = state.hits.load(std::memory_order_relaxed),
+    .misses = state.misses.load(std::memory_order_relaxed),
+    .writes = state.writes.load(std::memory_order_relaxed),
+    .evictions = state.evictions.load(std::memory_order_relaxed),
+    .bytes = state.bytes,
+    .entries = (u32)state.entries.size(),
+  };
+}
+
+Optional<u64> hash_file(const char* path) {
+  const auto file = MappedFile::open(path);
+  if (file.empty()) {
+    return nullopt;
+  }
+  return hash_bytes(file.data(), file.size());
+}
+
+Optional<BufferPath> lookup(u64 key, std::string_view ext) {
+  if (!is_enabled()) {
+    return nullopt;
+  }
+  KA_PROFILE_ZONE("cache::lookup");
+  const auto file = buffer_str_fmt<32>("{:016x}.{}", key, ext);
+  const fn miss = [&]() -> Optional<BufferPath> {
+    state.misses.fetch_add(1, std::memory_order_relaxed);
+    return nullopt;
+  };
+  {
+    std::scoped_lock lock{state.lock};
+    if (!state.entries.contains(std::string{file.as_view()})) {
+      return miss();
+    }
+  }
+
+  // Hashing the dependencies is still a lot cheaper than importing them again
+  if (!deps_valid(file.as_view())) {
+    std::scoped_lock lock{state.lock};
+    if (auto it = state.entries.find(std::string{file.as_view()}); it != state.entries.end()) {
+      remove_entry_files(file.as_view());
+      state.bytes -= it->second.size;
+      state.entries.erase(it);
+    }
+    return miss();
+  }
+
+  auto path = entry_path(file.as_view());
+  std::scoped_lock lock{state.lock};
+  auto it = state.entries.find(std::string{file.as_view()});
+  if (it == state.entries.end()) {
+    // Evicted while checking
+    return miss();
+  }
+  // The modification time doubles as the last use, so the order survives restarts
+  const auto now = fs::file_time_type::clock::now();
+  std::error_code err;
+  fs::last_write_time(path.c_str(), now, err);
+  it->second.last_used = now.time_since_epoch().count();
+  state.hits.fetch_add(1, std::memory_order_relaxed);
+  return path;
+}
+
+void store(u64 key, std::string_view ext, Vec<u8>&& blob, Vec<BufferPath>&& deps) {
+  if (!is_enabled()) {
+    return;
+  }
+  auto* task = new StoreTask{
+    .file = buffer_str_fmt<128>("{:016x}.{}", key, ext),
+    .blob = std::move(blob),
+    .deps = std::move(deps),
+  };
+  {
+    // Loading the same file twice in a row shouldn't write it twice
+    std::scoped_lock lock{state.lock};
+    if (!state.writing.emplace(task->file.as_view()).second) {
+      delete task;
+      return;
+    }
+  }
+  if (!jobs::is_running()) {
+    write_entry(*task);
+    delete task;
+    return;
+  }
+  jobs::run(
+    [task]() {
+      write_entry(*task);
+      delete task;
+    },
+    &state.pending);
+}
+
+} // namespace cache
+
+} // namespace kappa::assets
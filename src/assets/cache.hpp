@@ -0,0 +1,30 @@
+#pragma once
+
+#include "./ass_common.hpp"
+
+namespace kappa::assets::cache {
+
+struct CacheStats {
+  u64 hits;
+  u64 misses; // Stale entries count as misses too
+  u64 writes;
+  u64 evictions;
+  u64 bytes; // On disk right now
+  u32 entries;
+};
+
+constexpr u64 DEFAULT_MAX_BYTES = 2ull << 30;
+
+// Cooked copies of imported models and images, keyed by the contents of the source file plus the
+// import flags. Once initialized, Model3DLoader and ImageLoader look there first and queue a cook
+// on a miss. Past max_bytes the least recently used entries get deleted
+void initialize(const char* dir, u64 max_bytes = DEFAULT_MAX_BYTES);
+
+// Waits for the pending writes
+void shutdown();
+
+bool is_enabled();
+
+CacheStats stats();
+
+} // namespace kappa::assets::cache
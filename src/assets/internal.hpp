@@ -2,15 +2,18 @@
 
 #include "./ass_common.hpp"
 
+#include "./cache.hpp"
 #include "./model.hpp"
 #include "./texture.hpp"
 
 #include <chimatools/chimatools.hpp>
 
+#include <assimp/DefaultIOSystem.h>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+#include <memory>
 #include <unordered_map>
 
 namespace kappa::assets {
@@ -32,21 +35,60 @@ inline ImageFormat parse_chima_format(chima_image_depth depth, u32 channels) {
   }
 };
 
+inline size_t image_format_size(ImageFormat format) {
+  switch (format) {
+    case ImageFormat::rgb8u: return 3;
+    case ImageFormat::rgba8u: return 4;
+    case ImageFormat::rgb16u: return 6;
+    case ImageFormat::rgba16u: return 8;
+    case ImageFormat::rgb32f: return 12;
+    case ImageFormat::rgba32f: return 16;
+  }
+  KA_UNREACHABLE();
+}
+
+inline size_t image_bytes(Extent2D extent, ImageFormat format) {
+  return (size_t)extent.width * extent.height * image_format_size(format);
+}
+
 inline TextureType parse_tex_type_from_name(std::string_view name) {
   KA_UNUSED(name); // TODO
   return TextureType::albedo;
 };
 
 struct ImageData::ImageInternal {
-  ImageInternal(chima::context&& chima_, chima::image image_) :
-      chima(std::move(chima_)), image(image_), image_destroyer(chima, image) {}
+  // Decoded by chimatools
+  ImageInternal(chima::context&& chima_, chima::image image_, ImageFormat format_) :
+      chima(std::move(chima_)), image(in_place, image_), mapping(), pixels(image_.data()),
+      extent{image_.get().extent.width, image_.get().extent.height}, format(format_),
+      size(image_bytes(extent, format)) {
+    mem_track_alloc(MemTag::textures, size);
+  }
+
+  // Cooked, the pixels point into the mapping
+  ImageInternal(MappedFile&& mapping_, void* pixels_, Extent2D extent_, ImageFormat format_) :
+      chima(), image(nullopt), mapping(std::move(mapping_)), pixels(pixels_), extent(extent_),
+      format(format_), size(image_bytes(extent, format)) {}
+
+  ~ImageInternal() {
+    if (image.has_value()) {
+      mem_track_free(MemTag::textures, size);
+      chima::image::destroy(chima, *image);
+    }
+  }
+
+  NTF_NO_MOVE(ImageInternal);
+  NTF_NO_COPY(ImageInternal);
 
   chima::context chima;
-  chima::image image;
-  chima::scoped_resource<chima::image> image_destroyer;
+  Optional<chima::image> image;
+  MappedFile mapping;
+  void* pixels;
+  Extent2D extent;
   BufferName name;
   BufferPath path;
   ImageFormat format;
+  size_t size; // Pixel bytes
 };
 
 struct ImageLoader::LoaderInternal {
@@ -56,15 +98,30 @@ struct ImageLoader::LoaderInternal {
   Optional<TextureType> type;
 };
 
+constexpr size_t align_up(size_t value, size_t align) {
+  return (value + align - 1) & ~(align - 1);
+}
+
+// Alignment of each array carved out of ModelInternal::stream_block
+constexpr size_t MODEL_STREAM_ALIGN = 64;
+
 struct model_allocator {
   template<typename T>
   T* alloc(size_t n) {
-    return std::allocator<T>().allocate(n);
+    return TaggedAllocator<T, MemTag::models>().allocate(n);
   }
 
   template<typename T>
   void dealloc(T* ptr, size_t count) {
-    std::allocator<T>().deallocate(ptr, count);
+    TaggedAllocator<T, MemTag::models>().deallocate(ptr, count);
+  }
+
+  u8* alloc_block(size_t size, size_t align) {
+    return static_cast<u8*>(tagged_alloc(MemTag::models, size, align));
+  }
+
+  void dealloc_block(u8* ptr, size_t size, size_t align) {
+    tagged_free(MemTag::models, ptr, size, align);
   }
 };
 
@@ -141,14 +198,69 @@ struct Model3DData::ModelInternal {
   size_t material_count;
   u32* material_textures;
   size_t material_textures_count;
+
+  // Every mesh, blend shape and bone array above points in here, imported models only
+  u8* stream_block;
+  size_t stream_block_size;
+
+  // Only for cooked models, owns everything above except the texture table
+  MappedFile mapping;
+};
+
+// Remembers every file the importer opens. The buffers of a glTF or the .mtl of an OBJ end up
+// in the cooked data just like the main file
+struct ModelIOSystem : public Assimp::DefaultIOSystem {
+  Assimp::IOStream* Open(const char* file, const char* mode = "rb") override;
+
+  Vec<BufferPath> opened;
 };
 
 struct Model3DLoader::LoaderInternal {
   Assimp::Importer importer;
+  ModelIOSystem* io; // Owned by the importer
   BufferName model_name;
   BufferPath model_path;
   BufferPath texture_dir;
   u32 importer_flags;
 };
 
+struct CookedModelLoader::LoaderInternal {
+  BufferName model_name;
+  BufferPath model_path;
+};
+
+// Bump when the layout or any of the structs stored as is change
+constexpr u32 KMDL_VERSION = 1;
+constexpr u32 KIMG_VERSION = 1;
+
+// Whole .kmdl file in memory, Model3DData::cook and the cache write it out
+Vec<u8> cook_model_blob(Model3DData::ModelInternal& data);
+
+// Null on failure, with the reason in err. The model keeps the given name and path
+std::unique_ptr<Model3DData::ModelInternal> load_kmdl(const char* kmdl_path,
+                                                      const BufferName& name,
+                                                      const BufferPath& path, BuffStr<256>& err);
+
+Vec<u8> cook_image_blob(const ImageData::ImageInternal& image);
+
+ImageData::ImageInternal* load_kimg(const char* kimg_path, BuffStr<256>& err);
+
+// Writes to a temporary next to it and renames, so nobody sees half a file
+bool write_file_atomic(const char* path, const void* data, size_t size);
+
+namespace cache {
+
+// Hash of the file contents, nullopt if it can't be read
+Optional<u64> hash_file(const char* path);
+
+// Path of a live entry, counted as a hit or a miss. Entries with a changed dependency are
+// deleted and count as a miss. Always nullopt if the cache isn't initialized
+Optional<BufferPath> lookup(u64 key, std::string_view ext);
+
+// Writes the entry in the background when the job system is running. The dependencies get
+// hashed while writing, lookup drops the entry once any of them changes
+void store(u64 key, std::string_view ext, Vec<u8>&& blob, Vec<BufferPath>&& deps);
+
+} // namespace cache
+
 } // namespace kappa::assets
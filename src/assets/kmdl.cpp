@@ -0,0 +1,437 @@
+#include "./internal.hpp"
+#include "profiler.hpp"
+
+#define KMDL_LOG(_level, _fmt, ...) KA_LOG(_level, "[KMDL] " _fmt __VA_OPT__(, ) __VA_ARGS__)
+
+namespace kappa::assets {
+
+namespace {
+
+constexpr u32 KMDL_MAGIC = 0x4C444D4B; // "KMDL" in little endian
+constexpr u32 KMDL_BYTE_ORDER = 0x01020304;
+constexpr size_t KMDL_ALIGN = 64;
+constexpr size_t KMDL_PIXEL_ALIGN = 16;
+
+constexpr size_t MAX_MESH_UVS = Model3DData::MAX_MESH_UVS;
+constexpr size_t MAX_MESH_COLORS = Model3DData::MAX_MESH_COLORS;
+
+using TextureData = Model3DData::TextureData;
+
+enum KmdlSection : u32 {
+  KMDL_MESHES = 0,
+  KMDL_MESH_POSITIONS,
+  KMDL_MESH_NORMALS,
+  KMDL_MESH_UVS,
+  KMDL_MESH_COLORS = KMDL_MESH_UVS + MAX_MESH_UVS,
+  KMDL_MESH_TANGENTS = KMDL_MESH_COLORS + MAX_MESH_COLORS,
+  KMDL_MESH_BITANGENTS,
+  KMDL_MESH_BONE_INDICES,
+  KMDL_MESH_BONE_WEIGHTS,
+  KMDL_MESH_INDICES,
+  KMDL_BLEND_SHAPES,
+  KMDL_BLEND_POSITIONS,
+  KMDL_BLEND_NORMALS,
+  KMDL_BLEND_UVS,
+  KMDL_BLEND_COLORS = KMDL_BLEND_UVS + MAX_MESH_UVS,
+  KMDL_BLEND_TANGENTS = KMDL_BLEND_COLORS + MAX_MESH_COLORS,
+  KMDL_BLEND_BITANGENTS,
+  KMDL_BONES,
+  KMDL_BONE_LOCALS,
+  KMDL_BONE_INV_MODELS,
+  KMDL_MATERIALS,
+  KMDL_MATERIAL_TEXTURES,
+  KMDL_TEXTURES,
+  KMDL_TEXTURE_PIXELS,
+
+  KMDL_SECTION_COUNT,
+};
+
+struct KmdlHeader {
+  u32 magic;
+  u32 version;
+  u32 byte_order;
+  u32 section_count;
+  u64 file_size;
+};
+
+struct KmdlSectionEntry {
+  u64 offset; // From the start of the file
+  u64 count;
+  u32 elem_size;
+  u32 elem_align;
+};
+
+constexpr size_t KMDL_TABLE_OFFSET = sizeof(KmdlHeader);
+constexpr size_t KMDL_DATA_OFFSET =
+  align_up(KMDL_TABLE_OFFSET + sizeof(KmdlSectionEntry) * KMDL_SECTION_COUNT, KMDL_ALIGN);
+static_assert(KMDL_TABLE_OFFSET % alignof(KmdlSectionEntry) == 0);
+
+// Every array that gets stored and mapped back as is. The texture table is not in here, it has
+// pointers to patch
+template<typename F>
+void for_each_section(Model3DData::ModelInternal& data, F&& func) {
+  func(KMDL_MESHES, data.meshes, data.mesh_count);
+  func(KMDL_MESH_POSITIONS, data.mesh_positions, data.mesh_position_count);
+  func(KMDL_MESH_NORMALS, data.mesh_normals, data.mesh_normal_count);
+  for (u32 uv = 0; uv < MAX_MESH_UVS; ++uv) {
+    func(KMDL_MESH_UVS + uv, data.mesh_uvs[uv], data.mesh_uv_count[uv]);
+  }
+  for (u32 col = 0; col < MAX_MESH_COLORS; ++col) {
+    func(KMDL_MESH_COLORS + col, data.mesh_colors[col], data.mesh_color_count[col]);
+  }
+  func(KMDL_MESH_TANGENTS, data.mesh_tangents, data.mesh_tangent_count);
+  func(KMDL_MESH_BITANGENTS, data.mesh_bitangents, data.mesh_tangent_count);
+  func(KMDL_MESH_BONE_INDICES, data.mesh_bone_indices, data.mesh_bone_count);
+  func(KMDL_MESH_BONE_WEIGHTS, data.mesh_bone_weights, data.mesh_bone_count);
+  func(KMDL_MESH_INDICES, data.mesh_indices, data.mesh_index_count);
+
+  func(KMDL_BLEND_SHAPES, data.blend_shapes, data.blend_shape_count);
+  func(KMDL_BLEND_POSITIONS, data.blend_positions, data.blend_position_count);
+  func(KMDL_BLEND_NORMALS, data.blend_normals, data.blend_normal_count);
+  for (u32 uv = 0; uv < MAX_MESH_UVS; ++uv) {
+    func(KMDL_BLEND_UVS + uv, data.blend_uvs[uv], data.blend_uv_count[uv]);
+  }
+  for (u32 col = 0; col < MAX_MESH_COLORS; ++col) {
+    func(KMDL_BLEND_COLORS + col, data.blend_colors[col], data.blend_color_count[col]);
+  }
+  func(KMDL_BLEND_TANGENTS, data.blend_tangents, data.blend_tangent_count);
+  func(KMDL_BLEND_BITANGENTS, data.blend_bitangents, data.blend_tangent_count);
+
+  func(KMDL_BONES, data.bones, data.bone_count);
+  func(KMDL_BONE_LOCALS, data.bone_locals, data.bone_count);
+  func(KMDL_BONE_INV_MODELS, data.bone_inv_models, data.bone_count);
+
+  func(KMDL_MATERIALS, data.materials, data.material_count);
+  func(KMDL_MATERIAL_TEXTURES, data.material_textures, data.material_textures_count);
+}
+
+fn texture_pixel_size(const TextureData& tex) -> size_t {
+  return align_up(image_bytes(tex.extent, tex.format), KMDL_PIXEL_ALIGN);
+}
+
+template<typename T>
+fn check_section(const KmdlSectionEntry& entry, const u8* base, size_t file_size,
+                 BuffStr<256>& err) -> bool {
+  if (entry.elem_size != sizeof(T) || entry.elem_align != alignof(T)) {
+    err.format_from("Section element mismatch, expected {} bytes aligned to {} but got {} and {}",
+                    sizeof(T), alignof(T), entry.elem_size, entry.elem_align);
+    return false;
+  }
+  if (!entry.count) {
+    return true;
+  }
+  if (entry.offset > file_size || entry.count > (file_size - entry.offset) / sizeof(T)) {
+    err.format_from("Section out of bounds, {} elements at offset {}", entry.count, entry.offset);
+    return false;
+  }
+  if ((uintptr_t)(base + entry.offset) % alignof(T) != 0) {
+    err.format_from("Misaligned section at offset {}", entry.offset);
+    return false;
+  }
+  return true;
+}
+
+// Names come straight from the file, as_view() and c_str() trust them
+template<size_t N>
+fn name_ok(const BuffStr<N>& name) -> bool {
+  return name.len < N && name.data[name.len] == '\0';
+}
+
+template<typename T>
+fn check_names(const T* items, size_t count, std::string_view what, BuffStr<256>& err) -> bool {
+  for (size_t i = 0; i < count; ++i) {
+    if (!name_ok(items[i].name)) {
+      err.format_from("{} {} has a corrupt name", what, i);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Before anything calls image_bytes() on it
+fn check_texture(const TextureData& tex, size_t idx, BuffStr<256>& err) -> bool {
+  if (!name_ok(tex.name) || !name_ok(tex.path)) {
+    err.format_from("Texture {} has a corrupt name", idx);
+    return false;
+  }
+  if ((u32)tex.format > (u32)ImageFormat::rgba32f) {
+    err.format_from("Texture \"{}\" has an invalid format {}", tex.name.as_view(),
+                    (u32)tex.format);
+    return false;
+  }
+  const u64 pixels = (u64)tex.extent.width * tex.extent.height;
+  if (pixels > SIZE_MAX / image_format_size(ImageFormat::rgba32f)) {
+    err.format_from("Texture \"{}\" is too big, {}x{}", tex.name.as_view(), tex.extent.width,
+                    tex.extent.height);
+    return false;
+  }
+  return true;
+}
+
+fn range_ok(u32 start, u32 count, size_t total) -> bool {
+  return start == (u32)-1 || (size_t)start + count <= total;
+}
+
+fn index_ok(u32 idx, size_t total) -> bool {
+  return idx == (u32)-1 || idx < total;
+}
+
+// Everything read back from the file that indexes into another section
+fn check_ranges(const Model3DData::ModelInternal& data, BuffStr<256>& err) -> bool {
+  for (size_t i = 0; i < data.mesh_count; ++i) {
+    const auto& mesh = data.meshes[i];
+    bool ok = range_ok(mesh.positions_start, mesh.nverts, data.mesh_position_count) &&
+              range_ok(mesh.normals_start, mesh.nverts, data.mesh_normal_count) &&
+              range_ok(mesh.tangents_start, mesh.nverts, data.mesh_tangent_count) &&
+              range_ok(mesh.bones_start, mesh.nverts, data.mesh_bone_count) &&
+              range_ok(mesh.index_start, mesh.index_count, data.mesh_index_count) &&
+              range_ok(mesh.blend_start, mesh.blend_count, data.blend_shape_count) &&
+              index_ok(mesh.material_index, data.material_count);
+    for (u32 uv = 0; uv < MAX_MESH_UVS; ++uv) {
+      ok = ok && range_ok(mesh.uvs_start[uv], mesh.nverts, data.mesh_uv_count[uv]);
+    }
+    for (u32 col = 0; col < MAX_MESH_COLORS; ++col) {
+      ok = ok && range_ok(mesh.colors_start[col], mesh.nverts, data.mesh_color_count[col]);
+    }
+    if (!ok) {
+      err.format_from("Mesh \"{}\" out of range", mesh.name.as_view());
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < data.blend_shape_count; ++i) {
+    const auto& shape = data.blend_shapes[i];
+    bool ok = range_ok(shape.positions_start, shape.nverts, data.blend_position_count) &&
+              range_ok(shape.normals_start, shape.nverts, data.blend_normal_count) &&
+              range_ok(shape.tangents_start, shape.nverts, data.blend_tangent_count);
+    for (u32 uv = 0; uv < MAX_MESH_UVS; ++uv) {
+      ok = ok && range_ok(shape.uvs_start[uv], shape.nverts, data.blend_uv_count[uv]);
+    }
+    for (u32 col = 0; col < MAX_MESH_COLORS; ++col) {
+      ok = ok && range_ok(shape.colors_start[col], shape.nverts, data.blend_color_count[col]);
+    }
+    if (!ok) {
+      err.format_from("Blend shape \"{}\" out of range", shape.name.as_view());
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < data.material_count; ++i) {
+    const auto& mat = data.materials[i];
+    if (!range_ok(mat.texture_indices.start, mat.texture_indices.count,
+                  data.material_textures_count)) {
+      err.format_from("Material \"{}\" out of range", mat.name.as_view());
+      return false;
+    }
+  }
+  for (size_t i = 0; i < data.material_textures_count; ++i) {
+    if (data.material_textures[i] >= data.texture_count) {
+      err.format_from("Material texture {} out of range", data.material_textures[i]);
+      return false;
+    }
+  }
+
+  // Parents come before their children, anything else could loop
+  for (size_t i = 0; i < data.bone_count; ++i) {
+    const auto& bone = data.bones[i];
+    if (bone.parent != -1 && (bone.parent < 0 || (size_t)bone.parent >= i)) {
+      err.format_from("Bone \"{}\" has an invalid parent {}", bone.name.as_view(), bone.parent);
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+Vec<u8> cook_model_blob(Model3DData::ModelInternal& data) {
+  KA_PROFILE_ZONE("cook_model_blob");
+  // Lay the sections out first, then copy everything in one go
+  KmdlSectionEntry table[KMDL_SECTION_COUNT]{};
+  size_t file_size = KMDL_DATA_OFFSET;
+  const fn place = [&]<typename T>(u32 section, T*, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    file_size = align_up(file_size, KMDL_ALIGN);
+    table[section] = {file_size, count, sizeof(T), alignof(T)};
+    file_size += count * sizeof(T);
+  };
+  for_each_section(data, place);
+  place(KMDL_TEXTURES, data.textures, data.texture_count);
+  size_t pixel_size = 0;
+  for (size_t i = 0; i < data.texture_count; ++i) {
+    pixel_size += texture_pixel_size(data.textures[i]);
+  }
+  place(KMDL_TEXTURE_PIXELS, (u8*)nullptr, pixel_size);
+
+  Vec<u8> blob(file_size);
+  const KmdlHeader header{KMDL_MAGIC, KMDL_VERSION, KMDL_BYTE_ORDER, KMDL_SECTION_COUNT,
+                          file_size};
+  std::memcpy(blob.data(), &header, sizeof(header));
+  std::memcpy(blob.data() + KMDL_TABLE_OFFSET, table, sizeof(table));
+  for_each_section(data, [&]<typename T>(u32 section, T* ptr, size_t count) {
+    if (count) {
+      std::memcpy(blob.data() + table[section].offset, ptr, count * sizeof(T));
+    }
+  });
+  size_t pixel_offset = table[KMDL_TEXTURE_PIXELS].offset;
+  for (size_t i = 0; i < data.texture_count; ++i) {
+    auto tex = data.textures[i];
+    std::memcpy(blob.data() + pixel_offset, tex.data, image_bytes(tex.extent, tex.format));
+    pixel_offset += texture_pixel_size(tex);
+    tex.data = nullptr; // Patched on load
+    std::memcpy(blob.data() + table[KMDL_TEXTURES].offset + i * sizeof(tex), &tex, sizeof(tex));
+  }
+  return blob;
+}
+
+std::unique_ptr<Model3DData::ModelInternal> load_kmdl(const char* kmdl_path,
+                                                      const BufferName& name,
+                                                      const BufferPath& path, BuffStr<256>& err) {
+  KA_PROFILE_ZONE("load_kmdl");
+  auto file = MappedFile::open(kmdl_path, true);
+  if (file.empty()) {
+    err.format_from("Failed to open file");
+    return nullptr;
+  }
+  if (file.size() < KMDL_DATA_OFFSET) {
+    err.format_from("File too small");
+    return nullptr;
+  }
+  KmdlHeader header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (header.magic != KMDL_MAGIC || header.byte_order != KMDL_BYTE_ORDER) {
+    err.format_from("Not a kmdl file");
+    return nullptr;
+  }
+  if (header.version != KMDL_VERSION || header.section_count != KMDL_SECTION_COUNT) {
+    err.format_from("Version {} with {} sections, expected {} with {}", header.version,
+                    header.section_count, KMDL_VERSION, (u32)KMDL_SECTION_COUNT);
+    return nullptr;
+  }
+  if (header.file_size != file.size()) {
+    err.format_from("Expected {} bytes, got {}", header.file_size, file.size());
+    return nullptr;
+  }
+  KmdlSectionEntry table[KMDL_SECTION_COUNT];
+  std::memcpy(table, file.data() + KMDL_TABLE_OFFSET, sizeof(table));
+
+  auto ptr = std::make_unique<Model3DData::ModelInternal>(name, path);
+  auto& data = *ptr;
+  // Give it the mapping before pointing anything into it, so the destructor knows
+  data.mapping = std::move(file);
+  u8* base = data.mapping.mutable_data();
+  const size_t size = data.mapping.size();
+
+  bool valid = true;
+  for_each_section(data, [&]<typename T>(u32 section, T*& arr, size_t& count) {
+    if (!valid) {
+      return;
+    }
+    const auto& entry = table[section];
+    if (!check_section<T>(entry, base, size, err)) {
+      valid = false;
+      return;
+    }
+    arr = entry.count ? reinterpret_cast<T*>(base + entry.offset) : nullptr;
+    count = entry.count;
+  });
+  if (!valid || !check_names(data.meshes, data.mesh_count, "Mesh", err) ||
+      !check_names(data.blend_shapes, data.blend_shape_count, "Blend shape", err) ||
+      !check_names(data.bones, data.bone_count, "Bone", err) ||
+      !check_names(data.materials, data.material_count, "Material", err)) {
+    return nullptr;
+  }
+
+  // The texture table is copied, the pixels stay in the mapping
+  const auto& tex_entry = table[KMDL_TEXTURES];
+  const auto& pixel_entry = table[KMDL_TEXTURE_PIXELS];
+  if (!check_section<TextureData>(tex_entry, base, size, err) ||
+      !check_section<u8>(pixel_entry, base, size, err)) {
+    return nullptr;
+  }
+  if (tex_entry.count) {
+    data.textures = data.alloc.alloc<TextureData>(tex_entry.count);
+    data.texture_count = tex_entry.count;
+    std::memcpy(data.textures, base + tex_entry.offset, tex_entry.count * sizeof(TextureData));
+    size_t pixel_offset = 0;
+    for (size_t i = 0; i < data.texture_count; ++i) {
+      auto& tex = data.textures[i];
+      if (!check_texture(tex, i, err)) {
+        return nullptr;
+      }
+      const size_t bytes = image_bytes(tex.extent, tex.format);
+      if (pixel_offset > pixel_entry.count || bytes > pixel_entry.count - pixel_offset) {
+        err.format_from("Texture \"{}\" out of range", tex.name.as_view());
+        return nullptr;
+      }
+      tex.data = base + pixel_entry.offset + pixel_offset;
+      pixel_offset += texture_pixel_size(tex);
+    }
+  }
+  if (!check_ranges(data, err)) {
+    return nullptr;
+  }
+
+  const fn fill_registry = [](auto& registry, auto* items, size_t count) {
+    registry.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      registry.emplace(items[i].name.as_view(), i);
+    }
+  };
+  fill_registry(data.mesh_registry, data.meshes, data.mesh_count);
+  fill_registry(data.bone_registry, data.bones, data.bone_count);
+  fill_registry(data.material_registry, data.materials, data.material_count);
+  fill_registry(data.texture_registry, data.textures, data.texture_count);
+
+  KMDL_LOG(debug, "Mapped \"{}\" ({} meshes, {} bytes)", kmdl_path, data.mesh_count, size);
+  return ptr;
+}
+
+AssExpect<void> Model3DData::cook(std::string_view kmdl_path) const {
+  KA_PROFILE_ZONE("Model3DData::cook");
+  ka_assert(_data, "model3d_data use after free");
+  const auto blob = cook_model_blob(*_data);
+  BufferPath path;
+  path.copy_from(kmdl_path.data(), kmdl_path.size());
+  if (!write_file_atomic(path.c_str(), blob.data(), blob.size())) {
+    auto err = AssetErr::format(kmdl_path, _data->name.as_view(), "Failed to write {} bytes",
+                                blob.size());
+    KMDL_LOG(error, "Failed to cook \"{}\", {}", kmdl_path, err.msg());
+    return {unexpect, std::move(err)};
+  }
+  KMDL_LOG(debug, "Cooked \"{}\" into \"{}\" ({} bytes)", _data->path.as_view(), kmdl_path,
+           blob.size());
+  return {};
+}
+
+CookedModelLoader::CookedModelLoader(std::string_view kmdl_path, std::string_view model_name) :
+    _impl(new CookedModelLoader::LoaderInternal()) {
+  _impl->model_path.copy_from(kmdl_path.data(), kmdl_path.size());
+  _impl->model_name.copy_from(model_name.data(), model_name.size());
+}
+
+AssExpect<Model3DData> CookedModelLoader::load() {
+  KA_PROFILE_ZONE("CookedModelLoader::load");
+  ka_assert(_impl, "cooked_model_loader use after free");
+  const DeferFn defer = [this]() {
+    delete _impl;
+    _impl = nullptr;
+  };
+
+  BuffStr<256> err;
+  try {
+    auto data = load_kmdl(_impl->model_path.c_str(), _impl->model_name, _impl->model_path, err);
+    if (data) {
+      return {in_place, *data.release()};
+    }
+  } catch (const std::bad_alloc&) {
+    err.format_from("Model allocation failure");
+  } catch (const std::exception& ex) {
+    err.format_from("{}", ex.what());
+  }
+  KMDL_LOG(error, "Failed to load \"{}\", {}", _impl->model_path.as_view(), err.as_view());
+  return {unexpect,
+          AssetErr(_impl->model_path.as_view(), _impl->model_name.as_view(), std::move(err))};
+}
+
+} // namespace kappa::assets
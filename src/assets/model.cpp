@@ -1,7 +1,13 @@
 #include "./internal.hpp"
+#include "jobs.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 
 #define MODEL_LOG(_level, _fmt, ...) \
-  ::kappa::log_##_level("[MODEL_IMPORT] " _fmt __VA_OPT__(, ) __VA_ARGS__)
+  KA_LOG(_level, "[MODEL_IMPORT] " _fmt __VA_OPT__(, ) __VA_ARGS__)
 
 namespace kappa::assets {
 
@@ -9,7 +15,9 @@ namespace {
 
 template<typename T>
 constexpr void zeroinit(T* ptr, size_t sz) {
-  std::memset((void*)ptr, 0x00, sizeof(T) * sz);
+  if (sz) {
+    std::memset((void*)ptr, 0x00, sizeof(T) * sz);
+  }
 };
 
 template<typename T>
@@ -24,6 +32,8 @@ Model3DLoader::Model3DLoader(std::string_view model_path, std::string_view model
                              const LoadOpts* opts) : _impl(new Model3DLoader::LoaderInternal()) {
   _impl->importer.SetPropertyBool(AI_CONFIG_IMPORT_REMOVE_EMPTY_BONES, true);
   _impl->importer.SetPropertyInteger(AI_CONFIG_PP_SBBC_MAX_BONES, 4);
+  _impl->io = new ModelIOSystem();
+  _impl->importer.SetIOHandler(_impl->io);
   _impl->model_path.copy_from(model_path.data(), model_path.size());
   _impl->model_name.copy_from(model_name.data(), model_name.size());
   _impl->importer_flags = opts ? opts->flags : FLAGS_DEFAULT;
@@ -37,6 +47,22 @@ Model3DLoader::Model3DLoader(std::string_view model_path, std::string_view model
   }
 }
 
+Assimp::IOStream* ModelIOSystem::Open(const char* file, const char* mode) {
+  auto* stream = DefaultIOSystem::Open(file, mode);
+  if (!stream) {
+    return nullptr;
+  }
+  // Importers open the same file more than once
+  const std::string_view path{file};
+  const bool seen = std::any_of(opened.begin(), opened.end(), [&](const BufferPath& dep) {
+    return dep.as_view() == path;
+  });
+  if (!seen) {
+    opened.emplace_back().copy_from(path.data(), path.size());
+  }
+  return stream;
+}
+
 Model3DData::ModelInternal::ModelInternal(const BufferName& name_, const BufferPath& path_) :
     chima(), meshes(nullptr), mesh_count(0), mesh_positions(nullptr), mesh_position_count(0),
     mesh_normals(nullptr), mesh_normal_count(0), mesh_tangents(nullptr), mesh_bitangents(nullptr),
@@ -53,7 +79,8 @@ Model3DData::ModelInternal::ModelInternal(const BufferName& name_, const BufferP
 #endif
     bones(nullptr), bone_locals(nullptr), bone_inv_models(nullptr), bone_count(0),
     textures(nullptr), texture_count(0), materials(nullptr), material_count(0),
-    material_textures(nullptr), material_textures_count(0) {
+    material_textures(nullptr), material_textures_count(0), stream_block(nullptr),
+    stream_block_size(0) {
   // Initialize arrays
   zeroinit(&mesh_uvs[0], MAX_MESH_UVS);
   zeroinit(&mesh_uv_count[0], MAX_MESH_UVS);
@@ -89,13 +116,8 @@ auto initialize_data(const BufferName& name, const BufferPath& path, const aiSce
   auto ptr = std::make_unique<Model3DData::ModelInternal>(name, path);
   auto& data = *ptr;
   auto& al = ptr->alloc;
-  const auto maybe_alloc = [&]<typename T>(T** ptr, size_t sz) {
-    if (sz) {
-      alloc_init(al, ptr, sz);
-    }
-  };
 
-  // First mesh pass. Preallocate blend shapes, bones & meshes.
+  // First mesh pass. Count blend shapes, bones & meshes.
   for (size_t i = 0; i < scene.mNumMeshes; ++i) {
     const aiMesh* mesh = scene.mMeshes[i];
     data.blend_shape_count += mesh->mNumAnimMeshes;
@@ -115,126 +137,162 @@ auto initialize_data(const BufferName& name, const BufferPath& path, const aiSce
       }
     }
   }
-  data.meshes = al.alloc<Model3DData::MeshData>(data.mesh_count);
-  zeroinit(data.meshes, data.mesh_count);
-  maybe_alloc(&data.blend_shapes, data.blend_shape_count);
+  data.bone_count = bone_invs.size();
 
   static_assert(Model3DData::MAX_MESH_UVS <= AI_MAX_NUMBER_OF_TEXTURECOORDS);
   static_assert(Model3DData::MAX_MESH_COLORS <= AI_MAX_NUMBER_OF_COLOR_SETS);
-  // Second mesh pass. Count meshes and blend shapes for each mesh,
-  // copy names & preallocate vertices
-  {
-    size_t anim_pos = 0;
-    for (size_t i = 0; i < scene.mNumMeshes; ++i) {
-      const aiMesh* mesh = scene.mMeshes[i];
-      const size_t verts = mesh->mNumVertices;
-      if (!mesh->HasPositions()) {
-        err.format_from("Invalid position data at mesh \"{}\"", mesh->mName.C_Str());
-        return nullptr;
+  // Second mesh pass. Count vertices for each mesh and blend shape
+  for (size_t i = 0; i < scene.mNumMeshes; ++i) {
+    const aiMesh* mesh = scene.mMeshes[i];
+    const size_t verts = mesh->mNumVertices;
+    if (!mesh->HasPositions()) {
+      err.format_from("Invalid position data at mesh \"{}\"", mesh->mName.C_Str());
+      return nullptr;
+    }
+
+    data.mesh_position_count += verts;
+    if (mesh->HasNormals()) {
+      data.mesh_normal_count += verts;
+    }
+    if (mesh->HasTangentsAndBitangents()) {
+      data.mesh_tangent_count += verts;
+    }
+    for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
+      if (mesh->HasTextureCoords(uv)) {
+        data.mesh_uv_count[uv] += verts;
       }
-      const aiString& mesh_name = mesh->mName;
-      data.meshes[i].name.copy_from(mesh_name.data, mesh_name.length);
-      auto [_, empl] = data.mesh_registry.try_emplace(data.meshes[i].name.as_view(), i);
-      if (!empl) {
-        err.format_from("Duplicate mesh name \"{}\" in model", data.meshes[i].name.as_view());
-        return nullptr;
+    }
+    for (size_t col = 0; col < Model3DData::MAX_MESH_COLORS; ++col) {
+      if (mesh->HasVertexColors(col)) {
+        data.mesh_color_count[col] += verts;
       }
+    }
+    if (mesh->HasBones()) {
+      data.mesh_bone_count += verts;
+    }
+    for (size_t j = 0; j < mesh->mNumFaces; ++j) {
+      data.mesh_index_count += mesh->mFaces[j].mNumIndices;
+    }
 
-      data.mesh_position_count += verts;
-      if (mesh->HasNormals()) {
-        data.mesh_normal_count += verts;
+    for (size_t j = 0; j < mesh->mNumAnimMeshes; ++j) {
+      const aiAnimMesh* ai_anim = mesh->mAnimMeshes[j];
+      const size_t animverts = ai_anim->mNumVertices;
+      if (ai_anim->HasPositions()) {
+        data.blend_position_count += animverts;
+      }
+      if (ai_anim->HasNormals()) {
+        data.blend_normal_count += animverts;
       }
-      if (mesh->HasTangentsAndBitangents()) {
-        data.mesh_tangent_count += verts;
+      if (ai_anim->HasTangentsAndBitangents()) {
+        data.blend_tangent_count += animverts;
       }
       for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
-        if (mesh->HasTextureCoords(uv)) {
-          data.mesh_uv_count[uv] += verts;
-        }
-        if (mesh->HasTextureCoordsName(uv)) {
-          // Copy name
-          const aiString& name = *mesh->mTextureCoordsNames[uv];
-          data.meshes[i].uv_name[uv].copy_from(name.data, name.length);
+        if (ai_anim->HasTextureCoords(uv)) {
+          data.blend_uv_count[uv] += animverts;
         }
       }
       for (size_t col = 0; col < Model3DData::MAX_MESH_COLORS; ++col) {
-        if (mesh->HasVertexColors(col)) {
-          data.mesh_color_count[col] += verts;
-        }
-      }
-      if (mesh->HasBones()) {
-        data.mesh_bone_count += verts;
-      }
-      for (size_t j = 0; j < mesh->mNumFaces; ++j) {
-        data.mesh_index_count += mesh->mFaces[j].mNumIndices;
-      }
-
-      for (size_t j = 0; j < mesh->mNumAnimMeshes; ++j) {
-        const aiAnimMesh* ai_anim = mesh->mAnimMeshes[j];
-        const size_t animverts = ai_anim->mNumVertices;
-        auto& anim = data.blend_shapes[anim_pos++];
-        anim.name.copy_from(ai_anim->mName.data, ai_anim->mName.length);
-
-        if (ai_anim->HasPositions()) {
-          data.blend_position_count += animverts;
-        }
-        if (ai_anim->HasNormals()) {
-          data.blend_normal_count += animverts;
-        }
-        if (ai_anim->HasTangentsAndBitangents()) {
-          data.blend_tangent_count += animverts;
-        }
-        for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
-          if (ai_anim->HasTextureCoords(uv)) {
-            data.blend_uv_count[uv] += animverts;
-          }
-        }
-        for (size_t col = 0; col < Model3DData::MAX_MESH_COLORS; ++col) {
-          if (ai_anim->HasVertexColors(col)) {
-            data.blend_color_count[col] += animverts;
-          }
+        if (ai_anim->HasVertexColors(col)) {
+          data.blend_color_count[col] += animverts;
         }
       }
     }
+  }
 
-    maybe_alloc(&data.mesh_positions, data.mesh_position_count);
-    maybe_alloc(&data.blend_positions, data.blend_position_count);
-    maybe_alloc(&data.mesh_indices, data.mesh_index_count);
-
-    maybe_alloc(&data.mesh_normals, data.mesh_normal_count);
-    maybe_alloc(&data.blend_normals, data.blend_normal_count);
-
-    maybe_alloc(&data.mesh_tangents, data.mesh_tangent_count);
-    maybe_alloc(&data.mesh_bitangents, data.mesh_tangent_count);
-    maybe_alloc(&data.blend_tangents, data.blend_tangent_count);
-    maybe_alloc(&data.blend_bitangents, data.blend_tangent_count);
-
-    const bool have_bones = !bone_invs.empty();
-    if (have_bones && data.mesh_bone_count) {
-      data.mesh_bone_indices = al.alloc<ran::Vec4s32>(data.mesh_bone_count);
-      data.mesh_bone_weights = al.alloc<ran::Vec4f32>(data.mesh_bone_count);
-      // Set all parents to NULL (-1)
-      std::memset(data.mesh_bone_indices, 0xFF,
-                  sizeof(data.mesh_bone_indices[0]) * data.mesh_bone_count);
-      // Set all weights to 0
-      std::memset(data.mesh_bone_weights, 0x00,
-                  sizeof(data.mesh_bone_weights[0] * data.mesh_bone_count));
+  // Every array above comes out of a single block, sized by running carve_streams without one
+  const size_t bone_weight_count = bone_invs.empty() ? 0 : data.mesh_bone_count;
+  u8* block = nullptr;
+  size_t block_size = 0;
+  const auto carve = [&]<typename T>(T** ptr, size_t count) {
+    static_assert(alignof(T) <= MODEL_STREAM_ALIGN);
+    if (!count) {
+      return;
     }
-
+    block_size = align_up(block_size, MODEL_STREAM_ALIGN);
+    if (block) {
+      *ptr = reinterpret_cast<T*>(block + block_size);
+    }
+    block_size += count * sizeof(T);
+  };
+  const auto carve_streams = [&]() {
+    carve(&data.meshes, data.mesh_count);
+    carve(&data.mesh_positions, data.mesh_position_count);
+    carve(&data.mesh_normals, data.mesh_normal_count);
+    carve(&data.mesh_tangents, data.mesh_tangent_count);
+    carve(&data.mesh_bitangents, data.mesh_tangent_count);
+    for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
+      carve(data.mesh_uvs + uv, data.mesh_uv_count[uv]);
+    }
+    for (size_t col = 0; col < Model3DData::MAX_MESH_COLORS; ++col) {
+      carve(data.mesh_colors + col, data.mesh_color_count[col]);
+    }
+    carve(&data.mesh_bone_indices, bone_weight_count);
+    carve(&data.mesh_bone_weights, bone_weight_count);
+    carve(&data.mesh_indices, data.mesh_index_count);
+
+    carve(&data.blend_shapes, data.blend_shape_count);
+    carve(&data.blend_positions, data.blend_position_count);
+    carve(&data.blend_normals, data.blend_normal_count);
+    carve(&data.blend_tangents, data.blend_tangent_count);
+    carve(&data.blend_bitangents, data.blend_tangent_count);
     for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
-      maybe_alloc(data.mesh_uvs + uv, data.mesh_uv_count[uv]);
-      maybe_alloc(data.blend_uvs + uv, data.blend_uv_count[uv]);
+      carve(data.blend_uvs + uv, data.blend_uv_count[uv]);
     }
     for (size_t col = 0; col < Model3DData::MAX_MESH_COLORS; ++col) {
-      maybe_alloc(data.mesh_colors + col, data.mesh_color_count[col]);
-      maybe_alloc(data.blend_colors + col, data.blend_color_count[col]);
+      carve(data.blend_colors + col, data.blend_color_count[col]);
+    }
+
+    carve(&data.bones, data.bone_count);
+    carve(&data.bone_locals, data.bone_count);
+    carve(&data.bone_inv_models, data.bone_count);
+  };
+  carve_streams();
+  data.stream_block = al.alloc_block(block_size, MODEL_STREAM_ALIGN);
+  data.stream_block_size = block_size;
+  block = data.stream_block;
+  block_size = 0;
+  carve_streams();
+
+  // parse_meshes and parse_rigs overwrite the vertex streams and bone matrices as a whole, only
+  // the rest needs clearing
+  zeroinit(data.meshes, data.mesh_count);
+  zeroinit(data.blend_shapes, data.blend_shape_count);
+  zeroinit(data.bones, data.bone_count);
+  if (bone_weight_count) {
+    // Set all parents to NULL (-1)
+    std::memset(data.mesh_bone_indices, 0xFF,
+                sizeof(data.mesh_bone_indices[0]) * bone_weight_count);
+    // Set all weights to 0
+    zeroinit(data.mesh_bone_weights, bone_weight_count);
+  }
+
+  // Copy names
+  size_t anim_pos = 0;
+  for (size_t i = 0; i < scene.mNumMeshes; ++i) {
+    const aiMesh* mesh = scene.mMeshes[i];
+    const aiString& mesh_name = mesh->mName;
+    data.meshes[i].name.copy_from(mesh_name.data, mesh_name.length);
+    auto [_, empl] = data.mesh_registry.try_emplace(data.meshes[i].name.as_view(), i);
+    if (!empl) {
+      err.format_from("Duplicate mesh name \"{}\" in model", data.meshes[i].name.as_view());
+      return nullptr;
+    }
+    for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
+      if (mesh->HasTextureCoordsName(uv)) {
+        const aiString& name = *mesh->mTextureCoordsNames[uv];
+        data.meshes[i].uv_name[uv].copy_from(name.data, name.length);
+      }
+    }
+    for (size_t j = 0; j < mesh->mNumAnimMeshes; ++j) {
+      const aiAnimMesh* ai_anim = mesh->mAnimMeshes[j];
+      data.blend_shapes[anim_pos++].name.copy_from(ai_anim->mName.data, ai_anim->mName.length);
     }
   }
 
 #if 0
   // Preallocate animations & keyframes
   data.animation_count = scene.mNumAnimations;
-  maybe_alloc(&data.animations, data.animation_count);
+  alloc_init(al, &data.animations, data.animation_count);
   if (data.animation_count) {
     data.bone_anim_registry.reserve(data.animation_count);
     for (size_t i = 0; i < scene.mNumAnimations; ++i) {
@@ -257,22 +315,13 @@ auto initialize_data(const BufferName& name, const BufferPath& path, const aiSce
       data.anim_bone_keyframe_count += ai_anim->mNumChannels;
     }
   }
-  maybe_alloc(&data.anim_bone_keyframes, data.anim_bone_keyframe_count);
-  maybe_alloc(&data.anim_bone_positions, data.anim_bone_position_count);
-  maybe_alloc(&data.anim_bone_scales, data.anim_bone_scale_count);
-  maybe_alloc(&data.anim_bone_rotations, data.anim_bone_rotation_count);
+  alloc_init(al, &data.anim_bone_keyframes, data.anim_bone_keyframe_count);
+  alloc_init(al, &data.anim_bone_positions, data.anim_bone_position_count);
+  alloc_init(al, &data.anim_bone_scales, data.anim_bone_scale_count);
+  alloc_init(al, &data.anim_bone_rotations, data.anim_bone_rotation_count);
 #endif
 
-  // Preallocate bones & matrices
-  data.bone_count = bone_invs.size();
-  if (data.bone_count) {
-    data.bones = al.alloc<Model3DData::BoneData>(data.bone_count);
-    zeroinit(data.bones, data.bone_count);
-    data.bone_inv_models = al.alloc<ran::Mat4f32>(data.bone_count);
-    data.bone_locals = al.alloc<ran::Mat4f32>(data.bone_count);
-    data.bone_registry.reserve(data.bone_count); // We fill the registry at parse_bones()
-  }
-
+  data.bone_registry.reserve(data.bone_count); // We fill the registry at parse_bones()
   return ptr;
 }
 
@@ -356,24 +405,69 @@ ran::Vec3f32 asscast(const aiVector3D& vec) {
   return {vec.x, vec.y, vec.z};
 }
 
-ran::Vec4f32 asscast(const aiColor4D& col) {
-  return {col.r, col.g, col.b, col.a};
-}
+// Same layout on both sides, whole attribute streams go in a single memcpy
+static_assert(sizeof(aiVector3D) == sizeof(ran::Vec3f32) &&
+              std::is_trivially_copyable_v<aiVector3D>);
+static_assert(sizeof(aiColor4D) == sizeof(ran::Vec4f32) &&
+              std::is_trivially_copyable_v<aiColor4D>);
+
+template<typename T, typename U>
+void copy_attrib(T* dst, const U* src, size_t count) {
+  std::memcpy((void*)dst, (const void*)src, count * sizeof(T));
+}
+
+// Where each mesh starts writing in the shared arrays
+struct mesh_cursor {
+  size_t vertex_pos, vertex_anim_pos;
+  size_t normal_pos, normal_anim_pos;
+  size_t tangent_pos, tangent_anim_pos;
+  size_t bone_pos;
+  size_t uv_pos[Model3DData::MAX_MESH_UVS];
+  size_t uv_anim_pos[Model3DData::MAX_MESH_UVS];
+  size_t color_pos[Model3DData::MAX_MESH_COLORS];
+  size_t color_anim_pos[Model3DData::MAX_MESH_COLORS];
+  size_t index_pos;
+  size_t shape_pos;
+};
 
-void parse_meshes(Model3DData::ModelInternal& data, const aiScene& scene) {
-  size_t vertex_pos = 0, vertex_anim_pos = 0;
-  size_t normal_pos = 0, normal_anim_pos = 0;
-  size_t tangent_pos = 0, tangent_anim_pos = 0;
-  size_t bone_pos = 0;
-  size_t uv_pos[Model3DData::MAX_MESH_UVS] = {0};
-  size_t uv_anim_pos[Model3DData::MAX_MESH_UVS] = {0};
-  size_t color_pos[Model3DData::MAX_MESH_COLORS] = {0};
-  size_t color_anim_pos[Model3DData::MAX_MESH_COLORS] = {0};
-  size_t index_pos = 0;
-  size_t shape_pos = 0;
+// Moves the cursor past everything parse_mesh writes for this mesh
+void advance_cursor(mesh_cursor& cur, const aiMesh& ai_mesh, bool have_bones) {
+  const size_t verts = ai_mesh.mNumVertices;
+  cur.vertex_pos += ai_mesh.HasPositions() ? verts : 0;
+  cur.normal_pos += ai_mesh.HasNormals() ? verts : 0;
+  cur.tangent_pos += ai_mesh.HasTangentsAndBitangents() ? verts : 0;
+  for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
+    cur.uv_pos[uv] += ai_mesh.HasTextureCoords(uv) ? verts : 0;
+  }
+  for (size_t col = 0; col < Model3DData::MAX_MESH_COLORS; ++col) {
+    cur.color_pos[col] += ai_mesh.HasVertexColors(col) ? verts : 0;
+  }
+  cur.bone_pos += have_bones && ai_mesh.HasBones() ? verts : 0;
+  for (size_t face_idx = 0; face_idx < ai_mesh.mNumFaces; ++face_idx) {
+    cur.index_pos += ai_mesh.mFaces[face_idx].mNumIndices;
+  }
+
+  cur.shape_pos += ai_mesh.mNumAnimMeshes;
+  for (size_t j = 0; j < ai_mesh.mNumAnimMeshes; ++j) {
+    const aiAnimMesh& ai_anim = *ai_mesh.mAnimMeshes[j];
+    const size_t animverts = ai_anim.mNumVertices;
+    cur.vertex_anim_pos += ai_anim.HasPositions() ? animverts : 0;
+    cur.normal_anim_pos += ai_anim.HasNormals() ? animverts : 0;
+    cur.tangent_anim_pos += ai_anim.HasTangentsAndBitangents() ? animverts : 0;
+    for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
+      cur.uv_anim_pos[uv] += ai_anim.HasTextureCoords(uv) ? animverts : 0;
+    }
+    for (size_t col = 0; col < Model3DData::MAX_MESH_COLORS; ++col) {
+      cur.color_anim_pos[col] += ai_anim.HasVertexColors(col) ? animverts : 0;
+    }
+  }
+}
 
+// Only touches the ranges the cursor points to, so meshes can be parsed concurrently
+void parse_mesh(Model3DData::ModelInternal& data, const aiMesh* ai_mesh,
+                Model3DData::MeshData& mesh, mesh_cursor cur) {
   const auto try_place_weight = [&](i32 bone_idx, const aiVertexWeight& weight) {
-    const size_t offset = bone_pos + weight.mVertexId;
+    const size_t offset = cur.bone_pos + weight.mVertexId;
     assert(offset < data.mesh_bone_count);
 
     for (size_t i = 0; i < 4; ++i) {
@@ -386,14 +480,13 @@ void parse_meshes(Model3DData::ModelInternal& data, const aiScene& scene) {
         return;
       }
     }
-    MODEL_LOG(warn, "Bone weights out of range in vertex index {}", vertex_pos);
+    MODEL_LOG(warn, "Bone weights out of range in vertex index {}", cur.vertex_pos);
   };
 
+  // f(pos) fills [pos, pos + count)
   const auto do_attrib = [&](bool cond, size_t count, size_t& pos, u32& target_start, auto&& f) {
     if (cond) {
-      for (size_t i = 0; i < count; ++i) {
-        f(pos + i, i);
-      }
+      f(pos);
       target_start = static_cast<u32>(pos);
       pos += count;
     } else {
@@ -402,193 +495,198 @@ void parse_meshes(Model3DData::ModelInternal& data, const aiScene& scene) {
   };
 
   const auto& bone_reg = data.bone_registry;
-  for (size_t mesh_idx = 0; mesh_idx < scene.mNumMeshes; ++mesh_idx) {
-    const aiMesh* ai_mesh = scene.mMeshes[mesh_idx];
-    auto& mesh = data.meshes[mesh_idx];
-    mesh.nverts = ai_mesh->mNumVertices;
-
-    // Positions. Always present but use HasPositions for consistency.
-    do_attrib(ai_mesh->HasPositions(), mesh.nverts, vertex_pos, mesh.positions_start,
-              [&](size_t pos, size_t vert) {
-                assert(pos < data.mesh_position_count);
-                assert(vert < ai_mesh->mNumVertices);
-                data.mesh_positions[pos] = asscast(ai_mesh->mVertices[vert]);
+  mesh.nverts = ai_mesh->mNumVertices;
+
+  // Positions. Always present but use HasPositions for consistency.
+  do_attrib(ai_mesh->HasPositions(), mesh.nverts, cur.vertex_pos, mesh.positions_start,
+            [&](size_t pos) {
+              assert(pos + mesh.nverts <= data.mesh_position_count);
+              copy_attrib(data.mesh_positions + pos, ai_mesh->mVertices, mesh.nverts);
+            });
+
+  // Normals
+  do_attrib(ai_mesh->HasNormals(), mesh.nverts, cur.normal_pos, mesh.normals_start,
+            [&](size_t pos) {
+              assert(pos + mesh.nverts <= data.mesh_normal_count);
+              copy_attrib(data.mesh_normals + pos, ai_mesh->mNormals, mesh.nverts);
+            });
+
+  // Tangents & bitangents
+  do_attrib(ai_mesh->HasTangentsAndBitangents(), mesh.nverts, cur.tangent_pos,
+            mesh.tangents_start, [&](size_t pos) {
+              assert(pos + mesh.nverts <= data.mesh_tangent_count);
+              copy_attrib(data.mesh_tangents + pos, ai_mesh->mTangents, mesh.nverts);
+              copy_attrib(data.mesh_bitangents + pos, ai_mesh->mBitangents, mesh.nverts);
+            });
+
+  // UVs, these drop the third component
+  for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
+    do_attrib(ai_mesh->HasTextureCoords(uv), mesh.nverts, cur.uv_pos[uv], mesh.uvs_start[uv],
+              [&](size_t pos) {
+                assert(pos + mesh.nverts <= data.mesh_uv_count[uv]);
+                for (size_t vert = 0; vert < mesh.nverts; ++vert) {
+                  const auto& uv_vec = ai_mesh->mTextureCoords[uv][vert];
+                  data.mesh_uvs[uv][pos + vert].x = uv_vec.x;
+                  data.mesh_uvs[uv][pos + vert].y = uv_vec.y;
+                }
+              });
+  };
+
+  // Colors
+  for (size_t col = 0; col < Model3DData::MAX_MESH_COLORS; ++col) {
+    do_attrib(ai_mesh->HasVertexColors(col), mesh.nverts, cur.color_pos[col],
+              mesh.colors_start[col], [&](size_t pos) {
+                assert(pos + mesh.nverts <= data.mesh_color_count[col]);
+                copy_attrib(data.mesh_colors[col] + pos, ai_mesh->mColors[col], mesh.nverts);
+              });
+  }
+
+  // Bone indices & weights
+  if (!bone_reg.empty() && ai_mesh->HasBones()) {
+    // Special iteration here, can't use do_attrib directly
+    for (size_t bone = 0; bone < ai_mesh->mNumBones; ++bone) {
+      const aiBone* ai_bone = ai_mesh->mBones[bone];
+      std::string_view bone_name(ai_bone->mName.data, ai_bone->mName.length);
+      // At this point every name *should* be valid
+      auto it = bone_reg.find(bone_name);
+      if (it == bone_reg.end()) {
+        MODEL_LOG(error, "Bone out of hierarchy \"{}\"", bone_name);
+        continue;
+      }
+      const i32 bone_idx = static_cast<i32>(it->second);
+      for (size_t weight = 0; weight < ai_bone->mNumWeights; ++weight) {
+        try_place_weight(bone_idx, ai_bone->mWeights[weight]);
+      }
+    }
+    mesh.bones_start = static_cast<u32>(cur.bone_pos);
+  } else {
+    mesh.bones_start = static_cast<i32>(-1);
+  }
+
+  // Face indices
+  {
+    mesh.face_count = ai_mesh->mNumFaces;
+    u32 index_count = 0u;
+    for (size_t face_idx = 0; face_idx < ai_mesh->mNumFaces; ++face_idx) {
+      const aiFace& face = ai_mesh->mFaces[face_idx];
+      const size_t pos = cur.index_pos + index_count;
+      assert(pos + face.mNumIndices <= data.mesh_index_count);
+      std::memcpy(data.mesh_indices + pos, face.mIndices, face.mNumIndices * sizeof(u32));
+      index_count += face.mNumIndices;
+    }
+    mesh.index_start = index_count ? cur.index_pos : (u32)-1;
+    mesh.index_count = index_count;
+  }
+
+  // Blend shapes, almost a duplicate of the mesh data
+  if (ai_mesh->mNumAnimMeshes) {
+    mesh.blend_start = cur.shape_pos;
+    mesh.blend_count = ai_mesh->mNumAnimMeshes;
+  } else {
+    mesh.blend_start = static_cast<u32>(-1);
+  }
+  for (size_t j = 0; j < ai_mesh->mNumAnimMeshes; ++j) {
+    const aiAnimMesh* ai_anim = ai_mesh->mAnimMeshes[j];
+    auto& anim = data.blend_shapes[cur.shape_pos++];
+    anim.nverts = ai_anim->mNumVertices;
+    anim.weight = ai_anim->mWeight;
+
+    // Positions (can be absent this time)
+    do_attrib(ai_anim->HasPositions(), anim.nverts, cur.vertex_anim_pos, anim.positions_start,
+              [&](size_t pos) {
+                assert(pos + anim.nverts <= data.blend_position_count);
+                copy_attrib(data.blend_positions + pos, ai_anim->mVertices, anim.nverts);
               });
 
     // Normals
-    do_attrib(ai_mesh->HasNormals(), mesh.nverts, normal_pos, mesh.normals_start,
-              [&](size_t pos, size_t vert) {
-                assert(pos < data.mesh_normal_count);
-                assert(vert < ai_mesh->mNumVertices);
-                data.mesh_normals[pos] = asscast(ai_mesh->mNormals[vert]);
+    do_attrib(ai_anim->HasNormals(), anim.nverts, cur.normal_anim_pos, anim.normals_start,
+              [&](size_t pos) {
+                assert(pos + anim.nverts <= data.blend_normal_count);
+                copy_attrib(data.blend_normals + pos, ai_anim->mNormals, anim.nverts);
               });
 
-    // Tangents & bitangents
-    do_attrib(ai_mesh->HasTangentsAndBitangents(), mesh.nverts, tangent_pos, mesh.tangents_start,
-              [&](size_t pos, size_t vert) {
-                assert(pos < data.mesh_tangent_count);
-                assert(vert < ai_mesh->mNumVertices);
-                data.mesh_tangents[pos] = asscast(ai_mesh->mTangents[vert]);
-                data.mesh_bitangents[pos] = asscast(ai_mesh->mBitangents[vert]);
+    // Tangents & Bitangents
+    do_attrib(ai_anim->HasTangentsAndBitangents(), anim.nverts, cur.tangent_anim_pos,
+              anim.tangents_start, [&](size_t pos) {
+                assert(pos + anim.nverts <= data.blend_tangent_count);
+                copy_attrib(data.blend_tangents + pos, ai_anim->mTangents, anim.nverts);
+                copy_attrib(data.blend_bitangents + pos, ai_anim->mBitangents, anim.nverts);
               });
 
     // UVs
     for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
-      do_attrib(ai_mesh->HasTextureCoords(uv), mesh.nverts, uv_pos[uv], mesh.uvs_start[uv],
-                [&](size_t pos, size_t vert) {
-                  assert(pos < data.mesh_uv_count[uv]);
-                  assert(vert < ai_mesh->mNumVertices);
-                  const auto& uv_vec = ai_mesh->mTextureCoords[uv][vert];
-                  data.mesh_uvs[uv][pos].x = uv_vec.x;
-                  data.mesh_uvs[uv][pos].y = uv_vec.y;
+      do_attrib(ai_anim->HasTextureCoords(uv), anim.nverts, cur.uv_anim_pos[uv],
+                anim.uvs_start[uv], [&](size_t pos) {
+                  assert(pos + anim.nverts <= data.blend_uv_count[uv]);
+                  for (size_t vert = 0; vert < anim.nverts; ++vert) {
+                    const auto& uv_vec = ai_anim->mTextureCoords[uv][vert];
+                    data.blend_uvs[uv][pos + vert].x = uv_vec.x;
+                    data.blend_uvs[uv][pos + vert].y = uv_vec.y;
+                  }
                 });
-    };
+    }
 
     // Colors
     for (size_t col = 0; col < Model3DData::MAX_MESH_COLORS; ++col) {
-      do_attrib(ai_mesh->HasVertexColors(col), mesh.nverts, color_pos[col], mesh.colors_start[col],
-                [&](size_t pos, size_t vert) {
-                  assert(pos < data.mesh_color_count[col]);
-                  assert(vert < ai_mesh->mNumVertices);
-                  data.mesh_colors[col][pos] = asscast(ai_mesh->mColors[col][vert]);
+      do_attrib(ai_anim->HasVertexColors(col), anim.nverts, cur.color_anim_pos[col],
+                anim.colors_start[col], [&](size_t pos) {
+                  assert(pos + anim.nverts <= data.blend_color_count[col]);
+                  copy_attrib(data.blend_colors[col] + pos, ai_anim->mColors[col], anim.nverts);
                 });
     }
+  }
 
-    // Bone indices & weights
-    if (!bone_reg.empty() && ai_mesh->HasBones()) {
-      // Special iteration here, can't use do_attrib directly
-      for (size_t bone = 0; bone < ai_mesh->mNumBones; ++bone) {
-        const aiBone* ai_bone = ai_mesh->mBones[bone];
-        std::string_view bone_name(ai_bone->mName.data, ai_bone->mName.length);
-        // At this point every name *should* be valid
-        auto it = bone_reg.find(bone_name);
-        if (it == bone_reg.end()) {
-          MODEL_LOG(error, "Bone out of hierarchy \"{}\"", bone_name);
-          continue;
-        }
-        const i32 bone_idx = static_cast<i32>(it->second);
-        for (size_t weight = 0; weight < ai_bone->mNumWeights; ++weight) {
-          try_place_weight(bone_idx, ai_bone->mWeights[weight]);
-        }
-      }
-      mesh.bones_start = static_cast<u32>(bone_pos);
-      bone_pos += mesh.nverts;
-    } else {
-      mesh.bones_start = static_cast<i32>(-1);
-    }
-
-    // Face indices
-    {
-      mesh.face_count = ai_mesh->mNumFaces;
-      u32 index_count = 0u;
-      for (size_t face_idx = 0; face_idx < ai_mesh->mNumFaces; ++face_idx) {
-        const aiFace& face = ai_mesh->mFaces[face_idx];
-        for (size_t i = 0; i < face.mNumIndices; ++i) {
-          const size_t pos = index_pos + index_count + i;
-          assert(pos < data.mesh_index_count);
-          data.mesh_indices[pos] = face.mIndices[i];
-        }
-        index_count += face.mNumIndices;
-      }
-      mesh.index_start = index_count ? index_pos : (u32)-1;
-      mesh.index_count = index_count;
-      index_pos += index_count;
+  // Set other props
+  mesh.bbox_max = asscast(ai_mesh->mAABB.mMax);
+  mesh.bbox_min = asscast(ai_mesh->mAABB.mMin);
+  mesh.material_index = ai_mesh->mMaterialIndex;
+  mesh.primitive = [&]() -> Model3DData::MeshPrimitive {
+    switch (ai_mesh->mPrimitiveTypes) {
+      case aiPrimitiveType_POINT:
+        return Model3DData::MESH_PRIMITIVE_POINT;
+      case aiPrimitiveType_LINE:
+        return Model3DData::MESH_PRIMITIVE_LINE;
+      case aiPrimitiveType_POLYGON:
+        return Model3DData::MESH_PRIMITIVE_POLYGON;
+      case aiPrimitiveType_TRIANGLE:
+        [[fallthrough]];
+      default:
+        return Model3DData::MESH_PRIMITIVE_TRIANGLE;
     }
-
-    // Blend shapes, almost a duplicate of the mesh data
-    if (ai_mesh->mNumAnimMeshes) {
-      mesh.blend_start = shape_pos;
-      mesh.blend_count = ai_mesh->mNumAnimMeshes;
-    } else {
-      mesh.blend_start = static_cast<u32>(-1);
+  }();
+#if 0
+  mesh.blend_method = [&]() -> model3d_data::mesh_blend_method {
+    switch (ai_mesh->mMethod) {
+      case aiMorphingMethod_MORPH_RELATIVE:
+        return model3d_data::MESH_BLEND_METHOD_RELATIVE;
+      case aiMorphingMethod_MORPH_NORMALIZED:
+        return model3d_data::MESH_BLEND_METHOD_NORMALIZED;
+      case aiMorphingMethod_VERTEX_BLEND:
+        [[fallthrough]];
+      default:
+        return model3d_data::MESH_BLEND_METHOD_VERTEX_BLEND;
     }
-    for (size_t j = 0; j < ai_mesh->mNumAnimMeshes; ++j) {
-      const aiAnimMesh* ai_anim = ai_mesh->mAnimMeshes[j];
-      auto& anim = data.blend_shapes[shape_pos++];
-      anim.nverts = ai_anim->mNumVertices;
-      anim.weight = ai_anim->mWeight;
-
-      // Positions (can be absent this time)
-      do_attrib(ai_anim->HasPositions(), anim.nverts, vertex_anim_pos, anim.positions_start,
-                [&](size_t pos, size_t vert) {
-                  assert(pos < data.blend_position_count);
-                  assert(vert < ai_anim->mNumVertices);
-                  data.blend_positions[pos] = asscast(ai_anim->mVertices[vert]);
-                });
-
-      // Normals
-      do_attrib(ai_anim->HasNormals(), anim.nverts, normal_anim_pos, anim.normals_start,
-                [&](size_t pos, size_t vert) {
-                  assert(pos < data.blend_normal_count);
-                  assert(vert < ai_anim->mNumVertices);
-                  data.blend_normals[pos] = asscast(ai_anim->mNormals[vert]);
-                });
-
-      // Tangents & Bitangents
-      do_attrib(ai_anim->HasTangentsAndBitangents(), anim.nverts, tangent_anim_pos,
-                anim.tangents_start, [&](size_t pos, size_t vert) {
-                  assert(pos < data.blend_tangent_count);
-                  assert(vert < ai_anim->mNumVertices);
-                  data.blend_tangents[pos] = asscast(ai_anim->mTangents[vert]);
-                  data.blend_bitangents[pos] = asscast(ai_anim->mBitangents[vert]);
-                });
+  }();
+#endif
+}
 
-      // UVs
-      for (size_t uv = 0; uv < Model3DData::MAX_MESH_UVS; ++uv) {
-        do_attrib(ai_anim->HasTextureCoords(uv), anim.nverts, uv_anim_pos[uv], anim.uvs_start[uv],
-                  [&](size_t pos, size_t vert) {
-                    assert(pos < data.blend_uv_count[uv]);
-                    assert(vert < ai_anim->mNumVertices);
-                    const auto& uv_vec = ai_anim->mTextureCoords[uv][vert];
-                    data.blend_uvs[uv][pos].x = uv_vec.x;
-                    data.blend_uvs[uv][pos].y = uv_vec.y;
-                  });
-      }
+void parse_meshes(Model3DData::ModelInternal& data, const aiScene& scene) {
+  // Prefix sum over the meshes, then every one of them can be filled on its own
+  Vec<mesh_cursor> cursors(scene.mNumMeshes);
+  mesh_cursor cur{};
+  const bool have_bones = !data.bone_registry.empty();
+  for (size_t mesh_idx = 0; mesh_idx < scene.mNumMeshes; ++mesh_idx) {
+    cursors[mesh_idx] = cur;
+    advance_cursor(cur, *scene.mMeshes[mesh_idx], have_bones);
+  }
+  assert(cur.vertex_pos == data.mesh_position_count);
+  assert(cur.index_pos == data.mesh_index_count);
 
-      // Colors
-      for (size_t col = 0; col < Model3DData::MAX_MESH_COLORS; ++col) {
-        do_attrib(ai_anim->HasVertexColors(col), anim.nverts, color_anim_pos[col],
-                  anim.colors_start[col], [&](size_t pos, size_t vert) {
-                    assert(pos < data.blend_color_count[col]);
-                    assert(vert < ai_anim->mNumVertices);
-                    data.blend_colors[col][pos] = asscast(ai_anim->mColors[col][vert]);
-                  });
-      }
+  jobs::parallel_for(scene.mNumMeshes, 1, [&](size_t begin, size_t end) {
+    for (size_t mesh_idx = begin; mesh_idx < end; ++mesh_idx) {
+      parse_mesh(data, scene.mMeshes[mesh_idx], data.meshes[mesh_idx], cursors[mesh_idx]);
     }
-
-    // Set other props
-    mesh.bbox_max = asscast(ai_mesh->mAABB.mMax);
-    mesh.bbox_min = asscast(ai_mesh->mAABB.mMin);
-    mesh.material_index = ai_mesh->mMaterialIndex;
-    mesh.primitive = [&]() -> Model3DData::MeshPrimitive {
-      switch (ai_mesh->mPrimitiveTypes) {
-        case aiPrimitiveType_POINT:
-          return Model3DData::MESH_PRIMITIVE_POINT;
-        case aiPrimitiveType_LINE:
-          return Model3DData::MESH_PRIMITIVE_LINE;
-        case aiPrimitiveType_POLYGON:
-          return Model3DData::MESH_PRIMITIVE_POLYGON;
-        case aiPrimitiveType_TRIANGLE:
-          [[fallthrough]];
-        default:
-          return Model3DData::MESH_PRIMITIVE_TRIANGLE;
-      }
-    }();
-#if 0
-    mesh.blend_method = [&]() -> model3d_data::mesh_blend_method {
-      switch (ai_mesh->mMethod) {
-        case aiMorphingMethod_MORPH_RELATIVE:
-          return model3d_data::MESH_BLEND_METHOD_RELATIVE;
-        case aiMorphingMethod_MORPH_NORMALIZED:
-          return model3d_data::MESH_BLEND_METHOD_NORMALIZED;
-        case aiMorphingMethod_VERTEX_BLEND:
-          [[fallthrough]];
-        default:
-          return model3d_data::MESH_BLEND_METHOD_VERTEX_BLEND;
-      }
-    }();
-#endif
-  }
+  });
 }
 
 bool parse_materials(Model3DData::ModelInternal& data, const aiScene& scene,
@@ -674,38 +772,75 @@ bool parse_materials(Model3DData::ModelInternal& data, const aiScene& scene,
   // Load images
   alloc_init(al, &data.textures, data.texture_count);
   alloc_init(al, &data.texture_images, data.texture_count);
-  size_t image_idx = 0;
-  DeferFn image_err_cleanup = [&]() {
-    for (size_t i = 0; i < image_idx; ++i) {
-      chima::image::destroy(data.chima, data.texture_images[i]);
-    }
-  };
-
-  static constexpr chima_image_depth image_depth = CHIMA_DEPTH_8U;
-  chima::error chimaerr;
-  for (; image_idx < data.texture_count; ++image_idx) {
-    auto& tex = data.textures[image_idx];
-    auto& img = data.texture_images[image_idx];
-    const auto [filename, type] = texture_set[image_idx];
+  for (size_t i = 0; i < data.texture_count; ++i) {
+    auto& tex = data.textures[i];
+    const auto& [filename, type] = texture_set[i];
     std::string_view filename_view(filename.data, filename.length);
     tex.name.copy_from(filename.data, filename.length);
     tex.path.format_from("{}/{}", texture_dir.as_view(), filename_view);
-    data.texture_registry.emplace(tex.name.as_view(), image_idx); // Name should always be unique
-    auto image = chima::image::load(data.chima, image_depth, tex.path.c_str(), &chimaerr);
-    if (!image) {
-      err.format_from("Failed to load image at \"{}\", {}", tex.path.as_view(), chimaerr.what());
-      MODEL_LOG(error, "{}", err.as_view());
-      return false;
+    tex.type = type;
+    data.texture_registry.emplace(tex.name.as_view(), i); // Name should always be unique
+  }
+
+  // Decoding is most of the load time for textured models, so every image gets its own job.
+  // Each chunk uses its own context, they all free through the default allocator so data.chima
+  // can still destroy the images later
+  static constexpr chima_image_depth image_depth = CHIMA_DEPTH_8U;
+  Vec<u8> loaded(data.texture_count, 0);
+  std::atomic<u64> decode_ns = 0;
+  std::mutex err_lock;
+  size_t failed_idx = data.texture_count;
+  const u64 decode_start = profiler::now();
+  jobs::parallel_for(data.texture_count, 1, [&](size_t begin, size_t end) {
+    KA_PROFILE_ZONE("decode_textures");
+    chima::context chima;
+    chima::error chimaerr;
+    for (size_t i = begin; i < end; ++i) {
+      auto& tex = data.textures[i];
+      const u64 start = profiler::now();
+      auto image = chima::image::load(chima, image_depth, tex.path.c_str(), &chimaerr);
+      decode_ns.fetch_add(profiler::now() - start, std::memory_order_relaxed);
+      if (!image) {
+        // Report the first one in texture order, no matter which job got there first
+        std::scoped_lock lock{err_lock};
+        if (i < failed_idx) {
+          failed_idx = i;
+          err.format_from("Failed to load image at \"{}\", {}", tex.path.as_view(),
+                          chimaerr.what());
+        }
+        continue;
+      }
+      auto& img = data.texture_images[i];
+      img = *image;
+      tex.data = img.data();
+      const auto [w, h] = img.extent();
+      tex.extent.width = w;
+      tex.extent.height = h;
+      tex.format = parse_chima_format(image_depth, img.channels());
+      mem_track_alloc(MemTag::textures, image_bytes(tex.extent, tex.format));
+      loaded[i] = 1;
     }
-    img = *image;
-    tex.data = img.data();
-    const auto [w, h] = img.extent();
-    tex.extent.width = w;
-    tex.extent.height = h;
-    tex.format = parse_chima_format(image_depth, img.channels());
-    tex.type = texture_set[image_idx].type;
+  });
+  const u64 wall_ns = profiler::now() - decode_start;
+  MODEL_LOG(debug, "Decoded {} textures in {:.3f}ms wall, {:.3f}ms cpu", data.texture_count,
+            wall_ns / 1e6, decode_ns.load(std::memory_order_relaxed) / 1e6);
+
+  if (failed_idx < data.texture_count) {
+    MODEL_LOG(error, "{}", err.as_view());
+    // The destructor skips the empty slots
+    for (size_t i = 0; i < data.texture_count; ++i) {
+      if (!loaded[i]) {
+        continue;
+      }
+      auto& tex = data.textures[i];
+      mem_track_free(MemTag::textures, image_bytes(tex.extent, tex.format));
+      chima::image::destroy(data.chima, data.texture_images[i]);
+      zeroinit(&data.texture_images[i], 1);
+      tex.data = nullptr;
+      tex.extent = {0, 0};
+    }
+    return false;
   }
-  image_err_cleanup.disengage();
 
   // Copy material -> texture map
   alloc_init(al, &data.material_textures, material_textures.size());
@@ -715,9 +850,28 @@ bool parse_materials(Model3DData::ModelInternal& data, const aiScene& scene,
   return true;
 }
 
+Optional<u64> model_cache_key(const BufferPath& model_path, const BufferPath& texture_dir,
+                              u32 importer_flags) {
+  if (!cache::is_enabled()) {
+    return nullopt;
+  }
+  // Only the main file is known before importing. Whatever else the importer opens goes in the
+  // .deps file, the lookup rehashes all of it
+  const auto file_hash = cache::hash_file(model_path.c_str());
+  if (!file_hash.has_value()) {
+    return nullopt;
+  }
+  // Texture paths end up in the cooked data, so the directory is part of the key too
+  const auto dir = texture_dir.as_view();
+  u64 key = hash_combine(*file_hash, importer_flags);
+  key = hash_combine(key, hash_bytes(dir.data(), dir.size()));
+  return hash_combine(key, KMDL_VERSION);
+}
+
 } // namespace
 
 AssExpect<Model3DData> Model3DLoader::load() {
+  KA_PROFILE_ZONE("Model3DLoader::load");
   ka_assert(_impl, "model3d_loader use after free");
   const DeferFn defer = [this]() {
     delete _impl;
@@ -747,7 +901,22 @@ AssExpect<Model3DData> Model3DLoader::load() {
   };
 
   try {
-    const aiScene* scene = _impl->importer.ReadFile(_impl->model_path.c_str(), assimpflags);
+    const auto cache_key =
+      model_cache_key(_impl->model_path, _impl->texture_dir, _impl->importer_flags);
+    if (cache_key.has_value()) {
+      if (const auto cached = cache::lookup(*cache_key, "kmdl"); cached.has_value()) {
+        auto data = load_kmdl(cached->c_str(), _impl->model_name, _impl->model_path, err);
+        if (data) {
+          return {in_place, *data.release()};
+        }
+        MODEL_LOG(warn, "Failed to load cached \"{}\", {}", cached->as_view(), err.as_view());
+      }
+    }
+
+    const aiScene* scene = [&]() {
+      KA_PROFILE_ZONE("assimp::ReadFile");
+      return _impl->importer.ReadFile(_impl->model_path.c_str(), assimpflags);
+    }();
     if (!scene || !scene->mNumMeshes) {
       err.format_from("ASSIMP error: {}", _impl->importer.GetErrorString());
       MODEL_LOG(error, "{}", err.as_view());
@@ -760,11 +929,28 @@ AssExpect<Model3DData> Model3DLoader::load() {
       return unex();
     }
 
-    parse_rigs(*data, *scene, bone_invs);
-    parse_meshes(*data, *scene);
+    {
+      KA_PROFILE_ZONE("parse_rigs");
+      parse_rigs(*data, *scene, bone_invs);
+    }
+    {
+      KA_PROFILE_ZONE("parse_meshes");
+      parse_meshes(*data, *scene);
+    }
+    KA_PROFILE_ZONE("parse_materials");
     if (!parse_materials(*data, *scene, _impl->texture_dir, err)) {
       return unex();
     }
+    if (cache_key.has_value()) {
+      // Everything the importer read and the textures are baked in, any of them changing
+      // invalidates the entry
+      Vec<BufferPath> deps = std::move(_impl->io->opened);
+      deps.reserve(deps.size() + data->texture_count);
+      for (size_t i = 0; i < data->texture_count; ++i) {
+        deps.push_back(data->textures[i].path);
+      }
+      cache::store(*cache_key, "kmdl", cook_model_blob(*data), std::move(deps));
+    }
     // TODO: Parse animations
     return {in_place, *data.release()};
   } catch (const std::bad_alloc&) {
@@ -782,38 +968,23 @@ Model3DData::ModelInternal::~ModelInternal() {
   if (ptr && sz)         \
   alloc.dealloc(ptr, sz)
 
-  for (size_t i = 0; i < MAX_MESH_COLORS; ++i) {
-    DEALLOC(mesh_colors[i], mesh_color_count[i]);
-    DEALLOC(blend_colors[i], blend_color_count[i]);
-  }
-  for (size_t i = 0; i < MAX_MESH_UVS; ++i) {
-    DEALLOC(mesh_uvs[i], mesh_uv_count[i]);
-    DEALLOC(blend_uvs[i], blend_uv_count[i]);
+  if (!mapping.empty()) {
+    DEALLOC(textures, texture_count);
+    return;
   }
 
-  DEALLOC(mesh_bone_indices, mesh_bone_count);
-  DEALLOC(mesh_bone_weights, mesh_bone_count);
-
-  DEALLOC(mesh_tangents, mesh_tangent_count);
-  DEALLOC(mesh_bitangents, mesh_tangent_count);
-  DEALLOC(blend_tangents, blend_tangent_count);
-  DEALLOC(blend_bitangents, blend_tangent_count);
-
-  DEALLOC(mesh_normals, mesh_normal_count);
-  DEALLOC(blend_normals, blend_normal_count);
-
-  DEALLOC(mesh_positions, mesh_position_count);
-  DEALLOC(blend_positions, blend_position_count);
-
-  DEALLOC(meshes, mesh_count);
-  DEALLOC(mesh_indices, mesh_index_count);
-  DEALLOC(blend_shapes, blend_shape_count);
-
-  DEALLOC(bones, bone_count);
-  DEALLOC(bone_locals, bone_count);
-  DEALLOC(bone_inv_models, bone_count);
+  // Meshes, blend shapes and bones
+  if (stream_block) {
+    alloc.dealloc_block(stream_block, stream_block_size, MODEL_STREAM_ALIGN);
+  }
 
   for (size_t i = 0; i < texture_count; ++i) {
+    const auto& tex = textures[i];
+    // Slots that never decoded, or got freed when another one failed
+    if (!tex.data) {
+      continue;
+    }
+    mem_track_free(MemTag::textures, image_bytes(tex.extent, tex.format));
     chima::image::destroy(chima, texture_images[i]);
   }
   DEALLOC(textures, texture_count);
@@ -877,6 +1048,11 @@ BufferPath& Model3DData::path() const {
   return _data->path;
 }
 
+bool Model3DData::is_cooked() const {
+  CHECK_DATA;
+  return !_data->mapping.empty();
+}
+
 Model3DData::MeshData& Model3DData::mesh_at(size_t idx) const {
   CHECK_DATA;
   assert(idx < _data->mesh_count);
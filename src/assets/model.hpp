@@ -206,6 +206,12 @@ public:
 
   void destroy() noexcept;
 
+  // Writes everything as a .kmdl file that CookedModelLoader can map back without assimp
+  AssExpect<void> cook(std::string_view kmdl_path) const;
+
+  // Loaded from a .kmdl file, the arrays point into the mapping
+  bool is_cooked() const;
+
 public:
   BufferName& name() const;
   BufferPath& path() const;
@@ -347,4 +353,25 @@ private:
   LoaderInternal* _impl;
 };
 
+// Maps a file written by Model3DData::cook. Mesh, bone and material arrays are used in place, only
+// the texture table and the name lookups get built on load. The mapping is copy on write, so the
+// spans handed out can still be written to
+class CookedModelLoader {
+private:
+  struct LoaderInternal;
+
+public:
+  CookedModelLoader(std::string_view kmdl_path, std::string_view model_name);
+
+public:
+  // Same deal as Model3DLoader::load
+  AssExpect<Model3DData> load();
+
+public:
+  AssExpect<Model3DData> operator()() { return load(); }
+
+private:
+  LoaderInternal* _impl;
+};
+
 } // namespace kappa::assets
@@ -5,6 +5,79 @@
 
 namespace kappa::assets {
 
+namespace {
+
+constexpr u32 KIMG_MAGIC = 0x474D494B; // "KIMG" in little endian
+constexpr u32 KIMG_BYTE_ORDER = 0x01020304;
+constexpr size_t KIMG_PIXEL_OFFSET = 64;
+
+struct KimgHeader {
+  u32 magic;
+  u32 version;
+  u32 byte_order;
+  u32 width;
+  u32 height;
+  u32 format;
+  u64 pixel_size;
+};
+
+static_assert(sizeof(KimgHeader) <= KIMG_PIXEL_OFFSET);
+
+Optional<u64> image_cache_key(const ImageLoader::LoaderInternal& impl) {
+  if (!cache::is_enabled()) {
+    return nullopt;
+  }
+  const auto file_hash = cache::hash_file(impl.texture_path.c_str());
+  if (!file_hash.has_value()) {
+    return nullopt;
+  }
+  return hash_combine(hash_combine(*file_hash, impl.chima_flags), KIMG_VERSION);
+}
+
+} // namespace
+
+Vec<u8> cook_image_blob(const ImageData::ImageInternal& image) {
+  const KimgHeader header{
+    KIMG_MAGIC,          KIMG_VERSION,      KIMG_BYTE_ORDER, image.extent.width,
+    image.extent.height, (u32)image.format, image.size,
+  };
+  Vec<u8> blob(KIMG_PIXEL_OFFSET + image.size);
+  std::memcpy(blob.data(), &header, sizeof(header));
+  std::memcpy(blob.data() + KIMG_PIXEL_OFFSET, image.pixels, image.size);
+  return blob;
+}
+
+ImageData::ImageInternal* load_kimg(const char* kimg_path, BuffStr<256>& err) {
+  // Copy on write, ImageData hands out mutable pixels
+  auto file = MappedFile::open(kimg_path, true);
+  if (file.size() < KIMG_PIXEL_OFFSET) {
+    err.format_from("Failed to open file");
+    return nullptr;
+  }
+  KimgHeader header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (header.magic != KIMG_MAGIC || header.byte_order != KIMG_BYTE_ORDER ||
+      header.version != KIMG_VERSION) {
+    err.format_from("Not a version {} kimg file", KIMG_VERSION);
+    return nullptr;
+  }
+  if (header.format > (u32)ImageFormat::rgba32f) {
+    err.format_from("Invalid image format {}", header.format);
+    return nullptr;
+  }
+  const Extent2D extent{header.width, header.height};
+  const auto format = static_cast<ImageFormat>(header.format);
+  if (header.pixel_size != image_bytes(extent, format) ||
+      file.size() != KIMG_PIXEL_OFFSET + header.pixel_size) {
+    err.format_from("Expected {} pixel bytes, got {}", image_bytes(extent, format),
+                    file.size() - KIMG_PIXEL_OFFSET);
+    return nullptr;
+  }
+  // Moving the mapping keeps the pixels where they are
+  void* pixels = file.mutable_data() + KIMG_PIXEL_OFFSET;
+  return new ImageData::ImageInternal(std::move(file), pixels, extent, format);
+}
+
 ImageLoader::ImageLoader(std::string_view texture_path, std::string_view texture_name, u32 flags) :
     _impl(new ImageLoader::LoaderInternal()) {
   _impl->texture_path.copy_from(texture_path.data(), texture_path.size());
@@ -18,6 +91,28 @@ AssExpect<ImageData> ImageLoader::load() {
     delete _impl;
     _impl = nullptr;
   };
+  const fn set_names = [this](ImageData::ImageInternal& data) {
+    data.name = _impl->texture_name;
+    data.path = _impl->texture_path;
+  };
+
+  const auto cache_key = image_cache_key(*_impl);
+  if (cache_key.has_value()) {
+    if (const auto cached = cache::lookup(*cache_key, "kimg"); cached.has_value()) {
+      BuffStr<256> err;
+      ImageData::ImageInternal* ptr = nullptr;
+      try {
+        ptr = load_kimg(cached->c_str(), err);
+      } catch (const std::bad_alloc&) {
+        err.format_from("Failed to allocate texture internals");
+      }
+      if (ptr) {
+        set_names(*ptr);
+        return {in_place, *ptr};
+      }
+      TEX_LOG(warn, "Failed to load cached \"{}\", {}", cached->as_view(), err.as_view());
+    }
+  }
 
   chima::error chimaerr;
   auto chima = chima::context::create(nullptr, &chimaerr);
@@ -40,13 +135,12 @@ AssExpect<ImageData> ImageLoader::load() {
   }
 
   try {
-    auto* ptr = new ImageData::ImageInternal(*std::move(chima), *image);
-    std::memcpy(ptr->name.data, _impl->texture_name.data, sizeof(ptr->name.data));
-    ptr->name.len = _impl->texture_name.len;
-    std::memcpy(ptr->path.data, _impl->texture_path.data, sizeof(ptr->path.data));
-    ptr->path.len = _impl->texture_path.len;
-    ptr->format = parse_chima_format(image->get().depth, image->get().channels);
-
+    const auto format = parse_chima_format(image->get().depth, image->get().channels);
+    auto* ptr = new ImageData::ImageInternal(*std::move(chima), *image, format);
+    set_names(*ptr);
+    if (cache_key.has_value()) {
+      cache::store(*cache_key, "kimg", cook_image_blob(*ptr), {});
+    }
     return {in_place, *ptr};
   } catch (const std::bad_alloc&) {
     chima::image::destroy(*chima, *image);
@@ -79,12 +173,12 @@ BufferPath& ImageData::path() const {
 
 void* ImageData::data() const {
   ka_assert(_data, "texture_data use after free");
-  return _data->image.data();
+  return _data->pixels;
 }
 
 Extent2D ImageData::extent() const {
   ka_assert(_data, "texture_data use after free");
-  return {_data->image.get().extent.width, _data->image.get().extent.height};
+  return _data->extent;
 }
 
 ImageFormat ImageData::format() const {
@@ -5,7 +5,20 @@
 #include <fmt/chrono.h>
 #include <fmt/printf.h>
 
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <fstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace kappa {
 
@@ -22,18 +35,337 @@ fn load_entire_file(const char* path) -> UniqueArray<u8> {
   return array;
 }
 
+MappedFile::MappedFile() noexcept : _data(nullptr), _size(0), _buffer(), _writable(false) {}
+
+MappedFile::MappedFile(create_t, const u8* data, size_t size, Vec<u8>&& buffer,
+                       bool writable) noexcept :
+    _data(data), _size(size), _buffer(std::move(buffer)), _writable(writable) {}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+    _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)),
+    _buffer(std::move(other._buffer)), _writable(std::exchange(other._writable, false)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    unmap();
+    _data = std::exchange(other._data, nullptr);
+    _size = std::exchange(other._size, 0);
+    _buffer = std::move(other._buffer);
+    _writable = std::exchange(other._writable, false);
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() noexcept {
+  unmap();
+}
+
+fn MappedFile::unmap() -> void {
+  if (is_mapped()) {
+    munmap(const_cast<u8*>(_data), _size);
+  }
+  _data = nullptr;
+  _size = 0;
+  _buffer.clear();
+  _writable = false;
+}
+
+fn MappedFile::open(const char* path, bool copy_on_write) -> MappedFile {
+  const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return {};
+  }
+  // The mapping stays valid after closing
+  const DeferFn close_fd = [fd]() {
+    ::close(fd);
+  };
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+    const size_t size = (size_t)file_stat.st_size;
+    if (!size) {
+      return {};
+    }
+    const int prot = copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* ptr = mmap(nullptr, size, prot, MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED) {
+      // Everyone reads these front to back right after opening
+      madvise(ptr, size, MADV_SEQUENTIAL);
+      madvise(ptr, size, MADV_WILLNEED);
+      return {create_t(), static_cast<const u8*>(ptr), size, {}, copy_on_write};
+    }
+  }
+
+  // Pipes and such, or mmap just failed. Read it all into a buffer
+  Vec<u8> buffer;
+  size_t size = 0;
+  for (;;) {
+    buffer.resize(std::max<size_t>(size + 4096, buffer.size()));
+    const ssize_t count = ::read(fd, buffer.data() + size, buffer.size() - size);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return {};
+    }
+    if (count == 0) {
+      break;
+    }
+    size += (size_t)count;
+  }
+  if (!size) {
+    return {};
+  }
+  buffer.resize(size);
+  const u8* data = buffer.data();
+  return {create_t(), data, size, std::move(buffer), copy_on_write};
+}
+
+fn hash_bytes(const void* data, size_t size, u64 seed) -> u64 {
+  // Word at a time multiply-xorshift, good enough for cache keys
+  static constexpr u64 mul = 0x9fb21c651e98df25ull;
+  const fn mix = [](u64 h) -> u64 {
+    h ^= h >> 47;
+    return h * mul;
+  };
+
+  const u8* ptr = static_cast<const u8*>(data);
+  u64 h = seed ^ (size * mul);
+  while (size >= sizeof(u64)) {
+    u64 word;
+    std::memcpy(&word, ptr, sizeof(u64));
+    h = mix((h ^ word) * mul);
+    ptr += sizeof(u64);
+    size -= sizeof(u64);
+  }
+  if (size) {
+    u64 tail = 0;
+    std::memcpy(&tail, ptr, size);
+    h = mix((h ^ tail) * mul);
+  }
+  return mix(h);
+}
+
 namespace {
 
 LogLevel level = LogLevel::verbose;
 
-fn get_time() {
-  using TimePoint = std::chrono::system_clock::time_point;
-  TimePoint now = std::chrono::system_clock::now();
-  uint64_t ms =
-    std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+constexpr size_t LOG_QUEUE_SIZE = 1024; // Has to be a power of two
 
-  return std::make_pair(std::chrono::system_clock::to_time_t(now), ms);
+constexpr std::string_view log_prefixes[] = {
+  "[0;31m[ERROR]", "[0;33m[WARNING]", "[0;34m[INFO]", "[0;32m[DEBUG]", "[0;37m[VERBOSE]",
+};
+
+fn split_time(i64 time) -> std::pair<std::time_t, i64> {
+  using std::chrono::system_clock;
+  const auto stamp = system_clock::time_point(system_clock::duration(time));
+  const i64 ms =
+    std::chrono::duration_cast<std::chrono::milliseconds>(stamp.time_since_epoch()).count();
+  return std::make_pair(system_clock::to_time_t(stamp), ms % 1000);
+}
+
+fn format_line(fmt::memory_buffer& out, const std::tm& tm, i64 ms, LogLevel level_,
+               std::string_view str) -> void {
+  fmt::format_to(std::back_inserter(out), "[{:%H:%M:%S}.{:03d}]\033{}\033[0m{}\n", tm, (int)ms,
+                 log_prefixes[(u32)level_], str);
 }
+
+struct LogRecord {
+  std::atomic<u64> seq;
+  i64 time; // System clock ticks, taken by the producer
+  LogLevel level;
+  u32 len;
+  char text[LOG_LINE_MAX];
+};
+
+// Bounded multi producer queue, drained by a single writer thread. Producers only touch an
+// atomic and their own record, no locks and no allocations
+class Logger {
+public:
+  Logger() :
+      _head(0), _tail(0), _drained(0), _pushing(0), _wake(0), _sleeping(false), _running(false),
+      _cached_time(-1), _cached_tm() {
+    for (u64 i = 0; i < LOG_QUEUE_SIZE; ++i) {
+      _records[i].seq.store(i, std::memory_order_relaxed);
+    }
+    _running.store(true, std::memory_order_release);
+    _thread = std::thread([this]() {
+      thread_loop();
+    });
+  }
+
+public:
+  fn push(LogLevel level_, std::string_view str) -> void {
+    const i64 now = std::chrono::system_clock::now().time_since_epoch().count();
+    if (!_running.load(std::memory_order_acquire)) {
+      // No writer around anymore, just print it
+      print_now(now, level_, str);
+      return;
+    }
+    // Counted and checked again, so shutdown can wait for the pushes that got past it
+    _pushing.fetch_add(1, std::memory_order_seq_cst);
+    const DeferFn done = [this]() {
+      _pushing.fetch_sub(1, std::memory_order_release);
+    };
+    if (!_running.load(std::memory_order_seq_cst)) {
+      print_now(now, level_, str);
+      return;
+    }
+
+    u64 pos = _head.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& record = _records[pos & (LOG_QUEUE_SIZE - 1)];
+      const u64 seq = record.seq.load(std::memory_order_acquire);
+      const i64 diff = (i64)seq - (i64)pos;
+      if (diff == 0) {
+        if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          record.time = now;
+          record.level = level_;
+          record.len = (u32)std::min(str.size(), LOG_LINE_MAX);
+          std::memcpy(record.text, str.data(), record.len);
+          record.seq.store(pos + 1, std::memory_order_release);
+          wake_writer();
+          return;
+        }
+      } else if (diff < 0) {
+        // Full, wait for the writer to catch up. If it stopped in the meantime print it here
+        if (!_running.load(std::memory_order_acquire)) {
+          print_now(now, level_, str);
+          return;
+        }
+        std::this_thread::yield();
+        pos = _head.load(std::memory_order_relaxed);
+      } else {
+        pos = _head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  fn flush() -> void {
+    if (!_running.load(std::memory_order_acquire)) {
+      std::fflush(stdout);
+      return;
+    }
+    const u64 target = _head.load(std::memory_order_acquire);
+    while (_drained.load(std::memory_order_acquire) < target) {
+      std::this_thread::yield();
+    }
+  }
+
+  fn shutdown() -> void {
+    if (!_running.exchange(false, std::memory_order_seq_cst)) {
+      return;
+    }
+    _wake.fetch_add(1, std::memory_order_release);
+    _wake.notify_one();
+    _thread.join();
+    // Anything pushed while the thread was stopping, including pushes still in flight
+    while (_pushing.load(std::memory_order_seq_cst) ||
+           _drained.load(std::memory_order_relaxed) != _head.load(std::memory_order_acquire)) {
+      if (!drain()) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  fn print_now(i64 now, LogLevel level_, std::string_view str) -> void {
+    const auto [time, ms] = split_time(now);
+    std::tm tm;
+    localtime_r(&time, &tm);
+    fmt::memory_buffer out;
+    format_line(out, tm, ms, level_, str);
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    std::fflush(stdout);
+  }
+
+  // Producers only pay for the notify when the writer is actually asleep
+  fn wake_writer() -> void {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_sleeping.load(std::memory_order_relaxed)) {
+      _wake.fetch_add(1, std::memory_order_release);
+      _wake.notify_one();
+    }
+  }
+
+  fn thread_loop() -> void {
+    while (_running.load(std::memory_order_acquire)) {
+      if (drain()) {
+        continue;
+      }
+      // Taken before looking at the queue, a push or shutdown after that bumps it and the wait
+      // returns right away
+      const u32 wake = _wake.load(std::memory_order_acquire);
+      _sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (_head.load(std::memory_order_relaxed) == _tail &&
+          _running.load(std::memory_order_acquire)) {
+        _wake.wait(wake, std::memory_order_acquire);
+      } else {
+        // A record got claimed but isn't written yet
+        std::this_thread::yield();
+      }
+      _sleeping.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  fn drain() -> bool {
+    _out.clear();
+    u64 count = 0;
+    for (;;) {
+      auto& record = _records[_tail & (LOG_QUEUE_SIZE - 1)];
+      if (record.seq.load(std::memory_order_acquire) != _tail + 1) {
+        break;
+      }
+      const auto [time, ms] = split_time(record.time);
+      // localtime is slow and not thread safe, only redo it once per second
+      if (time != _cached_time) {
+        localtime_r(&time, &_cached_tm);
+        _cached_time = time;
+      }
+      format_line(_out, _cached_tm, ms, record.level, {record.text, record.len});
+      record.seq.store(_tail + LOG_QUEUE_SIZE, std::memory_order_release);
+      ++_tail;
+      ++count;
+    }
+    if (!count) {
+      return false;
+    }
+    // One write for the whole batch
+    std::fwrite(_out.data(), 1, _out.size(), stdout);
+    std::fflush(stdout);
+    _drained.store(_tail, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::array<LogRecord, LOG_QUEUE_SIZE> _records;
+  alignas(64) std::atomic<u64> _head;
+  alignas(64) u64 _tail;
+  std::atomic<u64> _drained;
+  std::atomic<u32> _pushing;
+  std::atomic<u32> _wake;
+  std::atomic<bool> _sleeping;
+  std::atomic<bool> _running;
+  std::thread _thread;
+  // Writer thread only
+  fmt::memory_buffer _out;
+  std::time_t _cached_time;
+  std::tm _cached_tm;
+};
+
+fn logger() -> Logger& {
+  // Never destroyed, so logging from other static destructors still works after shutdown
+  static Logger* instance = []() {
+    auto* ptr = new Logger();
+    std::atexit([]() {
+      logger().shutdown();
+    });
+    return ptr;
+  }();
+  return *instance;
+}
+
 } // namespace
 
 void set_log_level(LogLevel level_) {
@@ -44,10 +376,12 @@ LogLevel get_log_level() {
   return level;
 }
 
-void log_str(std::string_view prefix, std::string_view str) {
-  const auto [time, ms] = get_time();
-  const std::tm* time_tm = std::localtime(&time);
-  fmt::print("[{:%H:%M:%S}.{:03d}]\033{}\033[0m{}\n", *time_tm, (int)ms, prefix, str);
+void log_push(LogLevel level_, std::string_view str) {
+  logger().push(level_, str);
+}
+
+void log_flush() {
+  logger().flush();
 }
 
 } // namespace kappa
@@ -15,7 +15,26 @@
 
 #define ka_assert(...) NTF_ASSERT(__VA_ARGS__)
 #define ka_todo(...)   NTF_TODO(__VA_ARGS__)
-#define ka_panic(...)  NTF_PANIC(__VA_ARGS__)
+#define ka_panic(...)       \
+  do {                      \
+    ::kappa::log_flush();   \
+    NTF_PANIC(__VA_ARGS__); \
+  } while (0)
+
+// Levels above this (less important) get compiled out, 0 = error ... 4 = verbose
+#ifndef KA_LOG_MIN_LEVEL
+#define KA_LOG_MIN_LEVEL 4
+#endif
+
+// Arguments are only evaluated if the level is compiled in and enabled at runtime
+#define KA_LOG(_level, ...)                                            \
+  do {                                                                 \
+    if constexpr (::kappa::log_compiled(::kappa::LogLevel::_level)) {  \
+      if (::kappa::log_enabled(::kappa::LogLevel::_level)) {           \
+        ::kappa::log_at_level(::kappa::LogLevel::_level, __VA_ARGS__); \
+      }                                                                \
+    }                                                                  \
+  } while (0)
 
 #define KA_UNUSED(_thing) NTF_UNUSED(_thing)
 #define KA_UNREACHABLE()  NTF_UNREACHABLE()
@@ -53,6 +72,7 @@ public:
 
 #include <fmt/format.h>
 
+#include <cstdint>
 #include <deque>
 #include <vector>
 
@@ -123,49 +143,329 @@ enum class LogLevel : u32 {
   verbose,
 };
 
+// Longer lines get truncated
+constexpr size_t LOG_LINE_MAX = 480;
+
 void set_log_level(LogLevel level);
 LogLevel get_log_level();
-void log_str(std::string_view prefix, std::string_view str);
+
+constexpr fn log_compiled(LogLevel level) -> bool {
+  return (u32)level <= KA_LOG_MIN_LEVEL;
+}
+
+inline fn log_enabled(LogLevel level) -> bool {
+  return log_compiled(level) && (u32)level <= (u32)get_log_level();
+}
+
+// Queues an already formatted line, a background thread writes it out
+void log_push(LogLevel level, std::string_view str);
+
+// Blocks until everything logged so far is written, called on panic and exit
+void log_flush();
 
 fn load_entire_file(const char* path) -> UniqueArray<u8>;
 
+// Read only view of a whole file. Regular files get mmapped, anything else gets read into a
+// buffer. Empty if the file couldn't be opened. With copy_on_write the pages can be written to
+// through mutable_data(), the changes stay private and never reach the file
+class MappedFile {
+private:
+  struct create_t {};
+
+public:
+  MappedFile() noexcept;
+  MappedFile(create_t, const u8* data, size_t size, Vec<u8>&& buffer, bool writable) noexcept;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() noexcept;
+
+public:
+  static fn open(const char* path, bool copy_on_write = false) -> MappedFile;
+
+public:
+  fn data() const -> const u8* { return _data; }
+
+  fn mutable_data() -> u8* {
+    ka_assert(_writable, "File not mapped as copy on write");
+    return const_cast<u8*>(_data);
+  }
+
+  fn size() const -> size_t { return _size; }
+
+  fn span() const -> Span<const u8> { return {_data, _size}; }
+
+  fn empty() const -> bool { return _size == 0; }
+
+  fn is_mapped() const -> bool { return _data && _buffer.empty(); }
+
+private:
+  fn unmap() -> void;
+
+private:
+  const u8* _data;
+  size_t _size;
+  Vec<u8> _buffer; // Only used by the fallback path
+  bool _writable;
+};
+
+fn hash_bytes(const void* data, size_t size, u64 seed = 0) -> u64;
+
+constexpr fn hash_combine(u64 seed, u64 value) -> u64 {
+  return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+struct AllocStats {
+  u64 count; // Calls to the global operator new since startup
+  u64 bytes;
+};
+
+// Always zero when built without KA_ALLOC_STATS
+fn alloc_stats() -> AllocStats;
+
+// Who owns a chunk of host memory. Only covers what goes through tagged_alloc or gets reported
+// with mem_track_alloc, the global counters above still see everything
+enum class MemTag : u8 {
+  models = 0,
+  textures,
+  vulkan_host,
+  physics,
+  frame_scratch,
+
+  count,
+};
+
+struct MemTagStats {
+  u64 current; // Bytes
+  u64 peak;
+  u64 count; // Live allocations
+  u64 total; // Allocations since startup
+};
+
+fn mem_tag_name(MemTag tag) -> const char*;
+
+// Always zero when built without KA_ALLOC_STATS
+fn mem_tag_stats(MemTag tag) -> MemTagStats;
+
+// Bookkeeping only, for memory that some library allocated on our behalf
+fn mem_track_alloc(MemTag tag, size_t size) -> void;
+fn mem_track_free(MemTag tag, size_t size) -> void;
+
+// Global operator new and delete plus the bookkeeping. The size and alignment passed to free
+// have to match the ones used to allocate
+fn tagged_alloc(MemTag tag, size_t size, size_t align) -> void*;
+fn tagged_free(MemTag tag, void* ptr, size_t size, size_t align) noexcept -> void;
+
+template<typename T, MemTag Tag>
+class TaggedAllocator {
+public:
+  using value_type = T;
+
+  template<typename U>
+  struct rebind {
+    using other = TaggedAllocator<U, Tag>;
+  };
+
+public:
+  TaggedAllocator() noexcept = default;
+
+  template<typename U>
+  TaggedAllocator(const TaggedAllocator<U, Tag>&) noexcept {}
+
+public:
+  fn allocate(size_t count) -> T* {
+    return static_cast<T*>(tagged_alloc(Tag, count * sizeof(T), alignof(T)));
+  }
+
+  fn deallocate(T* ptr, size_t count) noexcept -> void {
+    tagged_free(Tag, ptr, count * sizeof(T), alignof(T));
+  }
+
+  template<typename U>
+  fn operator==(const TaggedAllocator<U, Tag>&) const -> bool {
+    return true;
+  }
+};
+
+// Bump allocator for temporaries, everything in it gets freed at once. Grows by chaining
+// blocks, and reset() merges them into a single one, so once it has seen the biggest frame it
+// stops touching the heap
+class LinearArena {
+public:
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+private:
+  struct alignas(16) Block {
+    Block* next;
+    size_t size;
+    size_t offset;
+
+    u8* data() { return reinterpret_cast<u8*>(this + 1); }
+  };
+
+public:
+  struct Marker {
+    Block* block;
+    size_t offset;
+  };
+
+public:
+  LinearArena() noexcept;
+  explicit LinearArena(size_t block_size) noexcept;
+
+  LinearArena(LinearArena&& other) noexcept;
+  LinearArena& operator=(LinearArena&& other) noexcept;
+  LinearArena(const LinearArena&) = delete;
+  LinearArena& operator=(const LinearArena&) = delete;
+
+  ~LinearArena() noexcept;
+
+public:
+  fn allocate(size_t size, size_t align) -> void* {
+    if (_current) {
+      u8* base = _current->data();
+      const uintptr_t ptr =
+        ((uintptr_t)(base + _current->offset) + align - 1) & ~(uintptr_t)(align - 1);
+      const size_t end = ptr - (uintptr_t)base + size;
+      if (end <= _current->size) {
+        _current->offset = end;
+        return reinterpret_cast<void*>(ptr);
+      }
+    }
+    return grow(size, align);
+  }
+
+  template<typename T>
+  fn allocate(size_t count) -> T* {
+    return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+  }
+
+  // Frees everything, nothing allocated from it can be used after this
+  fn reset() -> void;
+
+  fn marker() const -> Marker { return {_current, _current ? _current->offset : 0}; }
+
+  // Frees everything allocated after the marker was taken, keeping the blocks around
+  fn rewind(Marker marker) -> void;
+
+  fn used() const -> size_t;
+
+  fn capacity() const -> size_t { return _capacity; }
+
+private:
+  fn grow(size_t size, size_t align) -> void*;
+  fn release() -> void;
+
+private:
+  Block* _first;
+  Block* _current;
+  size_t _block_size;
+  size_t _capacity;
+};
+
+// Lets standard containers allocate from an arena, deallocating does nothing
+template<typename T>
+class ArenaAllocator {
+public:
+  using value_type = T;
+
+public:
+  ArenaAllocator(LinearArena& arena) noexcept : _arena(&arena) {}
+
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept : _arena(other.arena()) {}
+
+public:
+  fn allocate(size_t count) -> T* { return _arena->allocate<T>(count); }
+
+  fn deallocate(T*, size_t) noexcept -> void {}
+
+  fn arena() const -> LinearArena* { return _arena; }
+
+  template<typename U>
+  fn operator==(const ArenaAllocator<U>& other) const -> bool {
+    return _arena == other.arena();
+  }
+
+private:
+  LinearArena* _arena;
+};
+
+// Growing one of these leaves the old storage behind until the arena resets, reserve up front
+template<typename T>
+using ArenaVec = std::vector<T, ArenaAllocator<T>>;
+
+template<typename T>
+using ArenaDeque = std::deque<T, ArenaAllocator<T>>;
+
+// Per thread arena for temporaries that don't outlive a function
+fn scratch_arena() -> LinearArena&;
+
+// Frees whatever got allocated from the scratch arena while it was alive. Scopes can nest
+class ScratchScope {
+public:
+  ScratchScope() noexcept;
+  ~ScratchScope() noexcept;
+
+  ScratchScope(const ScratchScope&) = delete;
+  ScratchScope& operator=(const ScratchScope&) = delete;
+
+public:
+  fn arena() const -> LinearArena& { return *_arena; }
+
+private:
+  LinearArena* _arena;
+  LinearArena::Marker _marker;
+};
+
 template<typename... Args>
 void log_at_level(LogLevel level, fmt::format_string<Args...> fmt, Args&&... args) {
-  if ((u32)get_log_level() < (u32)level) {
+  if (!log_enabled(level)) {
     return;
   }
 
-  static constexpr std::string_view prefixes[] = {
-    "[0;31m[ERROR]", "[0;33m[WARNING]", "[0;34m[INFO]", "[0;32m[DEBUG]", "[0;37m[VERBOSE]",
-  };
-
-  const auto str = fmt::format(fmt, std::forward<Args>(args)...);
-  log_str(prefixes[(u32)level], str);
+  // Format on the stack, the queue copies it
+  char buffer[LOG_LINE_MAX];
+  const auto res = fmt::format_to_n(buffer, LOG_LINE_MAX, fmt, std::forward<Args>(args)...);
+  log_push(level, {buffer, std::min(res.size, LOG_LINE_MAX)});
 }
 
 template<typename... Args>
 void log_error(fmt::format_string<Args...> fmt, Args&&... args) {
-  log_at_level(LogLevel::error, fmt, std::forward<Args>(args)...);
+  if constexpr (log_compiled(LogLevel::error)) {
+    log_at_level(LogLevel::error, fmt, std::forward<Args>(args)...);
+  }
 }
 
 template<typename... Args>
 void log_warn(fmt::format_string<Args...> fmt, Args&&... args) {
-  log_at_level(LogLevel::warn, fmt, std::forward<Args>(args)...);
+  if constexpr (log_compiled(LogLevel::warn)) {
+    log_at_level(LogLevel::warn, fmt, std::forward<Args>(args)...);
+  }
 }
 
 template<typename... Args>
 void log_info(fmt::format_string<Args...> fmt, Args&&... args) {
-  log_at_level(LogLevel::info, fmt, std::forward<Args>(args)...);
+  if constexpr (log_compiled(LogLevel::info)) {
+    log_at_level(LogLevel::info, fmt, std::forward<Args>(args)...);
+  }
 }
 
 template<typename... Args>
 void log_debug(fmt::format_string<Args...> fmt, Args&&... args) {
-  log_at_level(LogLevel::debug, fmt, std::forward<Args>(args)...);
+  if constexpr (log_compiled(LogLevel::debug)) {
+    log_at_level(LogLevel::debug, fmt, std::forward<Args>(args)...);
+  }
 }
 
 template<typename... Args>
 void log_verbose(fmt::format_string<Args...> fmt, Args&&... args) {
-  log_at_level(LogLevel::verbose, fmt, std::forward<Args>(args)...);
+  if constexpr (log_compiled(LogLevel::verbose)) {
+    log_at_level(LogLevel::verbose, fmt, std::forward<Args>(args)...);
+  }
 }
 
 template<size_t MaxSize>
@@ -0,0 +1,366 @@
+#include "./jobs.hpp"
+#include "./profiler.hpp"
+
+#include <array>
+#include <memory>
+#include <random>
+#include <thread>
+
+namespace kappa::jobs {
+
+struct Job {
+  JobFn func;
+  Counter* counter;
+};
+
+struct CounterAccess {
+  static fn increment(Counter& counter) -> void {
+    counter._count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Returns the jobs that were waiting on it if it reached zero
+  static fn decrement(Counter& counter, Vec<Job*>& ready) -> void {
+    u32 count = counter._count.load(std::memory_order_relaxed);
+    while (count > 1) {
+      if (counter._count.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel,
+                                               std::memory_order_relaxed)) {
+        return;
+      }
+    }
+    // Hitting zero happens under the lock, see sync()
+    std::scoped_lock lock{counter._lock};
+    if (counter._count.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    ready.insert(ready.end(), counter._waiters.begin(), counter._waiters.end());
+    counter._waiters.clear();
+  }
+
+  // Waits for whoever brought the counter to zero to let go of it, so it can be destroyed
+  static fn sync(Counter& counter) -> void {
+    std::scoped_lock lock{counter._lock};
+  }
+
+  // False if the counter is already at zero, the job can run right away
+  static fn add_waiter(Counter& counter, Job* job) -> bool {
+    std::scoped_lock lock{counter._lock};
+    if (counter._count.load(std::memory_order_acquire) == 0) {
+      return false;
+    }
+    counter._waiters.push_back(job);
+    return true;
+  }
+};
+
+namespace {
+
+// Chase-Lev deque, the owner pushes and pops at the bottom and everyone else steals from the top
+class WorkDeque {
+public:
+  static constexpr i64 CAPACITY = 4096;
+
+public:
+  WorkDeque() noexcept : _top(0), _bottom(0), _jobs() {}
+
+public:
+  fn push(Job* job) -> bool {
+    const i64 bottom = _bottom.load(std::memory_order_relaxed);
+    const i64 top = _top.load(std::memory_order_acquire);
+    if (bottom - top >= CAPACITY) {
+      return false;
+    }
+    _jobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  fn pop() -> Job* {
+    const i64 bottom = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    i64 top = _top.load(std::memory_order_relaxed);
+    if (top > bottom) {
+      _bottom.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Job* job = _jobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+      // Last one, race the thieves for it
+      if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        job = nullptr;
+      }
+      _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  fn steal() -> Job* {
+    i64 top = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const i64 bottom = _bottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+      return nullptr;
+    }
+    Job* job = _jobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return job;
+  }
+
+private:
+  alignas(64) std::atomic<i64> _top;
+  alignas(64) std::atomic<i64> _bottom;
+  std::array<std::atomic<Job*>, CAPACITY> _jobs;
+};
+
+// Jobs coming from threads without a deque, or from a full deque
+class SharedQueue {
+public:
+  fn push(Job* job) -> void {
+    std::scoped_lock lock{_lock};
+    _jobs.push_back(job);
+    _size.store(_jobs.size(), std::memory_order_release);
+  }
+
+  fn pop() -> Job* {
+    if (!_size.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    std::scoped_lock lock{_lock};
+    if (_jobs.empty()) {
+      return nullptr;
+    }
+    Job* job = _jobs.front();
+    _jobs.pop_front();
+    _size.store(_jobs.size(), std::memory_order_release);
+    return job;
+  }
+
+private:
+  std::mutex _lock;
+  Deque<Job*> _jobs;
+  std::atomic<size_t> _size{0};
+};
+
+struct Scheduler {
+  std::unique_ptr<WorkDeque[]> deques; // One per thread, 0 is the render thread
+  Vec<std::thread> workers;
+  SharedQueue shared;
+  SharedQueue render; // Pinned to the render thread
+  std::atomic<u32> epoch{0};
+  std::atomic<u32> sleepers{0};
+  std::atomic<bool> running{false};
+  u32 thread_count{1};
+};
+
+Scheduler scheduler;
+
+// Index into the scheduler deques, or thread_count for threads that don't have one
+thread_local u32 t_thread_index = UINT32_MAX;
+
+fn local_index() -> u32 {
+  return t_thread_index < scheduler.thread_count ? t_thread_index : scheduler.thread_count;
+}
+
+fn wake_workers() -> void {
+  scheduler.epoch.fetch_add(1, std::memory_order_seq_cst);
+  if (scheduler.sleepers.load(std::memory_order_seq_cst)) {
+    scheduler.epoch.notify_all();
+  }
+}
+
+fn schedule(Job* job) -> void {
+  const u32 idx = local_index();
+  if (idx == scheduler.thread_count || !scheduler.deques[idx].push(job)) {
+    scheduler.shared.push(job);
+  }
+  wake_workers();
+}
+
+fn execute(Job* job) -> void {
+  {
+    KA_PROFILE_ZONE("job");
+    job->func();
+  }
+  if (job->counter) {
+    Vec<Job*> ready;
+    CounterAccess::decrement(*job->counter, ready);
+    for (Job* next : ready) {
+      if (scheduler.running.load(std::memory_order_acquire)) {
+        schedule(next);
+      } else {
+        execute(next);
+      }
+    }
+  }
+  delete job;
+}
+
+fn find_job(u32 idx, std::minstd_rand& rng) -> Job* {
+  if (idx < scheduler.thread_count) {
+    if (Job* job = scheduler.deques[idx].pop()) {
+      return job;
+    }
+  }
+  if (Job* job = scheduler.shared.pop()) {
+    return job;
+  }
+  // Start somewhere random so thieves don't all pile on the same deque
+  const u32 count = scheduler.thread_count;
+  const u32 start = rng() % count;
+  for (u32 i = 0; i < count; ++i) {
+    const u32 victim = (start + i) % count;
+    if (victim == idx) {
+      continue;
+    }
+    if (Job* job = scheduler.deques[victim].steal()) {
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+fn worker_loop(u32 idx) -> void {
+  t_thread_index = idx;
+  KA_PROFILE_THREAD_NAME(buffer_str_fmt<32>("worker {}", idx).c_str());
+  std::minstd_rand rng(idx);
+  while (scheduler.running.load(std::memory_order_acquire)) {
+    if (Job* job = find_job(idx, rng)) {
+      execute(job);
+      continue;
+    }
+    // Anything pushed after reading the epoch changes it, so the wait can't miss it
+    const u32 epoch = scheduler.epoch.load(std::memory_order_seq_cst);
+    if (Job* job = find_job(idx, rng)) {
+      execute(job);
+      continue;
+    }
+    scheduler.sleepers.fetch_add(1, std::memory_order_seq_cst);
+    scheduler.epoch.wait(epoch, std::memory_order_seq_cst);
+    scheduler.sleepers.fetch_sub(1, std::memory_order_seq_cst);
+  }
+}
+
+fn make_job(JobFn func, Counter* counter) -> Job* {
+  if (counter) {
+    CounterAccess::increment(*counter);
+  }
+  return new Job{func, counter};
+}
+
+} // namespace
+
+fn initialize(u32 worker_count) -> void {
+  ka_assert(!scheduler.running.load(), "Job system already initialized");
+  if (!worker_count) {
+    worker_count = std::max(1u, std::thread::hardware_concurrency()) - 1;
+  }
+  scheduler.thread_count = worker_count + 1;
+  scheduler.deques = std::make_unique<WorkDeque[]>(scheduler.thread_count);
+  scheduler.running.store(true, std::memory_order_release);
+  t_thread_index = 0;
+  scheduler.workers.reserve(worker_count);
+  for (u32 i = 1; i <= worker_count; ++i) {
+    scheduler.workers.emplace_back(worker_loop, i);
+  }
+  KA_LOG(debug, " Job system started with {} workers", worker_count);
+}
+
+fn shutdown() -> void {
+  if (!scheduler.running.exchange(false, std::memory_order_acq_rel)) {
+    return;
+  }
+  scheduler.epoch.fetch_add(1, std::memory_order_seq_cst);
+  scheduler.epoch.notify_all();
+  for (auto& worker : scheduler.workers) {
+    worker.join();
+  }
+  scheduler.workers.clear();
+
+  // Whatever is still queued runs here, otherwise its counter never reaches zero and it would
+  // run after the next initialize() with stale captures. No other thread touches the queues now
+  for (;;) {
+    Job* job = scheduler.shared.pop();
+    if (!job) {
+      job = scheduler.render.pop();
+    }
+    for (u32 i = 0; !job && i < scheduler.thread_count; ++i) {
+      job = scheduler.deques[i].steal();
+    }
+    if (!job) {
+      break;
+    }
+    execute(job);
+  }
+  scheduler.deques.reset();
+  scheduler.thread_count = 1;
+  t_thread_index = UINT32_MAX;
+}
+
+fn is_running() -> bool {
+  return scheduler.running.load(std::memory_order_acquire);
+}
+
+fn thread_count() -> u32 {
+  return scheduler.thread_count;
+}
+
+fn thread_index() -> u32 {
+  return local_index();
+}
+
+fn run(JobFn func, Counter* counter) -> void {
+  if (!is_running()) {
+    // No workers, just do it here
+    func();
+    return;
+  }
+  schedule(make_job(func, counter));
+}
+
+fn run_after(Counter& deps, JobFn func, Counter* counter) -> void {
+  Job* job = make_job(func, counter);
+  if (!CounterAccess::add_waiter(deps, job)) {
+    if (!is_running()) {
+      execute(job);
+      return;
+    }
+    schedule(job);
+  }
+}
+
+fn run_on_render(JobFn func, Counter* counter) -> void {
+  scheduler.render.push(make_job(func, counter));
+}
+
+fn pump_render() -> u32 {
+  ka_assert(t_thread_index == 0 || !is_running(), "Not in the render thread");
+  u32 count = 0;
+  while (Job* job = scheduler.render.pop()) {
+    execute(job);
+    ++count;
+  }
+  return count;
+}
+
+fn wait(Counter& counter) -> void {
+  const u32 idx = local_index();
+  std::minstd_rand rng(idx);
+  while (!counter.done()) {
+    if (idx == 0 || !is_running()) {
+      pump_render();
+    }
+    if (Job* job = is_running() ? find_job(idx, rng) : nullptr) {
+      execute(job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  CounterAccess::sync(counter);
+}
+
+} // namespace kappa::jobs
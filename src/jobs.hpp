@@ -0,0 +1,109 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <atomic>
+#include <mutex>
+
+namespace kappa::jobs {
+
+// Captures have to be trivially copyable, pass pointers to anything bigger
+using JobFn = TrivFn<void(), 6 * sizeof(void*), 8>;
+
+struct Job;
+
+// Counts unfinished jobs. Jobs scheduled with run_after wait for it to reach zero, and waiting on
+// it keeps the waiting thread busy with other jobs
+class Counter {
+public:
+  Counter() noexcept : _count(0), _lock(), _waiters() {}
+
+  Counter(const Counter&) = delete;
+  Counter& operator=(const Counter&) = delete;
+
+public:
+  fn value() const -> u32 { return _count.load(std::memory_order_acquire); }
+
+  fn done() const -> bool { return value() == 0; }
+
+private:
+  friend struct CounterAccess;
+
+  std::atomic<u32> _count;
+  std::mutex _lock;
+  Vec<Job*> _waiters;
+};
+
+// Starts worker_count threads (one less than the core count if zero). The calling thread becomes
+// the render thread, and can still run jobs while waiting
+fn initialize(u32 worker_count = 0) -> void;
+
+// Stops the workers, then runs the jobs still queued on the calling thread. Anything they
+// schedule runs right away, like run() does without workers
+fn shutdown() -> void;
+
+fn is_running() -> bool;
+
+// Workers plus the render thread
+fn thread_count() -> u32;
+
+// Between 0 and thread_count(), 0 is the render thread. Any other thread gets thread_count()
+fn thread_index() -> u32;
+
+fn run(JobFn func, Counter* counter = nullptr) -> void;
+
+// Queued once deps reaches zero
+fn run_after(Counter& deps, JobFn func, Counter* counter = nullptr) -> void;
+
+// Only ever runs on the render thread, from pump_render() or while it waits
+fn run_on_render(JobFn func, Counter* counter = nullptr) -> void;
+
+// Runs the pending render thread jobs, returns how many ran
+fn pump_render() -> u32;
+
+// Runs other jobs until the counter reaches zero
+fn wait(Counter& counter) -> void;
+
+// Splits [0, count) in chunks of at least grain elements, calls func(begin, end) on each of
+// them and waits for all of them to finish
+template<typename F>
+requires(std::invocable<F&, size_t, size_t>)
+fn parallel_for(size_t count, size_t grain, F&& func) -> void {
+  if (!count) {
+    return;
+  }
+  // A few chunks per thread so stealing can even things out
+  const size_t chunks = std::max<size_t>(1, thread_count() * 4);
+  const size_t chunk = std::max<size_t>(std::max<size_t>(grain, 1), (count + chunks - 1) / chunks);
+  if (chunk >= count || !is_running()) {
+    func(size_t{0}, count);
+    return;
+  }
+
+  Counter counter;
+  auto* func_ptr = &func;
+  for (size_t begin = chunk; begin < count; begin += chunk) {
+    const size_t end = std::min(count, begin + chunk);
+    run(
+      [func_ptr, begin, end]() {
+        (*func_ptr)(begin, end);
+      },
+      &counter);
+  }
+  // Take the first chunk ourselves instead of just waiting
+  func(size_t{0}, chunk);
+  wait(counter);
+}
+
+template<typename T, typename F>
+requires(std::invocable<F&, T&>)
+fn parallel_for(Span<T> items, F&& func, size_t grain = 1) -> void {
+  T* data = items.data();
+  parallel_for(items.size(), grain, [data, &func](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      func(data[i]);
+    }
+  });
+}
+
+} // namespace kappa::jobs
@@ -1,14 +1,34 @@
+#include "assets/cache.hpp"
 #include "assets/model.hpp"
+#include "jobs.hpp"
+#include "profiler.hpp"
 #include "render/context.hpp"
 #include "render/glfw.hpp"
 #include "render/scene.hpp"
 
+#include <chrono>
+#include <cstring>
+
 namespace {
 
 using namespace kappa;
 
 constexpr u32 WINDOW_WIDTH = 1280;
 constexpr u32 WINDOW_HEIGHT = 720;
+constexpr u32 HEADLESS_FRAMES = 1000;
+constexpr u32 HEADLESS_WARMUP = 60; // Uploads and pipelines settle in before timing anything
+
+// --headless [frames] renders without a window and logs the frame rate, zero runs windowed
+fn headless_frames() -> u32 {
+  for (int i = 1; i < g_argc; ++i) {
+    if (std::strcmp(g_argv[i], "--headless") != 0) {
+      continue;
+    }
+    const u32 frames = i + 1 < g_argc ? (u32)std::strtoul(g_argv[i + 1], nullptr, 10) : 0;
+    return frames ? frames : HEADLESS_FRAMES;
+  }
+  return 0;
+}
 
 fn extract_model_data(const assets::Model3DData& model) -> render::SceneData::MeshData {
   const auto& mesh = model.mesh_at(0);
@@ -37,6 +57,8 @@ fn extract_model_data(const assets::Model3DData& model) -> render::SceneData::Me
     .uvs = {uvs.data() + uv_start, uv_count},
     .tangents = {tangents.data() + tang_start, tang_count},
     .bitangents = {bitangents.data() + tang_start, tang_count},
+    .bbox_min = mesh.bbox_min,
+    .bbox_max = mesh.bbox_max,
   };
 }
 
@@ -51,21 +73,37 @@ public:
   fn on_fixed_update(u32 ups) -> void;
 
 private:
+  fn run_headless() -> void;
+
+private:
+  u32 _headless_frames;
   TypeBuffer<render::GLFWContext> _glfw;
   TypeBuffer<render::RenderContext> _renderer;
   TypeBuffer<render::SceneData> _scene;
 };
 
-KappaContext::KappaContext() {
-  render::GLFWContext::initialize(_glfw, WINDOW_WIDTH, WINDOW_HEIGHT);
-  render::RenderContext::initialize(_renderer, *_glfw);
+KappaContext::KappaContext() : _headless_frames(headless_frames()) {
+  KA_PROFILE_THREAD_NAME("render");
+  jobs::initialize();
+  assets::cache::initialize(KA_CACHE_DIR "/assets");
+  if (_headless_frames) {
+    render::RenderContext::initialize_headless(_renderer, {WINDOW_WIDTH, WINDOW_HEIGHT});
+  } else {
+    render::GLFWContext::initialize(_glfw, WINDOW_WIDTH, WINDOW_HEIGHT);
+    render::RenderContext::initialize(_renderer, *_glfw);
+  }
   render::SceneData::initialize(_scene, *_renderer);
 }
 
 KappaContext::~KappaContext() {
   _scene.destroy();
   _renderer.destroy();
-  _glfw.destroy();
+  if (!_headless_frames) {
+    _glfw.destroy();
+  }
+  // Cache writes run as jobs
+  assets::cache::shutdown();
+  jobs::shutdown();
 }
 
 fn KappaContext::start() -> void {
@@ -74,11 +112,50 @@ fn KappaContext::start() -> void {
     suzanne.destroy();
   };
   const auto model = extract_model_data(suzanne);
-  _scene->add_mesh(model, suzanne.name().as_view());
+  const auto mesh = _scene->add_mesh(model, suzanne.name().as_view());
+  _scene->add_instance(mesh, ran::Mat4f32::identity());
+
+  const auto pip_stats = _renderer->get_vk().pipeline_stats();
+  log_info(" Startup pipelines: {} compiled in {:.3f}ms ({} cache)", pip_stats.compiled,
+           pip_stats.compile_ms, pip_stats.warm_cache ? "warm" : "cold");
+  if (_headless_frames) {
+    run_headless();
+    return;
+  }
   render::render_loop<60>(*_glfw, *this);
 }
 
+fn KappaContext::run_headless() -> void {
+  using clock = std::chrono::steady_clock;
+  static constexpr f64 dt = 1. / 60.;
+  for (u32 i = 0; i < HEADLESS_WARMUP; ++i) {
+    on_render(dt, 0.);
+  }
+
+  u64 draws = 0;
+  u64 instances = 0;
+  const auto start = clock::now();
+  for (u32 i = 0; i < _headless_frames; ++i) {
+    KA_PROFILE_FRAME();
+    on_render(dt, 0.);
+    draws += _scene->draw_count();
+    instances += _scene->cull_stats().visible;
+  }
+  // Count the GPU work too, not just the recording
+  vkDeviceWaitIdle(_renderer->get_vk().device());
+  const f64 secs = std::chrono::duration<f64>(clock::now() - start).count();
+
+  log_info(" Headless: {} frames in {:.3f}s, {:.1f} frames/s ({:.3f}ms/frame)", _headless_frames,
+           secs, _headless_frames / secs, secs * 1e3 / _headless_frames);
+  log_info(" Headless: {:.0f} draws/s, {:.0f} instances/s", draws / secs, instances / secs);
+}
+
 fn KappaContext::on_render(f64 dt, f64 alpha) -> void {
+  // Vulkan side of whatever the workers finished loading
+  {
+    KA_PROFILE_ZONE("jobs::pump_render");
+    jobs::pump_render();
+  }
   _renderer->draw_things(*_scene, dt, alpha);
 }
 
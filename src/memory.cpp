@@ -0,0 +1,279 @@
+#include "./core.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace kappa {
+
+LinearArena::LinearArena() noexcept : LinearArena(DEFAULT_BLOCK_SIZE) {}
+
+LinearArena::LinearArena(size_t block_size) noexcept :
+    _first(nullptr), _current(nullptr), _block_size(block_size), _capacity(0) {}
+
+LinearArena::LinearArena(LinearArena&& other) noexcept :
+    _first(std::exchange(other._first, nullptr)), _current(std::exchange(other._current, nullptr)),
+    _block_size(other._block_size), _capacity(std::exchange(other._capacity, 0)) {}
+
+LinearArena& LinearArena::operator=(LinearArena&& other) noexcept {
+  if (this != &other) {
+    release();
+    _first = std::exchange(other._first, nullptr);
+    _current = std::exchange(other._current, nullptr);
+    _block_size = other._block_size;
+    _capacity = std::exchange(other._capacity, 0);
+  }
+  return *this;
+}
+
+LinearArena::~LinearArena() noexcept {
+  release();
+}
+
+fn LinearArena::release() -> void {
+  Block* block = _first;
+  while (block) {
+    Block* next = block->next;
+    mem_track_free(MemTag::frame_scratch, sizeof(Block) + block->size);
+    ::operator delete(block);
+    block = next;
+  }
+  _first = nullptr;
+  _current = nullptr;
+  _capacity = 0;
+}
+
+fn LinearArena::grow(size_t size, size_t align) -> void* {
+  // Padding for the worst case alignment, so the retry can't fail
+  const size_t needed = size + align;
+  if (_current && _current->next && _current->next->size >= needed) {
+    // Left over from a rewind
+    _current = _current->next;
+    _current->offset = 0;
+    return allocate(size, align);
+  }
+
+  const size_t block_size = std::max(_block_size, needed);
+  auto* block = static_cast<Block*>(::operator new(sizeof(Block) + block_size));
+  mem_track_alloc(MemTag::frame_scratch, sizeof(Block) + block_size);
+  block->size = block_size;
+  block->offset = 0;
+  if (_current) {
+    block->next = _current->next;
+    _current->next = block;
+  } else {
+    block->next = nullptr;
+    _first = block;
+  }
+  _current = block;
+  _capacity += block_size;
+  return allocate(size, align);
+}
+
+fn LinearArena::reset() -> void {
+  if (_first && _first->next) {
+    // Needed more than one block, replace them with one big enough for all of it
+    const size_t capacity = _capacity;
+    release();
+    _first = static_cast<Block*>(::operator new(sizeof(Block) + capacity));
+    mem_track_alloc(MemTag::frame_scratch, sizeof(Block) + capacity);
+    _first->next = nullptr;
+    _first->size = capacity;
+    _capacity = capacity;
+  }
+  if (_first) {
+    _first->offset = 0;
+  }
+  _current = _first;
+}
+
+fn LinearArena::rewind(Marker marker) -> void {
+  if (!marker.block) {
+    // Taken before anything was allocated
+    _current = _first;
+    if (_current) {
+      _current->offset = 0;
+    }
+    return;
+  }
+  _current = marker.block;
+  _current->offset = marker.offset;
+}
+
+fn LinearArena::used() const -> size_t {
+  size_t used = 0;
+  for (Block* block = _first; block; block = block->next) {
+    used += block->offset;
+    if (block == _current) {
+      break;
+    }
+  }
+  return used;
+}
+
+namespace {
+
+thread_local u32 t_scratch_depth = 0;
+
+} // namespace
+
+fn scratch_arena() -> LinearArena& {
+  thread_local LinearArena arena;
+  return arena;
+}
+
+ScratchScope::ScratchScope() noexcept : _arena(&scratch_arena()), _marker(_arena->marker()) {
+  ++t_scratch_depth;
+}
+
+ScratchScope::~ScratchScope() noexcept {
+  // The outermost scope gets to merge the blocks, nobody else can be holding a marker then
+  if (--t_scratch_depth == 0) {
+    _arena->reset();
+  } else {
+    _arena->rewind(_marker);
+  }
+}
+
+#if KA_ALLOC_STATS
+namespace {
+
+std::atomic<u64> alloc_count{0};
+std::atomic<u64> alloc_bytes{0};
+
+fn count_alloc(size_t size) -> void {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+} // namespace
+
+fn alloc_stats() -> AllocStats {
+  return {alloc_count.load(std::memory_order_relaxed),
+          alloc_bytes.load(std::memory_order_relaxed)};
+}
+#else
+fn alloc_stats() -> AllocStats {
+  return {0, 0};
+}
+#endif
+
+namespace {
+
+constexpr const char* mem_tag_names[] = {
+  "models", "textures", "vulkan-host", "physics", "frame-scratch",
+};
+static_assert(std::size(mem_tag_names) == (size_t)MemTag::count);
+
+#if KA_ALLOC_STATS
+struct TagCounters {
+  std::atomic<u64> current{0};
+  std::atomic<u64> peak{0};
+  std::atomic<u64> count{0};
+  std::atomic<u64> total{0};
+};
+
+TagCounters tag_counters[(size_t)MemTag::count];
+#endif
+
+} // namespace
+
+fn mem_tag_name(MemTag tag) -> const char* {
+  ka_assert(tag < MemTag::count);
+  return mem_tag_names[(size_t)tag];
+}
+
+#if KA_ALLOC_STATS
+fn mem_tag_stats(MemTag tag) -> MemTagStats {
+  ka_assert(tag < MemTag::count);
+  const auto& counters = tag_counters[(size_t)tag];
+  return {counters.current.load(std::memory_order_relaxed),
+          counters.peak.load(std::memory_order_relaxed),
+          counters.count.load(std::memory_order_relaxed),
+          counters.total.load(std::memory_order_relaxed)};
+}
+
+fn mem_track_alloc(MemTag tag, size_t size) -> void {
+  auto& counters = tag_counters[(size_t)tag];
+  const u64 current = counters.current.fetch_add(size, std::memory_order_relaxed) + size;
+  u64 peak = counters.peak.load(std::memory_order_relaxed);
+  while (peak < current &&
+         !counters.peak.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {}
+  counters.count.fetch_add(1, std::memory_order_relaxed);
+  counters.total.fetch_add(1, std::memory_order_relaxed);
+}
+
+fn mem_track_free(MemTag tag, size_t size) -> void {
+  auto& counters = tag_counters[(size_t)tag];
+  counters.current.fetch_sub(size, std::memory_order_relaxed);
+  counters.count.fetch_sub(1, std::memory_order_relaxed);
+}
+#else
+fn mem_tag_stats(MemTag) -> MemTagStats {
+  return {0, 0, 0, 0};
+}
+
+fn mem_track_alloc(MemTag, size_t) -> void {}
+
+fn mem_track_free(MemTag, size_t) -> void {}
+#endif
+
+fn tagged_alloc(MemTag tag, size_t size, size_t align) -> void* {
+  void* ptr = align > __STDCPP_DEFAULT_NEW_ALIGNMENT__
+              ? ::operator new(size, std::align_val_t{align})
+              : ::operator new(size);
+  mem_track_alloc(tag, size);
+  return ptr;
+}
+
+fn tagged_free(MemTag tag, void* ptr, size_t size, size_t align) noexcept -> void {
+  if (!ptr) {
+    return;
+  }
+  mem_track_free(tag, size);
+  if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    ::operator delete(ptr, std::align_val_t{align});
+  } else {
+    ::operator delete(ptr);
+  }
+}
+
+} // namespace kappa
+
+#if KA_ALLOC_STATS
+// Same as the default ones plus a counter, the array and nothrow versions call into these. Keep
+// them out of files that allocate, GCC inlines them and then warns about new paired with free
+void* operator new(std::size_t size) {
+  kappa::count_alloc(size);
+  if (void* ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+  kappa::count_alloc(size);
+  const std::size_t alignment = std::max(sizeof(void*), (std::size_t)align);
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, alignment, size ? size : 1) == 0) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+#endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core.hpp"
+#include "profiler.hpp"
 
 #include <ranmath/ran.hpp>
 
@@ -92,6 +93,7 @@ public:
   template<typename F>
   requires(std::is_invocable_r_v<ParticleEntity&, F, u64, u32>)
   void update_forces(real dt, F&& func) {
+    KA_PROFILE_ZONE("ParticleForceRegistry::update_forces");
     for (auto& elem : _registry) {
       if (!elem.has_value()) {
         continue;
@@ -106,8 +108,11 @@ private:
   u32 _add_force(u64 particle, u32 tag, GeneratorFunc generator);
 
 private:
-  std::vector<Nullable<force_entry>> _registry;
-  std::queue<u32> _free;
+  template<typename T>
+  using PhysicsAlloc = TaggedAllocator<T, MemTag::physics>;
+
+  std::vector<Nullable<force_entry>, PhysicsAlloc<Nullable<force_entry>>> _registry;
+  std::queue<u32, std::deque<u32, PhysicsAlloc<u32>>> _free;
 };
 
 static constexpr ran::Vec3f32 DEFAULT_GRAVITY{0.f, -9.81f, 0.f};
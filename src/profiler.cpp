@@ -0,0 +1,246 @@
+#include "./profiler.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+namespace kappa::profiler {
+
+namespace {
+
+constexpr u64 ZONE_CAPACITY = 1u << 15; // Per thread, has to be a power of two
+constexpr u32 FRAME_HISTORY = 1024;
+
+struct ZoneSlot {
+  std::atomic<const char*> name;
+  std::atomic<u64> begin;
+  std::atomic<u64> end;
+};
+
+struct ZoneRecord {
+  const char* name;
+  u64 begin;
+  u64 end;
+};
+
+// Ring of zones only written by its own thread. Dumps copy it and drop whatever got rewritten
+// while they were at it, which _started tells them about
+class ThreadBuffer {
+public:
+  explicit ThreadBuffer(u32 tid) : _started(0), _head(0), _tid(tid), _name() {
+    _name.copy_from("thread");
+  }
+
+public:
+  fn push(const char* name, u64 begin, u64 end) -> void {
+    const u64 head = _head.load(std::memory_order_relaxed);
+    _started.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    auto& slot = _slots[head & (ZONE_CAPACITY - 1)];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.begin.store(begin, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    _head.store(head + 1, std::memory_order_release);
+  }
+
+  // Appends the zones that ended after since
+  fn copy(Vec<ZoneRecord>& out, u64 since) const -> void {
+    const u64 head = _head.load(std::memory_order_acquire);
+    const u64 first = head > ZONE_CAPACITY ? head - ZONE_CAPACITY : 0;
+    const size_t start = out.size();
+    for (u64 i = first; i < head; ++i) {
+      const auto& slot = _slots[i & (ZONE_CAPACITY - 1)];
+      out.push_back({slot.name.load(std::memory_order_relaxed),
+                     slot.begin.load(std::memory_order_relaxed),
+                     slot.end.load(std::memory_order_relaxed)});
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const u64 started = _started.load(std::memory_order_relaxed);
+    const u64 valid = started > ZONE_CAPACITY ? started - ZONE_CAPACITY : 0;
+
+    size_t count = start;
+    for (u64 i = first; i < head; ++i) {
+      const auto& zone = out[start + (i - first)];
+      if (i >= valid && zone.end >= since) {
+        out[count++] = zone;
+      }
+    }
+    out.resize(count);
+  }
+
+  fn tid() const -> u32 { return _tid; }
+
+  // Registry lock only
+  fn name() -> BuffStr<32>& { return _name; }
+
+private:
+  std::atomic<u64> _started;
+  std::atomic<u64> _head;
+  u32 _tid;
+  BuffStr<32> _name;
+  std::array<ZoneSlot, ZONE_CAPACITY> _slots;
+};
+
+struct Registry {
+  std::mutex lock;
+  Vec<ThreadBuffer*> threads;
+  std::atomic<u32> dump_request{0}; // Frame count plus one, zero if there's nothing to do
+
+  // Frame markers, only touched from the render loop
+  std::array<u64, FRAME_HISTORY> frames{};
+  u64 frame_count{0};
+};
+
+fn registry() -> Registry& {
+  // Never destroyed, threads can still be recording during static destruction
+  static Registry* instance = new Registry();
+  return *instance;
+}
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+
+fn thread_buffer() -> ThreadBuffer& {
+  if (!t_buffer) {
+    auto& reg = registry();
+    std::scoped_lock lock{reg.lock};
+    t_buffer = new ThreadBuffer((u32)reg.threads.size() + 1);
+    reg.threads.push_back(t_buffer);
+  }
+  return *t_buffer;
+}
+
+fn write_escaped(fmt::memory_buffer& out, std::string_view str) -> void {
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+    }
+    out.push_back(c);
+  }
+}
+
+} // namespace
+
+fn now() -> u64 {
+  using namespace std::chrono;
+  return (u64)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+fn record_zone(const char* name, u64 begin, u64 end) -> void {
+  thread_buffer().push(name, begin, end);
+}
+
+fn record_gpu_zone(const char* name, u64 begin, u64 end) -> void {
+  static ThreadBuffer* gpu_buffer = []() {
+    auto& reg = registry();
+    std::scoped_lock lock{reg.lock};
+    auto* buffer = new ThreadBuffer((u32)reg.threads.size() + 1);
+    buffer->name().copy_from("GPU");
+    reg.threads.push_back(buffer);
+    return buffer;
+  }();
+  gpu_buffer->push(name, begin, end);
+}
+
+fn set_thread_name(const char* name) -> void {
+  auto& buffer = thread_buffer();
+  std::scoped_lock lock{registry().lock};
+  buffer.name().copy_from(name);
+}
+
+fn mark_frame() -> void {
+  auto& reg = registry();
+  reg.frames[reg.frame_count % FRAME_HISTORY] = now();
+  ++reg.frame_count;
+
+  if (const u32 request = reg.dump_request.exchange(0, std::memory_order_acq_rel)) {
+    const auto path = buffer_str_fmt<64>("kappa_trace_{}.json", reg.frame_count);
+    dump_trace(path.c_str(), request - 1);
+  }
+}
+
+fn request_dump(u32 frame_count) -> void {
+  registry().dump_request.store(frame_count + 1, std::memory_order_release);
+}
+
+fn dump_trace(const char* path, u32 frame_count) -> bool {
+  KA_PROFILE_ZONE("profiler::dump_trace");
+  auto& reg = registry();
+
+  // The newest marker is the start of a frame that hasn't happened yet
+  u64 since = 0;
+  u64 first_frame = reg.frame_count > FRAME_HISTORY ? reg.frame_count - FRAME_HISTORY : 0;
+  if (frame_count) {
+    frame_count = std::min(frame_count, FRAME_HISTORY - 1);
+    if (reg.frame_count > frame_count) {
+      first_frame = reg.frame_count - 1 - frame_count;
+      since = reg.frames[first_frame % FRAME_HISTORY];
+    }
+  }
+
+  std::FILE* file = std::fopen(path, "wb");
+  if (!file) {
+    KA_LOG(warn, " Failed to open trace file \"{}\"", path);
+    return false;
+  }
+
+  fmt::memory_buffer out;
+  const auto inserter = std::back_inserter(out);
+  bool first_event = true;
+  const fn begin_event = [&]() {
+    fmt::format_to(inserter, "{}\n{{", first_event ? "" : ",");
+    first_event = false;
+  };
+  fmt::format_to(inserter, "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  size_t zone_count = 0;
+  {
+    std::scoped_lock lock{reg.lock};
+    Vec<ZoneRecord> zones;
+    zones.reserve(ZONE_CAPACITY);
+    for (ThreadBuffer* thread : reg.threads) {
+      begin_event();
+      fmt::format_to(inserter,
+                     "\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},"
+                     "\"args\":{{\"name\":\"",
+                     thread->tid());
+      write_escaped(out, thread->name().as_view());
+      fmt::format_to(inserter, "\"}}}}");
+
+      zones.clear();
+      thread->copy(zones, since);
+      zone_count += zones.size();
+      for (const auto& zone : zones) {
+        begin_event();
+        fmt::format_to(inserter, "\"name\":\"");
+        write_escaped(out, zone.name);
+        // Chrome wants microseconds
+        fmt::format_to(inserter,
+                       "\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                       thread->tid(), zone.begin / 1000., (zone.end - zone.begin) / 1000.);
+      }
+    }
+  }
+
+  for (u64 i = first_frame; i < reg.frame_count; ++i) {
+    begin_event();
+    fmt::format_to(inserter,
+                   "\"name\":\"frame {}\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,"
+                   "\"ts\":{:.3f}}}",
+                   i, reg.frames[i % FRAME_HISTORY] / 1000.);
+  }
+  fmt::format_to(inserter, "\n]}}\n");
+
+  const bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+  std::fclose(file);
+  if (!ok) {
+    KA_LOG(warn, " Failed to write trace file \"{}\"", path);
+    return false;
+  }
+  KA_LOG(info, " Wrote {} zones from {} frames to \"{}\"", zone_count,
+         reg.frame_count - first_frame, path);
+  return true;
+}
+
+} // namespace kappa::profiler
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "core.hpp"
+
+// 0 compiles every zone and frame marker out
+#ifndef KA_PROFILE
+#define KA_PROFILE 1
+#endif
+
+#define KA_PROFILE_CONCAT_(_a, _b) _a##_b
+#define KA_PROFILE_CONCAT(_a, _b)  KA_PROFILE_CONCAT_(_a, _b)
+
+#if KA_PROFILE
+// Times the rest of the enclosing scope, the name has to outlive the program (a literal)
+#define KA_PROFILE_ZONE(_name) \
+  const ::kappa::profiler::Zone KA_PROFILE_CONCAT(_ka_profile_zone_, __LINE__)(_name)
+#define KA_PROFILE_FRAME()            ::kappa::profiler::mark_frame()
+#define KA_PROFILE_THREAD_NAME(_name) ::kappa::profiler::set_thread_name(_name)
+#else
+#define KA_PROFILE_ZONE(_name)        ((void)0)
+#define KA_PROFILE_FRAME()            ((void)0)
+#define KA_PROFILE_THREAD_NAME(_name) ((void)0)
+#endif
+
+namespace kappa::profiler {
+
+// Steady clock nanoseconds
+fn now() -> u64;
+
+// Appends to the calling thread's ring buffer, never locks. Old zones get overwritten
+fn record_zone(const char* name, u64 begin, u64 end) -> void;
+
+// Same, but on a separate "GPU" track. Only one thread should be feeding it
+fn record_gpu_zone(const char* name, u64 begin, u64 end) -> void;
+
+fn set_thread_name(const char* name) -> void;
+
+// Called once per frame from the render loop, also writes out pending dumps
+fn mark_frame() -> void;
+
+// Writes the zones of the last frame_count frames as Chrome trace JSON (chrome://tracing or
+// Perfetto). Zero writes everything still buffered, startup included. Only call it from the
+// thread that marks frames
+fn dump_trace(const char* path, u32 frame_count = 0) -> bool;
+
+// Same as dump_trace, from any thread. Happens on the next frame marker, into a file named
+// after the frame in the working directory
+fn request_dump(u32 frame_count) -> void;
+
+class Zone {
+public:
+  explicit Zone(const char* name) noexcept : _name(name), _begin(now()) {}
+
+  ~Zone() noexcept { record_zone(_name, _begin, now()); }
+
+  Zone(const Zone&) = delete;
+  Zone& operator=(const Zone&) = delete;
+
+private:
+  const char* _name;
+  u64 _begin;
+};
+
+} // namespace kappa::profiler
@@ -16,10 +16,13 @@ fn make_vk_defer(VkContext& vk) {
   };
 }
 
-fn make_imgui_defer(GLFWImGuiHandler& imgui) {
+fn make_imgui_defer(Optional<GLFWImGuiHandler>& imgui) {
   return [&]() {
+    if (!imgui) {
+      return; // Headless, never initialized
+    }
     vk_shutdown_imgui();
-    imgui.destroy();
+    imgui->destroy();
     ImGui::DestroyContext();
   };
 }
@@ -54,48 +57,29 @@ fn init_draw_target(VkContext& vk, VkDelQueue& delqueue, VkExtent2D surface_exte
   return {std::move(color), std::move(depth), surface_extent, 1.f};
 }
 
-fn upload_image_data(VkContext& vk, VkAllocImage& imag, const void* data) -> VkExpect<void> {
+fn upload_image_data(VkContext& vk, VkAllocImage& imag, const void* data)
+  -> VkExpect<VkUploadTicket> {
   ka_assert(data);
   const auto size = imag.extent();
   const size_t data_size = size.depth * size.width * size.height * 4;
-  const VkBufferArgs upload_args{
-    .size = data_size,
-    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-    .mem_usage = KA_VK_MEM_USAGE_CPU_TO_GPU,
-  };
-  auto upload_buff = VkAllocBuff::create(vk.allocator(), upload_args);
-  if (!upload_buff) {
-    return {unexpect, upload_buff.error()};
-  }
-  std::memcpy(upload_buff->mapped_data(), data, data_size);
-  const DeferFn buff_defer = [&]() {
-    vk_destroy_buffer(vk.allocator(), *upload_buff);
-  };
-  return vk_submit_immediate(vk, [&](VkCommandBuffer cmd) -> void {
-    auto layout = VK_IMAGE_LAYOUT_UNDEFINED;
-    layout =
-      vkcmd_transition_image(cmd, imag.image(), layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageExtent = size;
-
-    vkCmdCopyBufferToImage(cmd, upload_buff->buffer(), imag.image(),
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    layout =
-      vkcmd_transition_image(cmd, imag.image(), layout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  VkExpect<void> ret;
+  auto ticket = vk_submit_upload(vk, [&](VkUploadCmd& upload) -> void {
+    auto staging = upload.stage(data, data_size);
+    if (!staging) {
+      ret = {unexpect, staging.error()};
+      return;
+    }
+    upload.copy_buffer_to_image(staging->buffer, staging->offset, imag.image(), size);
   });
+  if (!ret) {
+    return {unexpect, ret.error()};
+  }
+  return ticket;
 }
 
 fn create_actual_image(VkContext& vk, const void* data, VkExtent3D size, VkFormat format,
-                       VkImageUsageFlags flags, VkImageMipsFlag mips) -> VkExpect<VkAllocImage> {
+                       VkImageUsageFlags flags, VkImageMipsFlag mips)
+  -> VkExpect<std::pair<VkAllocImage, VkUploadTicket>> {
   const VkImageArgs image_args{
     .extent = size,
     .format = format,
@@ -104,16 +88,17 @@ fn create_actual_image(VkContext& vk, const void* data, VkExtent3D size, VkForma
   };
   auto imag = VkAllocImage::create(vk.device(), vk.allocator(), image_args);
   if (!imag) {
-    return imag;
+    return {unexpect, imag.error()};
   }
   DeferFn on_err = [&]() {
     vk_destroy_image(vk.device(), vk.allocator(), *imag);
   };
+  VkUploadTicket upload = KA_VK_UPLOAD_NONE;
   if (data) {
-    upload_image_data(vk, *imag, data).value();
+    upload = upload_image_data(vk, *imag, data).value();
   }
   on_err.disengage();
-  return imag;
+  return {in_place, std::move(*imag), upload};
 }
 
 constexpr auto default_texture = []() {
@@ -130,11 +115,13 @@ constexpr auto default_texture = []() {
 
 fn init_images(VkContext& vk, VkDelQueue& delqueue)
   -> std::pair<VkAllocImage, RenderContext::SamplerArray> {
-  auto image = create_actual_image(vk, default_texture.data(), VkExtent3D(16, 16, 1),
-                                   VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT,
-                                   KA_VK_DISABLE_MIPMAPS)
-                 .value();
+  auto [image, upload] = create_actual_image(vk, default_texture.data(), VkExtent3D(16, 16, 1),
+                                             VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT,
+                                             KA_VK_DISABLE_MIPMAPS)
+                          .value();
   delqueue.enqueue(image, vk.device(), vk.allocator());
+  // Everything falls back to this one, it has to be there from the start
+  vk_upload_wait(vk, upload).value();
   RenderContext::SamplerArray samplers{};
   samplers[RenderContext::SAMPLER_LINEAR] =
     vk_create_sampler(vk.device(), VK_FILTER_LINEAR, VK_FILTER_LINEAR).value();
@@ -148,13 +135,15 @@ fn init_images(VkContext& vk, VkDelQueue& delqueue)
 
 } // namespace
 
-RenderContext::RenderContext(create_t, VkContext&& vk, GLFWImGuiHandler&& glfw_imgui,
+RenderContext::RenderContext(create_t, VkContext&& vk, Optional<GLFWImGuiHandler>&& glfw_imgui,
                              VkDelQueue&& delqueue, VkDynDescAlloc&& desc_alloc,
                              DrawTarget&& target, FrameData* frames, VkAllocImage&& default_image,
-                             SamplerArray&& samplers) :
+                             SamplerArray&& samplers, VkBindlessTable&& bindless) :
     _vk(std::move(vk)), _glfw_imgui(std::move(glfw_imgui)), _delqueue(std::move(delqueue)),
     _desc_alloc(std::move(desc_alloc)), _target(std::move(target)),
-    _images(std::move(default_image), std::move(samplers)), _frame_count(0) {
+    _images(std::move(default_image), std::move(samplers)), _bindless(std::move(bindless)),
+    _shaders(), _pipelines(), _frame_count(0), _alloc_count(alloc_stats().count),
+    _frame_allocs(0), _gpu_zones() {
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
     _frames.construct(i, std::move(frames[i]));
   }
@@ -174,20 +163,43 @@ fn RenderContext::initialize(TypeBufferRef<RenderContext> renderer, GLFWContext&
     .surface = {in_place, std::move(vk_surface)},
     .app_name = KA_APP_NAME,
     .app_ver = KA_APP_VERSION,
+    .cache_dir = KA_CACHE_DIR,
   };
+  initialize_with(renderer, vk_args, &glfw);
+}
+
+fn RenderContext::initialize_headless(TypeBufferRef<RenderContext> renderer, VkExtent2D extent)
+  -> void {
+  const VkContextArgs vk_args{
+    .surface = nullopt,
+    .app_name = KA_APP_NAME,
+    .app_ver = KA_APP_VERSION,
+    .cache_dir = KA_CACHE_DIR,
+    .headless_extent = extent,
+  };
+  initialize_with(renderer, vk_args, nullptr);
+}
+
+fn RenderContext::initialize_with(TypeBufferRef<RenderContext> renderer,
+                                  const VkContextArgs& vk_args, GLFWContext* glfw) -> void {
+  const VkExtent2D surface_extent =
+    vk_args.surface ? vk_args.surface->swapchain_extent : vk_args.headless_extent;
   auto vk = VkContext::create(vk_args).value();
   DeferFn vk_defer = make_vk_defer(vk);
 
-  auto glfw_imgui = glfw.make_imgui_handler();
-  fn imgui_initer = [&]() {
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO();
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard; // Enable Keyboard Controls
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;  // Enable Gamepad Controls
-    glfw_imgui.init();
-  };
-  vk_init_imgui(vk, imgui_initer).value();
+  Optional<GLFWImGuiHandler> glfw_imgui;
+  if (glfw) {
+    glfw_imgui.emplace(glfw->make_imgui_handler());
+    fn imgui_initer = [&]() {
+      IMGUI_CHECKVERSION();
+      ImGui::CreateContext();
+      ImGuiIO& io = ImGui::GetIO();
+      io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard; // Enable Keyboard Controls
+      io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;  // Enable Gamepad Controls
+      glfw_imgui->init();
+    };
+    vk_init_imgui(vk, imgui_initer).value();
+  }
   DeferFn imgui_defer = make_imgui_defer(glfw_imgui);
 
   VkDelQueue delqueue;
@@ -212,7 +224,8 @@ fn RenderContext::initialize(TypeBufferRef<RenderContext> renderer, GLFWContext&
   Span<const VkDescPoolRatio> frame_sizes_span(frame_sizes.data(), frame_sizes.size());
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
     auto alloc = VkDynDescAlloc::create(vk.device(), 1000, frame_sizes_span).value();
-    frames.construct(i, VkDelQueue(), std::move(alloc));
+    auto timer = VkGpuTimer::create(vk).value();
+    frames.construct(i, VkDelQueue(), std::move(alloc), std::move(timer), 0u);
   }
 
   VkDescriptorSetLayout scene_layout{};
@@ -226,13 +239,17 @@ fn RenderContext::initialize(TypeBufferRef<RenderContext> renderer, GLFWContext&
 
   auto [default_image, samplers] = init_images(vk, delqueue);
 
+  auto bindless = VkBindlessTable::create(vk, MAX_IMAGES).value();
+  bindless.add_to_delqueue(delqueue);
+  bindless.write_image((u32)DEFAULT_IMAGE, default_image.view(), samplers[SAMPLER_NEAREST]);
+
   delqueue_defer.disengage();
   imgui_defer.disengage();
   vk_defer.disengage();
 
   renderer->construct(create_t(), std::move(vk), std::move(glfw_imgui), std::move(delqueue),
                       std::move(desc_alloc), std::move(target), frames.data(),
-                      std::move(default_image), std::move(samplers));
+                      std::move(default_image), std::move(samplers), std::move(bindless));
 }
 
 RenderContext::~RenderContext() {
@@ -240,8 +257,18 @@ RenderContext::~RenderContext() {
     auto& frame = _frames[i];
     make_delqueue_defer(_vk, frame.delqueue)();
     frame.desc_alloc.destroy();
+    frame.gpu_timer.destroy();
     _frames.destroy(i);
   }
+  // The default image lives in the delqueue
+  const auto default_image = _images.images[(u32)DEFAULT_IMAGE].image.image();
+  _images.images.for_each([&](ImageEntry& entry) {
+    if (entry.image.image() != default_image) {
+      vk_destroy_image(_vk.device(), _vk.allocator(), entry.image);
+    }
+  });
+  _pipelines.destroy(_vk);
+  _shaders.destroy(_vk);
   make_delqueue_defer(_vk, _delqueue)();
   _desc_alloc.destroy();
   make_imgui_defer(_glfw_imgui)();
@@ -259,19 +286,52 @@ fn update_draw_target_extent(RenderContext::DrawTarget& target, VkExtent2D swapc
 
 } // namespace
 
+fn RenderContext::collect_gpu_zones(FrameData& frame) -> void {
+  // This frame's fence already signaled, so whatever it recorded last time is there
+  if (!frame.gpu_timer.collect()) {
+    return;
+  }
+  _gpu_zones = frame.gpu_timer.results();
+#if KA_PROFILE
+  // No clock calibration, line them up after the CPU finished recording
+  for (const auto& zone : _gpu_zones) {
+    profiler::record_gpu_zone(zone.name, frame.record_end + zone.begin,
+                              frame.record_end + zone.end);
+  }
+#endif
+}
+
 fn RenderContext::draw_things(IDrawAction& draw, f64 dt, f64 alpha) -> void {
+  KA_PROFILE_ZONE("RenderContext::draw_things");
   vk_draw_frame(_vk, [&](const VkFrameContext& frame) -> void {
+    const u64 alloc_count = alloc_stats().count;
+    _frame_allocs = alloc_count - _alloc_count;
+    _alloc_count = alloc_count;
+
+    // The fence already signaled, nothing on the GPU is using these anymore
     auto& ctx_frame = get_frame();
     ctx_frame.delqueue.flush();
     ctx_frame.desc_alloc.clear();
 
     const auto cmd = frame.cmd;
+    collect_gpu_zones(ctx_frame);
+    ctx_frame.gpu_timer.begin_frame(cmd);
     update_draw_target_extent(_target, frame.swapchain_extent);
 
     VkImageLayout target_layout = VK_IMAGE_LAYOUT_UNDEFINED; // Don't care about the older layout
 
     // Draw our things
-    draw.render_geometry(target_layout, cmd, dt, alpha);
+    {
+      KA_PROFILE_ZONE("render_geometry");
+      draw.render_geometry(target_layout, cmd, dt, alpha);
+    }
+
+    if (is_headless()) {
+      // Nothing to present, the frame ends up in the draw target
+      ctx_frame.record_end = profiler::now();
+      ++_frame_count;
+      return;
+    }
 
     // Prepare swapchain for copying
     target_layout = vkcmd_transition_image(cmd, _target.color.image(), target_layout,
@@ -281,8 +341,11 @@ fn RenderContext::draw_things(IDrawAction& draw, f64 dt, f64 alpha) -> void {
                                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
     // Do the copy
-    vkcmd_transfer_image(cmd, _target.color.image(), frame.swapchain_image, _target.extent,
-                         frame.swapchain_extent);
+    {
+      VkGpuZone gpu_zone(ctx_frame.gpu_timer, cmd, "blit");
+      vkcmd_transfer_image(cmd, _target.color.image(), frame.swapchain_image, _target.extent,
+                           frame.swapchain_extent);
+    }
 
     // Draw ImGui ontop of the swapchain image (not the render image!!!)
     sw_layout = vkcmd_transition_image(cmd, frame.swapchain_image, sw_layout,
@@ -290,7 +353,8 @@ fn RenderContext::draw_things(IDrawAction& draw, f64 dt, f64 alpha) -> void {
 
     // Draw imgui
     {
-      _glfw_imgui.new_frame();
+      KA_PROFILE_ZONE("imgui");
+      _glfw_imgui->new_frame();
       ImGui::NewFrame();
       draw.render_imgui(frame, dt, alpha);
       ImGui::Render();
@@ -299,6 +363,7 @@ fn RenderContext::draw_things(IDrawAction& draw, f64 dt, f64 alpha) -> void {
         vkmk_attach_info(frame.swapchain_view, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
       const auto render_info =
         vkmk_render_info(frame.swapchain_extent, &color_attachment, nullptr);
+      VkGpuZone gpu_zone(ctx_frame.gpu_timer, cmd, "imgui");
       vkCmdBeginRendering(cmd, &render_info);
       vk_draw_imgui(cmd, ImGui::GetDrawData());
       vkCmdEndRendering(cmd);
@@ -307,6 +372,7 @@ fn RenderContext::draw_things(IDrawAction& draw, f64 dt, f64 alpha) -> void {
     // Prepare swapchain image for presenting
     sw_layout = vkcmd_transition_image(cmd, frame.swapchain_image, sw_layout,
                                        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    ctx_frame.record_end = profiler::now();
     ++_frame_count;
   }).value();
 }
@@ -320,7 +386,12 @@ fn RenderContext::create_image(VkExtent3D size, VkFormat format, VkImageUsageFla
   if (!image) {
     return DEFAULT_IMAGE;
   }
-  auto slot = _images.images.emplace(std::move(*image));
+  auto& [alloc_image, upload] = *image;
+  auto slot = _images.images.emplace(std::move(alloc_image), upload);
+  if (flags & VK_IMAGE_USAGE_SAMPLED_BIT) {
+    _bindless.write_image((u32)slot, _images.images[slot].image.view(),
+                          get_sampler(SAMPLER_NEAREST));
+  }
   return (Image)slot;
 }
 
@@ -328,19 +399,39 @@ fn RenderContext::destroy_image(Image image) -> void {
   if ((u32)image == 0) {
     return;
   }
-  _images.images.remove((u32)image);
+  ka_assert(_images.images.has_element((u32)image));
+  // Called between frames, the last submitted one might still sample it. Keep the slot taken
+  // until that frame is done too, so it doesn't get rewritten under it
+  auto& frame = _frames[(_frame_count + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT];
+  frame.delqueue.enqueue_deleter([this, image]() {
+    auto& entry = _images.images[(u32)image];
+    // The frame fence doesn't cover the transfer queue, an upload might still be writing it
+    vk_upload_wait(_vk, entry.upload).value();
+    vk_destroy_image(_vk.device(), _vk.allocator(), entry.image);
+    _images.images.remove((u32)image);
+  });
 }
 
 fn RenderContext::submit_image_data(Image image, const void* data) -> void {
   if (!data || (u32)image == 0) {
     return;
   }
-  upload_image_data(_vk, get_image(image), data).value();
+  auto& entry = _images.images[(u32)image];
+  entry.upload = upload_image_data(_vk, entry.image, data).value();
 }
 
 fn RenderContext::get_image(Image image) -> VkAllocImage& {
   ka_assert(_images.images.has_element((u32)image));
-  return _images.images[(u32)image];
+  return _images.images[(u32)image].image;
+}
+
+fn RenderContext::is_image_ready(Image image) -> bool {
+  ka_assert(_images.images.has_element((u32)image));
+  return vk_upload_done(_vk, _images.images[(u32)image].upload);
+}
+
+fn RenderContext::get_image_index(Image image) -> u32 {
+  return is_image_ready(image) ? (u32)image : (u32)DEFAULT_IMAGE;
 }
 
 fn RenderContext::get_sampler(SamplerType type) -> VkSampler {
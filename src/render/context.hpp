@@ -4,6 +4,8 @@
 #include "render/vulkan/vk_context.hpp"
 #include "render/vulkan/vk_image.hpp"
 #include "render/vulkan/vk_pipeline.hpp"
+#include "render/vulkan/vk_query.hpp"
+#include "render/vulkan/vk_upload.hpp"
 #include "render/vulkan/vk_util.hpp"
 
 #include <ranmath/ran.hpp>
@@ -29,6 +31,8 @@ public:
   struct FrameData {
     VkDelQueue delqueue;
     VkDynDescAlloc desc_alloc;
+    VkGpuTimer gpu_timer;
+    u64 record_end; // Profiler time when recording finished, the GPU zones start after it
   };
 
   using FrameArray = TypeArrayBuffer<FrameData, MAX_FRAMES_IN_FLIGHT>;
@@ -44,31 +48,44 @@ public:
 
   using SamplerArray = std::array<VkSampler, SAMPLER_COUNT>;
 
+  struct ImageEntry {
+    VkAllocImage image;
+    VkUploadTicket upload;
+  };
+
   struct ImageData {
     ImageData(VkAllocImage&& image, SamplerArray&& samplers_) :
         samplers(std::move(samplers_)), images() {
-      images.emplace(std::move(image));
+      images.emplace(std::move(image), KA_VK_UPLOAD_NONE);
     }
 
     SamplerArray samplers;
-    FixedFreelist<VkAllocImage, MAX_IMAGES> images;
+    FixedFreelist<ImageEntry, MAX_IMAGES> images;
   };
 
 public:
-  RenderContext(create_t, VkContext&& vk, GLFWImGuiHandler&& glfw_imgui, VkDelQueue&& delqueue,
-                VkDynDescAlloc&& desc_alloc, DrawTarget&& target, FrameData* frames,
-                VkAllocImage&& default_image, SamplerArray&& samplers);
+  RenderContext(create_t, VkContext&& vk, Optional<GLFWImGuiHandler>&& glfw_imgui,
+                VkDelQueue&& delqueue, VkDynDescAlloc&& desc_alloc, DrawTarget&& target,
+                FrameData* frames, VkAllocImage&& default_image, SamplerArray&& samplers,
+                VkBindlessTable&& bindless);
   ~RenderContext();
 
 public:
   static fn initialize(TypeBufferRef<RenderContext> renderer, GLFWContext& glfw) -> void;
 
+  // No window, no swapchain and no ImGui. Frames only get rendered into the draw target
+  static fn initialize_headless(TypeBufferRef<RenderContext> renderer, VkExtent2D extent)
+    -> void;
+
 public:
   fn create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags flags, VkImageMipsFlag mips,
                   const void* data = nullptr) -> Image;
   fn destroy_image(Image image) -> void;
   fn submit_image_data(Image image, const void* data) -> void;
   fn get_image(Image image) -> VkAllocImage&;
+  fn is_image_ready(Image image) -> bool;
+  // Slot in the bindless table, the default image until the upload lands
+  fn get_image_index(Image image) -> u32;
   fn get_sampler(SamplerType type) -> VkSampler;
 
 public:
@@ -83,17 +100,50 @@ public:
 
   fn get_target() -> DrawTarget& { return _target; }
 
-  fn get_frame() -> FrameData& { return _frames[_frame_count % MAX_FRAMES_IN_FLIGHT]; }
+  fn get_frame() -> FrameData& { return _frames[get_frame_index()]; }
+
+  fn get_frame_index() const -> u32 { return _frame_count % MAX_FRAMES_IN_FLIGHT; }
+
+  fn get_frame_count() const -> u32 { return _frame_count; }
+
+  fn is_headless() const -> bool { return !_glfw_imgui.has_value(); }
+
+  // Heap allocations made between the last two frames, from any thread
+  fn get_frame_allocs() const -> u64 { return _frame_allocs; }
+
+  // Only valid while recording a frame
+  fn get_gpu_timer() -> VkGpuTimer& { return get_frame().gpu_timer; }
+
+  // The newest zones that came back from the GPU, a frame or two old
+  fn get_gpu_zones() const -> Span<const VkGpuZoneTime> { return _gpu_zones; }
+
+  fn get_shader_cache() -> VkShaderCache& { return _shaders; }
+
+  fn get_pipeline_cache() -> VkGfxPipelineCache& { return _pipelines; }
+
+  fn get_bindless() -> VkBindlessTable& { return _bindless; }
+
+private:
+  static fn initialize_with(TypeBufferRef<RenderContext> renderer, const VkContextArgs& vk_args,
+                            GLFWContext* glfw) -> void;
+
+  fn collect_gpu_zones(FrameData& frame) -> void;
 
 private:
   VkContext _vk;
-  GLFWImGuiHandler _glfw_imgui;
+  Optional<GLFWImGuiHandler> _glfw_imgui; // nullopt when headless
   VkDelQueue _delqueue;
   VkDynDescAlloc _desc_alloc;
   DrawTarget _target;
   ImageData _images;
+  VkBindlessTable _bindless;
+  VkShaderCache _shaders;
+  VkGfxPipelineCache _pipelines;
   FrameArray _frames;
   u32 _frame_count;
+  u64 _alloc_count;
+  u64 _frame_allocs;
+  Span<const VkGpuZoneTime> _gpu_zones;
 };
 
 } // namespace kappa::render
@@ -0,0 +1,247 @@
+#include "render/culling.hpp"
+
+#include <bit>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define KA_CULL_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define KA_CULL_SSE 1
+#endif
+
+namespace kappa::render {
+
+fn frustum_from_matrix(const ran::Mat4f32& view_proj) -> Frustum {
+  const f32* m = view_proj.data();
+  const fn row = [&](u32 i) -> ran::Vec4f32 {
+    return ran::Vec4f32(m[i], m[4 + i], m[8 + i], m[12 + i]);
+  };
+  const auto r0 = row(0);
+  const auto r1 = row(1);
+  const auto r2 = row(2);
+  const auto r3 = row(3);
+  const fn add = [](const ran::Vec4f32& a, const ran::Vec4f32& b) -> ran::Vec4f32 {
+    return ran::Vec4f32(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+  };
+  const fn sub = [](const ran::Vec4f32& a, const ran::Vec4f32& b) -> ran::Vec4f32 {
+    return ran::Vec4f32(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+  };
+
+  // Gribb & Hartmann, the near plane is just z >= 0 with a [0, 1] depth range
+  Frustum frustum;
+  frustum.planes[0] = add(r3, r0);
+  frustum.planes[1] = sub(r3, r0);
+  frustum.planes[2] = add(r3, r1);
+  frustum.planes[3] = sub(r3, r1);
+  frustum.planes[4] = r2;
+  frustum.planes[5] = sub(r3, r2);
+  return frustum;
+}
+
+fn AabbSoA::push(u32 id, const ran::Vec3f32& min, const ran::Vec3f32& max) -> u32 {
+  const u32 idx = size();
+  _min_x.push_back(min.x);
+  _min_y.push_back(min.y);
+  _min_z.push_back(min.z);
+  _max_x.push_back(max.x);
+  _max_y.push_back(max.y);
+  _max_z.push_back(max.z);
+  _ids.push_back(id);
+  return idx;
+}
+
+fn AabbSoA::set(u32 idx, const ran::Vec3f32& min, const ran::Vec3f32& max) -> void {
+  ka_assert(idx < size());
+  _min_x[idx] = min.x;
+  _min_y[idx] = min.y;
+  _min_z[idx] = min.z;
+  _max_x[idx] = max.x;
+  _max_y[idx] = max.y;
+  _max_z[idx] = max.z;
+}
+
+fn AabbSoA::set_transformed(u32 idx, const ran::Vec3f32& min, const ran::Vec3f32& max,
+                            const ran::Mat4f32& transform) -> void {
+  // Arvo, transform the center and grow the extents by the absolute rotation
+  const f32* m = transform.data();
+  const f32 center[3] = {(min.x + max.x) * .5f, (min.y + max.y) * .5f, (min.z + max.z) * .5f};
+  const f32 extent[3] = {(max.x - min.x) * .5f, (max.y - min.y) * .5f, (max.z - min.z) * .5f};
+  f32 out_center[3], out_extent[3];
+  for (u32 i = 0; i < 3; ++i) {
+    out_center[i] = m[12 + i];
+    out_extent[i] = 0.f;
+    for (u32 j = 0; j < 3; ++j) {
+      out_center[i] += m[j * 4 + i] * center[j];
+      out_extent[i] += std::fabs(m[j * 4 + i]) * extent[j];
+    }
+  }
+  set(idx,
+      ran::Vec3f32(out_center[0] - out_extent[0], out_center[1] - out_extent[1],
+                   out_center[2] - out_extent[2]),
+      ran::Vec3f32(out_center[0] + out_extent[0], out_center[1] + out_extent[1],
+                   out_center[2] + out_extent[2]));
+}
+
+fn AabbSoA::remove(u32 idx) -> u32 {
+  ka_assert(idx < size());
+  const u32 last = size() - 1;
+  const fn swap_pop = [&](auto& vec) {
+    vec[idx] = vec[last];
+    vec.pop_back();
+  };
+  const u32 moved = _ids[last];
+  swap_pop(_min_x);
+  swap_pop(_min_y);
+  swap_pop(_min_z);
+  swap_pop(_max_x);
+  swap_pop(_max_y);
+  swap_pop(_max_z);
+  swap_pop(_ids);
+  return moved;
+}
+
+fn AabbSoA::clear() -> void {
+  _min_x.clear();
+  _min_y.clear();
+  _min_z.clear();
+  _max_x.clear();
+  _max_y.clear();
+  _max_z.clear();
+  _ids.clear();
+}
+
+fn AabbSoA::reserve(size_t count) -> void {
+  _min_x.reserve(count);
+  _min_y.reserve(count);
+  _min_z.reserve(count);
+  _max_x.reserve(count);
+  _max_y.reserve(count);
+  _max_z.reserve(count);
+  _ids.reserve(count);
+}
+
+namespace {
+
+// For each plane only the corner furthest along the normal matters, pick the arrays once
+struct PlaneSelect {
+  f32 a, b, c, d;
+  const f32* px;
+  const f32* py;
+  const f32* pz;
+};
+
+fn select_planes(const Frustum& frustum, const AabbSoA& boxes, PlaneSelect (&out)[6]) -> void {
+  for (u32 i = 0; i < 6; ++i) {
+    const auto& plane = frustum.planes[i];
+    out[i].a = plane.x;
+    out[i].b = plane.y;
+    out[i].c = plane.z;
+    out[i].d = plane.w;
+    out[i].px = plane.x >= 0.f ? boxes.max_x() : boxes.min_x();
+    out[i].py = plane.y >= 0.f ? boxes.max_y() : boxes.min_y();
+    out[i].pz = plane.z >= 0.f ? boxes.max_z() : boxes.min_z();
+  }
+}
+
+fn cull_range(const PlaneSelect (&planes)[6], const u32* ids, u32 start, u32 end, u32* out)
+  -> u32 {
+  u32 count = 0;
+  for (u32 i = start; i < end; ++i) {
+    bool inside = true;
+    for (const auto& plane : planes) {
+      const f32 dist = plane.a * plane.px[i] + plane.b * plane.py[i] + plane.c * plane.pz[i];
+      if (dist + plane.d < 0.f) {
+        inside = false;
+        break;
+      }
+    }
+    if (inside) {
+      out[count++] = ids[i];
+    }
+  }
+  return count;
+}
+
+} // namespace
+
+fn cull_aabbs_scalar(const Frustum& frustum, const AabbSoA& boxes, Vec<u32>& visible)
+  -> CullStats {
+  PlaneSelect planes[6];
+  select_planes(frustum, boxes, planes);
+  visible.resize(boxes.size());
+  const u32 count = cull_range(planes, boxes.ids(), 0, boxes.size(), visible.data());
+  visible.resize(count);
+  return {boxes.size(), count};
+}
+
+fn cull_aabbs(const Frustum& frustum, const AabbSoA& boxes, Vec<u32>& visible) -> CullStats {
+  PlaneSelect planes[6];
+  select_planes(frustum, boxes, planes);
+  const u32 box_count = boxes.size();
+  const u32* ids = boxes.ids();
+  visible.resize(box_count);
+  u32* out = visible.data();
+  u32 count = 0;
+  u32 i = 0;
+
+#if defined(KA_CULL_AVX)
+  constexpr u32 WIDTH = 8;
+  __m256 plane_a[6], plane_b[6], plane_c[6], plane_d[6];
+  for (u32 p = 0; p < 6; ++p) {
+    plane_a[p] = _mm256_set1_ps(planes[p].a);
+    plane_b[p] = _mm256_set1_ps(planes[p].b);
+    plane_c[p] = _mm256_set1_ps(planes[p].c);
+    plane_d[p] = _mm256_set1_ps(planes[p].d);
+  }
+  const __m256 zero = _mm256_setzero_ps();
+  for (; i + WIDTH <= box_count; i += WIDTH) {
+    __m256 outside = zero;
+    for (u32 p = 0; p < 6; ++p) {
+      __m256 dist = _mm256_mul_ps(plane_a[p], _mm256_loadu_ps(planes[p].px + i));
+      dist = _mm256_add_ps(dist, _mm256_mul_ps(plane_b[p], _mm256_loadu_ps(planes[p].py + i)));
+      dist = _mm256_add_ps(dist, _mm256_mul_ps(plane_c[p], _mm256_loadu_ps(planes[p].pz + i)));
+      dist = _mm256_add_ps(dist, plane_d[p]);
+      outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, zero, _CMP_LT_OQ));
+    }
+    u32 mask = ~(u32)_mm256_movemask_ps(outside) & 0xFFu;
+    while (mask) {
+      out[count++] = ids[i + std::countr_zero(mask)];
+      mask &= mask - 1;
+    }
+  }
+#elif defined(KA_CULL_SSE)
+  constexpr u32 WIDTH = 4;
+  __m128 plane_a[6], plane_b[6], plane_c[6], plane_d[6];
+  for (u32 p = 0; p < 6; ++p) {
+    plane_a[p] = _mm_set1_ps(planes[p].a);
+    plane_b[p] = _mm_set1_ps(planes[p].b);
+    plane_c[p] = _mm_set1_ps(planes[p].c);
+    plane_d[p] = _mm_set1_ps(planes[p].d);
+  }
+  const __m128 zero = _mm_setzero_ps();
+  for (; i + WIDTH <= box_count; i += WIDTH) {
+    __m128 outside = zero;
+    for (u32 p = 0; p < 6; ++p) {
+      __m128 dist = _mm_mul_ps(plane_a[p], _mm_loadu_ps(planes[p].px + i));
+      dist = _mm_add_ps(dist, _mm_mul_ps(plane_b[p], _mm_loadu_ps(planes[p].py + i)));
+      dist = _mm_add_ps(dist, _mm_mul_ps(plane_c[p], _mm_loadu_ps(planes[p].pz + i)));
+      dist = _mm_add_ps(dist, plane_d[p]);
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, zero));
+    }
+    u32 mask = ~(u32)_mm_movemask_ps(outside) & 0xFu;
+    while (mask) {
+      out[count++] = ids[i + std::countr_zero(mask)];
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  // Whatever doesn't fill a whole register
+  count += cull_range(planes, ids, i, box_count, out + count);
+  visible.resize(count);
+  return {box_count, count};
+}
+
+} // namespace kappa::render
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <ranmath/ran.hpp>
+
+namespace kappa::render {
+
+// Planes as (normal, distance), a point is inside if dot(normal, p) + distance >= 0
+struct Frustum {
+  ran::Vec4f32 planes[6];
+};
+
+// Works with column major view projection matrices, with a [0, 1] depth range
+fn frustum_from_matrix(const ran::Mat4f32& view_proj) -> Frustum;
+
+struct CullStats {
+  u32 tested;
+  u32 visible;
+};
+
+// Axis aligned boxes stored per component, so the kernels can test a bunch at once. Each box
+// carries an user id, which is what ends up in the visible list
+class AabbSoA {
+public:
+  AabbSoA() = default;
+
+public:
+  fn push(u32 id, const ran::Vec3f32& min, const ran::Vec3f32& max) -> u32;
+  fn set(u32 idx, const ran::Vec3f32& min, const ran::Vec3f32& max) -> void;
+
+  // Stores the world space bounds of a local space box
+  fn set_transformed(u32 idx, const ran::Vec3f32& min, const ran::Vec3f32& max,
+                     const ran::Mat4f32& transform) -> void;
+
+  // Swaps the last box into idx, returns the id of the box that got moved
+  fn remove(u32 idx) -> u32;
+  fn clear() -> void;
+  fn reserve(size_t count) -> void;
+
+public:
+  fn size() const -> u32 { return (u32)_ids.size(); }
+
+  fn ids() const -> const u32* { return _ids.data(); }
+
+  fn min_x() const -> const f32* { return _min_x.data(); }
+
+  fn min_y() const -> const f32* { return _min_y.data(); }
+
+  fn min_z() const -> const f32* { return _min_z.data(); }
+
+  fn max_x() const -> const f32* { return _max_x.data(); }
+
+  fn max_y() const -> const f32* { return _max_y.data(); }
+
+  fn max_z() const -> const f32* { return _max_z.data(); }
+
+private:
+  Vec<f32> _min_x, _min_y, _min_z;
+  Vec<f32> _max_x, _max_y, _max_z;
+  Vec<u32> _ids;
+};
+
+// Writes the ids of every box touching the frustum into visible, using SSE or AVX when available
+fn cull_aabbs(const Frustum& frustum, const AabbSoA& boxes, Vec<u32>& visible) -> CullStats;
+
+// One box at a time, same results as cull_aabbs
+fn cull_aabbs_scalar(const Frustum& frustum, const AabbSoA& boxes, Vec<u32>& visible)
+  -> CullStats;
+
+} // namespace kappa::render
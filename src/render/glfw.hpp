@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core.hpp"
+#include "profiler.hpp"
 
 #include <vulkan/vulkan_core.h>
 
@@ -134,12 +135,17 @@ void render_loop(GLFWContext& win, LoopObj&& obj) {
 
   time_point last_time = clock::now();
   while (!win.should_close()) {
+    KA_PROFILE_FRAME();
     const time_point start_time = clock::now();
     const auto elapsed_time = start_time - last_time;
     last_time = start_time;
     const f64 dt = (std::chrono::duration<f64>(elapsed_time) / 1s);
 
-    win.poll_events();
+    {
+      KA_PROFILE_ZONE("poll_events");
+      win.poll_events();
+    }
+    KA_PROFILE_ZONE("render");
     if constexpr (meta::delta_render_object<LoopObj>) {
       obj.on_render(dt);
     } else {
@@ -162,6 +168,7 @@ void render_loop(GLFWContext& win, LoopObj&& obj) {
   time_point last_time = clock::now();
   duration lag = 0s;
   while (!win.should_close()) {
+    KA_PROFILE_FRAME();
     const time_point start_time = clock::now();
     const auto elapsed_time = start_time - last_time;
     last_time = start_time;
@@ -170,9 +177,13 @@ void render_loop(GLFWContext& win, LoopObj&& obj) {
     const f64 dt = (std::chrono::duration<f64>(elapsed_time) / 1s);
     const f64 alpha = (std::chrono::duration<f64>(lag) / fixed_elapsed_time);
 
-    win.poll_events();
+    {
+      KA_PROFILE_ZONE("poll_events");
+      win.poll_events();
+    }
 
     while (lag >= fixed_elapsed_time) {
+      KA_PROFILE_ZONE("fixed_update");
       if constexpr (meta::fixed_update_object<LoopObj, UPS>) {
         obj.on_fixed_update(std::integral_constant<u32, UPS>{});
       } else {
@@ -181,6 +192,7 @@ void render_loop(GLFWContext& win, LoopObj&& obj) {
       lag -= fixed_elapsed_time;
     }
 
+    KA_PROFILE_ZONE("render");
     if constexpr (meta::fixed_render_object<LoopObj>) {
       obj.on_render(dt, alpha);
     } else {
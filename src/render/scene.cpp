@@ -5,28 +5,39 @@
 
 namespace kappa::render {
 
-SceneData::SceneData(create_t, RenderContext& ctx, ComputeData&& compute, SceneLayouts&& layouts) :
-    _ctx(&ctx), _compute(std::move(compute)), _meshes(), _layouts(std::move(layouts)) {}
+SceneData::SceneData(create_t, RenderContext& ctx, ComputeData&& compute, SceneLayouts&& layouts,
+                     VkBufferPool&& vertex_pool, VkBufferPool&& index_pool,
+                     IndirectData&& indirect, IndirectFrame* indirect_frames) :
+    _ctx(&ctx), _compute(std::move(compute)), _meshes(), _layouts(std::move(layouts)),
+    _vertex_pool(std::move(vertex_pool)), _index_pool(std::move(index_pool)),
+    _indirect(std::move(indirect)), _instances(), _free_instances(), _mesh_draws(), _bounds(),
+    _visible(), _cull_stats(), _draw_count(0) {
+  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    _indirect_frames.construct(i, std::move(indirect_frames[i]));
+  }
+}
 
 namespace {
 
+// The vertex pool keeps each attribute in its own stream, the shaders pull them separately
+enum VertexStream : u32 {
+  VERTEX_STREAM_POSITION = 0,
+  VERTEX_STREAM_UV,
+};
+
+static_assert(sizeof(ran::Vec3f32) == 3 * sizeof(f32) && sizeof(ran::Vec2f32) == 2 * sizeof(f32),
+              "Vertex streams have to be tightly packed");
+
 fn init_compute(RenderContext& ctx, SceneData::ComputeData& compute) -> void {
   auto& vk = ctx.get_vk();
   auto& delqueue = ctx.get_delqueue();
   auto& desc_alloc = ctx.get_desc_alloc();
   auto& target = ctx.get_target();
+  auto& shaders = ctx.get_shader_cache();
 
-  VkShaderModule shader_gradient = VK_NULL_HANDLE, shader_sky = VK_NULL_HANDLE;
-  const DeferFn shader_defer = [&]() {
-    vk_destroy_shader(vk, shader_gradient);
-    vk_destroy_shader(vk, shader_sky);
-  };
-
-  const auto src_gradient = load_entire_file(KA_RES_DIR "/shaders/gradient_color.comp.spv");
-  shader_gradient = vk_create_shader(vk, {src_gradient.data(), src_gradient.size()}).value();
-
-  const auto src_sky = load_entire_file(KA_RES_DIR "/shaders/sky.comp.spv");
-  shader_sky = vk_create_shader(vk, {src_sky.data(), src_sky.size()}).value();
+  const auto shader_gradient =
+    shaders.get_shader(vk, KA_RES_DIR "/shaders/gradient_color.comp.spv").value();
+  const auto shader_sky = shaders.get_shader(vk, KA_RES_DIR "/shaders/sky.comp.spv").value();
 
   VkDescLayoutBuilder desc_layout_builder;
   compute.image_desc_layout = desc_layout_builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
@@ -36,7 +47,8 @@ fn init_compute(RenderContext& ctx, SceneData::ComputeData& compute) -> void {
 
   compute.image_desc = desc_alloc.allocate(compute.image_desc_layout).value();
 
-  VkDescWriter writer(vk.device());
+  ScratchScope scratch;
+  VkDescWriter writer(vk.device(), scratch.arena());
   writer.write_storage_image(0, target.color.view(), VK_IMAGE_LAYOUT_GENERAL);
   writer.update_set(compute.image_desc);
 
@@ -65,192 +77,378 @@ fn init_layouts(RenderContext& ctx, SceneData::SceneLayouts& layouts) -> void {
   auto& delqueue = ctx.get_delqueue();
 
   VkDescLayoutBuilder builder;
-  layouts.image_layout = builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
-                           .build(vk, VK_SHADER_STAGE_FRAGMENT_BIT)
-                           .value();
-  delqueue.enqueue(layouts.image_layout, vk.device());
-
-  builder.clear();
   layouts.main_layout = builder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
                           .build(vk, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
                           .value();
   delqueue.enqueue(layouts.main_layout, vk.device());
 }
 
-} // namespace
-
-fn SceneData::initialize(TypeBufferRef<SceneData> scene, RenderContext& ctx) -> void {
-  ComputeData compute;
-  init_compute(ctx, compute);
-
-  SceneLayouts layouts;
-  init_layouts(ctx, layouts);
-  scene->construct(create_t(), ctx, std::move(compute), std::move(layouts));
-}
-
-SceneData::~SceneData() {
-  clear();
+fn upload_mesh(VkContext& vk, const VkBufferPool& vertex_pool, const VkPoolRange& vertices,
+                const VkBufferPool& index_pool, const VkPoolRange& indices,
+                const SceneData::MeshData& mesh) -> VkUploadTicket {
+  auto ticket = vk_submit_upload(vk, [&](VkUploadCmd& upload) -> void {
+    // Streams go from the loader arrays into staging as they are
+    const fn copy_stream = [&](VkBuffer dst, VkDeviceSize dst_offset, const void* data,
+                               VkDeviceSize size) -> void {
+      const auto staging = upload.stage(data, size).value();
+      VkBufferCopy copy{};
+      copy.dstOffset = dst_offset;
+      copy.srcOffset = staging.offset;
+      copy.size = size;
+      upload.copy_buffer(staging.buffer, dst, copy);
+    };
+    copy_stream(vertex_pool.buffer(), vertex_pool.byte_offset(vertices, VERTEX_STREAM_POSITION),
+                mesh.positions.data(), mesh.positions.size_bytes());
+    copy_stream(vertex_pool.buffer(), vertex_pool.byte_offset(vertices, VERTEX_STREAM_UV),
+                mesh.uvs.data(), mesh.uvs.size_bytes());
+    copy_stream(index_pool.buffer(), index_pool.byte_offset(indices), mesh.indices.data(),
+                mesh.indices.size_bytes());
+  });
+  return ticket.value();
 }
 
-namespace {
-
-struct Vertex {
-  ran::Vec3f32 pos;
-  f32 uv_x;
-  ran::Vec3f32 normal;
-  f32 uv_y;
-  ran::Vec4f32 color;
+// Same layout as the shader push constant block
+struct MeshConstants {
+  ran::Mat4f32 view;
+  ran::Mat4f32 proj;
+  VkDeviceAddress position_buffer;
+  VkDeviceAddress uv_buffer;
+  VkDeviceAddress instance_buffer;
+  u32 texture_index;
 };
 
-fn soa_to_aos(Span<const ran::Vec3f32> pos, Span<const ran::Vec2f32> uvs) -> UniqueArray<Vertex> {
-  const size_t count = pos.size();
-  ka_assert(uvs.size() == count);
-  auto out = make_unique_array<Vertex>(uninitialized, count);
-  for (size_t i = 0; i < count; ++i) {
-    out[i].color = ran::Vec4f32(1.f, 1.f, 1.f, 1.f); // make something up
-    out[i].uv_x = uvs[i].x;
-    out[i].uv_y = uvs[i].y;
-    out[i].pos = pos[i];
-  }
-  return out;
-}
-
-fn copy_buffers(VkContext& vk, VkAllocBuff& vb, const void* vb_data, VkDeviceSize vb_size,
-                VkAllocBuff& ib, const void* ib_data, VkDeviceSize ib_size) -> void {
-  const VkBufferArgs staging_args{
-    .size = vb_size + ib_size,
-    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-    .mem_usage = KA_VK_MEM_USAGE_CPU_ONLY,
-  };
-  auto staging = VkAllocBuff::create(vk.allocator(), staging_args).value();
-  const DeferFn staging_defer = [&]() {
-    vk_destroy_buffer(vk.allocator(), staging);
-  };
+// Per object data for the GPU culling path, same layout as the shaders
+struct GpuObject {
+  ran::Mat4f32 world;
+  ran::Vec4f32 bbox_min;
+  ran::Vec4f32 bbox_max;
+  u32 bucket; // Draw command of its mesh
+  u32 texture_index;
+  u32 pad[2];
+};
 
-  void* data = staging.mapped_data();
-  std::memcpy(data, vb_data, vb_size);
-  std::memcpy(((u8*)data) + vb_size, ib_data, ib_size);
-
-  vk_submit_immediate(vk, [&](VkCommandBuffer cmd) -> void {
-    VkBufferCopy vertex_copy{};
-    vertex_copy.dstOffset = 0;
-    vertex_copy.srcOffset = 0;
-    vertex_copy.size = vb_size;
-    vkCmdCopyBuffer(cmd, staging.buffer(), vb.buffer(), 1, &vertex_copy);
-
-    VkBufferCopy index_copy{};
-    index_copy.dstOffset = 0;
-    index_copy.srcOffset = vb_size;
-    index_copy.size = ib_size;
-    vkCmdCopyBuffer(cmd, staging.buffer(), ib.buffer(), 1, &index_copy);
-  });
-}
+static_assert(sizeof(GpuObject) == 112, "GpuObject doesn't match the std430 layout");
+
+struct CullConstants {
+  ran::Mat4f32 view_proj;
+  VkDeviceAddress object_buffer;
+  VkDeviceAddress bucket_buffer;
+  VkDeviceAddress visible_buffer;
+  VkDeviceAddress draw_buffer;
+  VkDeviceAddress count_buffer;
+  u32 object_count;
+  u32 bucket_count;
+  u32 pass; // Cull the objects first, then emit a command per mesh
+};
 
-struct MeshConstants {
-  ran::Mat4f32 world;
-  ran::Mat4f32 proj;
+struct IndirectConstants {
   ran::Mat4f32 view;
-  VkDeviceAddress vertex_buffer;
+  ran::Mat4f32 proj;
+  VkDeviceAddress position_buffer;
+  VkDeviceAddress uv_buffer;
+  VkDeviceAddress object_buffer;
+  VkDeviceAddress visible_buffer;
 };
 
-fn init_pipeline(RenderContext& ctx, VkDescriptorSetLayout image_layout)
-  -> std::pair<VkPipeline, VkPipelineLayout> {
+constexpr u32 CULL_GROUP_SIZE = 64;
+
+fn build_mesh_pipeline(RenderContext& ctx, const char* vert_path, const char* frag_path,
+                       u32 push_size) -> std::pair<VkPipeline, VkPipelineLayout> {
   auto& vk = ctx.get_vk();
-  auto& delqueue = ctx.get_delqueue();
   auto& target = ctx.get_target();
+  auto& shaders = ctx.get_shader_cache();
+  auto& pipelines = ctx.get_pipeline_cache();
 
-  VkShaderModule frag = VK_NULL_HANDLE, vert = VK_NULL_HANDLE;
-  const DeferFn shader_defer = [&]() {
-    vk_destroy_shader(vk, frag);
-    vk_destroy_shader(vk, vert);
-  };
-  VkPipelineLayout layout = VK_NULL_HANDLE;
-  VkPipeline pipeline = VK_NULL_HANDLE;
-
-  const auto mesh_vert_src = load_entire_file(KA_RES_DIR "/shaders/colored_mesh.vert.spv");
-  vert = vk_create_shader(vk, {mesh_vert_src.data(), mesh_vert_src.size()}).value();
-
-  const auto frag_src = load_entire_file(KA_RES_DIR "/shaders/colored_triangle.frag.spv");
-  frag = vk_create_shader(vk, {frag_src.data(), frag_src.size()}).value();
+  // Cached, only the first mesh pays for these
+  const auto vert = shaders.get_shader(vk, vert_path).value();
+  const auto frag = shaders.get_shader(vk, frag_path).value();
 
   VkPipelineLayoutBuilder layout_builder;
-  layout = layout_builder.add_push_range(VK_SHADER_STAGE_VERTEX_BIT, sizeof(MeshConstants), 0)
-             .add_layout(image_layout)
-             .build(vk)
-             .value();
-  delqueue.enqueue(layout, vk.device());
+  layout_builder
+    .add_push_range(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, push_size, 0)
+    .add_layout(ctx.get_bindless().layout());
+  const auto layout = pipelines.get_layout(vk, layout_builder).value();
 
   VkGfxPipelineBuilder pipeline_builder;
-  pipeline = pipeline_builder.set_layout(layout)
-               .add_module(VK_SHADER_STAGE_VERTEX_BIT, vert)
-               .add_module(VK_SHADER_STAGE_FRAGMENT_BIT, frag)
-               .set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
-               .set_poly_mode(VK_POLYGON_MODE_FILL)
-               .set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE)
-               .set_color_format(target.color.format())
-               .set_depth_format(target.depth.format())
-               .enable_depth_test(KA_VK_DEPTH_WRITE_ENABLE, VK_COMPARE_OP_GREATER_OR_EQUAL)
-               .disable_multisampling()
-               .disable_blending()
-               .build(vk)
-               .value();
-  delqueue.enqueue(pipeline, vk.device());
+  pipeline_builder.set_layout(layout)
+    .add_module(VK_SHADER_STAGE_VERTEX_BIT, vert)
+    .add_module(VK_SHADER_STAGE_FRAGMENT_BIT, frag)
+    .set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+    .set_poly_mode(VK_POLYGON_MODE_FILL)
+    .set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE)
+    .set_color_format(target.color.format())
+    .set_depth_format(target.depth.format())
+    .enable_depth_test(KA_VK_DEPTH_WRITE_ENABLE, VK_COMPARE_OP_GREATER_OR_EQUAL)
+    .disable_multisampling()
+    .disable_blending();
+  const auto pipeline = pipelines.get_pipeline(vk, pipeline_builder).value();
   return {pipeline, layout};
 }
 
-} // namespace
+fn init_pipeline(RenderContext& ctx) -> std::pair<VkPipeline, VkPipelineLayout> {
+  return build_mesh_pipeline(ctx, KA_RES_DIR "/shaders/colored_mesh.vert.spv",
+                             KA_RES_DIR "/shaders/colored_triangle.frag.spv",
+                             sizeof(MeshConstants));
+}
 
-fn SceneData::add_mesh(const MeshData& mesh, std::string_view name) -> Mesh {
-  log_debug(" Adding mesh: {}", name);
-  auto& vk = _ctx->get_vk();
+fn init_indirect(RenderContext& ctx, SceneData::IndirectData& indirect,
+                 SceneData::IndirectFrameArray& frames) -> void {
+  auto& vk = ctx.get_vk();
+  auto& delqueue = ctx.get_delqueue();
+  auto& shaders = ctx.get_shader_cache();
+
+  const auto shader_cull =
+    shaders.get_shader(vk, KA_RES_DIR "/shaders/mesh_cull.comp.spv").value();
+  VkPipelineLayoutBuilder layout_builder;
+  indirect.cull_layout =
+    layout_builder.add_push_range(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(CullConstants), 0)
+      .build(vk)
+      .value();
+  delqueue.enqueue(indirect.cull_layout, vk.device());
+  indirect.cull_pipeline =
+    vk_create_compute_pipeline(vk, indirect.cull_layout, shader_cull).value();
+  delqueue.enqueue(indirect.cull_pipeline, vk.device());
+
+  const auto [pipeline, layout] =
+    build_mesh_pipeline(ctx, KA_RES_DIR "/shaders/mesh_indirect.vert.spv",
+                        KA_RES_DIR "/shaders/mesh_indirect.frag.spv", sizeof(IndirectConstants));
+  indirect.draw_pipeline = pipeline;
+  indirect.draw_layout = layout;
+  indirect.object_count = 0;
+  indirect.bucket_count = 0;
+  // Without drawIndirectCount only the direct path is left
+  indirect.supported = vk.has_draw_indirect_count();
+  indirect.enabled = indirect.supported;
+  if (!indirect.supported) {
+    KA_LOG(warn, "drawIndirectCount not supported, GPU culling disabled");
+  }
 
-  // Vertex buffer
-  const auto vertices = soa_to_aos(mesh.positions, mesh.uvs); // commit a crime
-  const auto vb_size = vertices.size() * sizeof(vertices[0]);
-  const VkBufferArgs vb_args{
-    .size = vb_size,
-    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+  const VkBufferArgs object_args{
+    .size = SceneData::MAX_GPU_OBJECTS * sizeof(GpuObject),
+    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    .mem_usage = KA_VK_MEM_USAGE_CPU_TO_GPU,
+  };
+  const VkBufferArgs bucket_args{
+    .size = SceneData::MAX_MESHES * sizeof(VkDrawIndexedIndirectCommand),
+    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    .mem_usage = KA_VK_MEM_USAGE_CPU_TO_GPU,
+  };
+  const VkBufferArgs visible_args{
+    .size = SceneData::MAX_GPU_OBJECTS * sizeof(u32),
+    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    .mem_usage = KA_VK_MEM_USAGE_GPU_ONLY,
+  };
+  const VkBufferArgs draw_args{
+    .size = SceneData::MAX_MESHES * sizeof(VkDrawIndexedIndirectCommand),
+    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
              VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
     .mem_usage = KA_VK_MEM_USAGE_GPU_ONLY,
   };
-  auto vb = VkAllocBuff::create(vk.allocator(), vb_args).value();
-  DeferFn vb_err = [&]() {
-    vk_destroy_buffer(vk.allocator(), vb);
+  const VkBufferArgs count_args{
+    .size = sizeof(u32),
+    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+             VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    .mem_usage = KA_VK_MEM_USAGE_GPU_ONLY,
+  };
+  const VkBufferArgs transform_args{
+    .size = SceneData::MAX_GPU_OBJECTS * sizeof(ran::Mat4f32),
+    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    .mem_usage = KA_VK_MEM_USAGE_CPU_TO_GPU,
   };
+  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    auto objects = VkAllocBuff::create(vk.allocator(), object_args).value();
+    auto buckets = VkAllocBuff::create(vk.allocator(), bucket_args).value();
+    auto visible = VkAllocBuff::create(vk.allocator(), visible_args).value();
+    auto draws = VkAllocBuff::create(vk.allocator(), draw_args).value();
+    auto count = VkAllocBuff::create(vk.allocator(), count_args).value();
+    auto transforms = VkAllocBuff::create(vk.allocator(), transform_args).value();
+    delqueue.enqueue(objects, vk.allocator());
+    delqueue.enqueue(buckets, vk.allocator());
+    delqueue.enqueue(visible, vk.allocator());
+    delqueue.enqueue(draws, vk.allocator());
+    delqueue.enqueue(count, vk.allocator());
+    delqueue.enqueue(transforms, vk.allocator());
+    frames.construct(i, std::move(objects), std::move(buckets), std::move(visible),
+                     std::move(draws), std::move(count), std::move(transforms));
+  }
+}
 
-  // Index buffer
-  const auto ib_size = mesh.indices.size_bytes();
-  const VkBufferArgs ib_args{
-    .size = ib_size,
-    .usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-    .mem_usage = KA_VK_MEM_USAGE_GPU_ONLY,
+} // namespace
+
+fn SceneData::initialize(TypeBufferRef<SceneData> scene, RenderContext& ctx) -> void {
+  ComputeData compute;
+  init_compute(ctx, compute);
+
+  SceneLayouts layouts;
+  init_layouts(ctx, layouts);
+
+  auto& vk = ctx.get_vk();
+  const VkBufferPoolArgs vertex_args{
+    .capacity = VERTEX_POOL_CAPACITY,
+    .stride = sizeof(ran::Vec3f32) + sizeof(ran::Vec2f32),
+    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    .streams = {sizeof(ran::Vec3f32), sizeof(ran::Vec2f32)},
+  };
+  auto vertex_pool = VkBufferPool::create(vk.allocator(), vertex_args).value();
+  const VkBufferPoolArgs index_args{
+    .capacity = INDEX_POOL_CAPACITY,
+    .stride = sizeof(u32),
+    .usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+  };
+  auto index_pool = VkBufferPool::create(vk.allocator(), index_args).value();
+
+  IndirectData indirect;
+  IndirectFrameArray indirect_frames;
+  init_indirect(ctx, indirect, indirect_frames);
+
+  scene->construct(create_t(), ctx, std::move(compute), std::move(layouts),
+                   std::move(vertex_pool), std::move(index_pool), std::move(indirect),
+                   indirect_frames.data());
+}
+
+SceneData::~SceneData() {
+  clear();
+  // Buffers are owned by the context delqueue
+  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    _indirect_frames.destroy(i);
+  }
+  _index_pool.destroy(_ctx->get_vk().allocator());
+  _vertex_pool.destroy(_ctx->get_vk().allocator());
+}
+
+fn SceneData::add_mesh(const MeshData& mesh, std::string_view name) -> Mesh {
+  KA_LOG(debug, " Adding mesh: {}", name);
+  auto& vk = _ctx->get_vk();
+
+  ka_assert(mesh.uvs.size() == mesh.positions.size());
+  auto vb_range = allocate_range(_vertex_pool, &MeshAsset::vertices, (u32)mesh.positions.size());
+  DeferFn vb_err = [&]() {
+    _vertex_pool.free(vb_range);
   };
-  auto ib = VkAllocBuff::create(vk.allocator(), ib_args).value();
+  auto ib_range = allocate_range(_index_pool, &MeshAsset::indices, (u32)mesh.indices.size());
   DeferFn ib_err = [&]() {
-    vk_destroy_buffer(vk.allocator(), ib);
+    _index_pool.free(ib_range);
   };
 
-  const auto [pipeline, layout] = init_pipeline(*_ctx, _layouts.image_layout);
+  const auto [pipeline, layout] = init_pipeline(*_ctx);
   BuffStr<256> mesh_name;
   mesh_name.copy_from(name.data(), name.size());
 
-  copy_buffers(vk, vb, vertices.data(), vb_size, ib, mesh.indices.data(), ib_size);
+  // Don't wait for the upload, the mesh gets drawn once it lands
+  const auto upload = upload_mesh(vk, _vertex_pool, vb_range, _index_pool, ib_range, mesh);
 
   ib_err.disengage();
   vb_err.disengage();
 
-  return _meshes.emplace(pipeline, layout, ran::Mat4f32::identity(), std::move(vb), std::move(ib),
-                         0, (u32)mesh.indices.size(), mesh_name);
+  return _meshes.emplace(pipeline, layout, mesh.bbox_min, mesh.bbox_max, vb_range, ib_range,
+                         RenderContext::DEFAULT_IMAGE, upload, 0u, mesh_name);
+}
+
+fn SceneData::remove_mesh(Mesh mesh) -> void {
+  ka_assert(_meshes.has_element(mesh));
+  // Frames in flight might still be drawing it, and the ranges get reused right away
+  vkDeviceWaitIdle(_ctx->get_vk().device());
+  auto& asset = _meshes[mesh];
+  for (u32 id = 0; id < _instances.size() && asset.instance_count; ++id) {
+    if (_instances[id].alive && (u32)_instances[id].mesh == (u32)mesh) {
+      remove_instance((Instance)id);
+    }
+  }
+  _vertex_pool.free(asset.vertices);
+  _index_pool.free(asset.indices);
+  _meshes.remove(mesh);
+}
+
+fn SceneData::set_mesh_texture(Mesh mesh, Image texture) -> void {
+  ka_assert(_meshes.has_element(mesh));
+  _meshes[mesh].texture = texture;
+}
+
+fn SceneData::add_instance(Mesh mesh, const ran::Mat4f32& transform) -> Instance {
+  ka_assert(_meshes.has_element(mesh));
+  ka_assert(_bounds.size() < MAX_GPU_OBJECTS, "Too many instances");
+  auto& asset = _meshes[mesh];
+
+  u32 id;
+  if (!_free_instances.empty()) {
+    id = _free_instances.back();
+    _free_instances.pop_back();
+    _instances[id] = {transform, mesh, 0, true};
+  } else {
+    id = (u32)_instances.size();
+    _instances.push_back({transform, mesh, 0, true});
+  }
+  auto& instance = _instances[id];
+  instance.bounds_idx = _bounds.push(id, asset.bbox_min, asset.bbox_max);
+  _bounds.set_transformed(instance.bounds_idx, asset.bbox_min, asset.bbox_max, transform);
+  ++asset.instance_count;
+  return (Instance)id;
+}
+
+fn SceneData::remove_instance(Instance instance) -> void {
+  const u32 id = (u32)instance;
+  ka_assert(id < _instances.size() && _instances[id].alive);
+  // Transforms are copied every frame, frames in flight keep their own copy
+  auto& data = _instances[id];
+  _instances[_bounds.remove(data.bounds_idx)].bounds_idx = data.bounds_idx;
+  --_meshes[data.mesh].instance_count;
+  data.alive = false;
+  _free_instances.push_back(id);
+}
+
+fn SceneData::set_instance_transform(Instance instance, const ran::Mat4f32& transform) -> void {
+  const u32 id = (u32)instance;
+  ka_assert(id < _instances.size() && _instances[id].alive);
+  auto& data = _instances[id];
+  const auto& asset = _meshes[data.mesh];
+  data.transform = transform;
+  _bounds.set_transformed(data.bounds_idx, asset.bbox_min, asset.bbox_max, transform);
 }
 
 fn SceneData::clear() -> void {
+  // Meshes might still be in use by frames in flight, or still uploading
+  vkDeviceWaitIdle(_ctx->get_vk().device());
+  // Pipelines and layouts belong to the context cache
   _meshes.for_each([&](MeshAsset& mesh) {
-    vk_destroy_pipeline_layout(_ctx->get_vk(), mesh.layout);
-    vk_destroy_pipeline(_ctx->get_vk(), mesh.pipeline);
-    vk_destroy_buffer(_ctx->get_vk().allocator(), mesh.vertex_buffer);
-    vk_destroy_buffer(_ctx->get_vk().allocator(), mesh.index_buffer);
+    _vertex_pool.free(mesh.vertices);
+    _index_pool.free(mesh.indices);
   });
   _meshes.clear();
+  _instances.clear();
+  _free_instances.clear();
+  _bounds.clear();
+  _visible.clear();
+}
+
+fn SceneData::compact() -> void {
+  vkDeviceWaitIdle(_ctx->get_vk().device());
+  compact_pool(_vertex_pool, &MeshAsset::vertices, _vertex_pool.capacity());
+  compact_pool(_index_pool, &MeshAsset::indices, _index_pool.capacity());
+}
+
+fn SceneData::allocate_range(VkBufferPool& pool, VkPoolRange MeshAsset::*member, u32 count)
+  -> VkPoolRange {
+  if (auto range = pool.allocate(count); range.has_value()) {
+    return *range;
+  }
+
+  // Either fragmented or full, repack everything into a bigger buffer and try again
+  const u32 capacity = std::max(pool.capacity() * 2, pool.used() + count);
+  KA_LOG(debug, "Growing scene buffer pool from {} to {} elements", pool.capacity(), capacity);
+  vkDeviceWaitIdle(_ctx->get_vk().device());
+  compact_pool(pool, member, capacity);
+  return pool.allocate(count).value();
+}
+
+fn SceneData::compact_pool(VkBufferPool& pool, VkPoolRange MeshAsset::*member, u32 capacity)
+  -> void {
+  ScratchScope scratch;
+  ArenaVec<VkPoolRange*> ranges(scratch.arena());
+  ranges.reserve(_meshes.size());
+  _meshes.for_each([&](MeshAsset& mesh) {
+    ranges.push_back(&(mesh.*member));
+  });
+  pool.compact(_ctx->get_vk(), {ranges.data(), ranges.size()}, capacity).value();
 }
 
 namespace {
@@ -273,14 +471,37 @@ fn SceneData::render_geometry(VkImageLayout& target_layout, VkCommandBuffer cmd,
   -> void {
   KA_UNUSED(dt);
   KA_UNUSED(alpha);
-  auto& vk = _ctx->get_vk();
   auto& target = _ctx->get_target();
-  auto& frame = _ctx->get_frame();
+  auto& indirect_frame = _indirect_frames[_ctx->get_frame_index()];
+  auto& gpu_timer = _ctx->get_gpu_timer();
+
+  const auto view = ran::Mat4f32::identity();
+  //  ran::translate(ran::Mat4f32::identity(), ran::Vec3f32(0.f, 0.f, -5.f));
+  const auto proj = ran::Mat4f32::identity();
+  //  ran::perspective(
+  //  ran::rad(70.f), (f32)draw_extent.width / (f32)draw_extent.height, 10000.f, .1f);
+  // proj.y2 *= -1;
 
   // Draw using compute pipeline (we use a general layout)
   target_layout =
     vkcmd_transition_image(cmd, target.color.image(), target_layout, VK_IMAGE_LAYOUT_GENERAL);
-  draw_compute(_compute, target.extent, cmd);
+  {
+    VkGpuZone gpu_zone(gpu_timer, cmd, "compute");
+    draw_compute(_compute, target.extent, cmd);
+  }
+
+  // Both paths only record what survives the CPU test
+  {
+    KA_PROFILE_ZONE("cull_aabbs");
+    _cull_stats = cull_aabbs(frustum_from_matrix(proj * view), _bounds, _visible);
+  }
+
+  // Culling has to happen outside of the render pass
+  if (_indirect.enabled) {
+    _indirect.object_count = write_objects(indirect_frame);
+    VkGpuZone gpu_zone(gpu_timer, cmd, "gpu_cull");
+    cull_objects(cmd, indirect_frame, proj * view);
+  }
 
   // Draw using graphics pipelines (we use a color attachment layout)
   target_layout = vkcmd_transition_image(cmd, target.color.image(), target_layout,
@@ -308,37 +529,218 @@ fn SceneData::render_geometry(VkImageLayout& target_layout, VkCommandBuffer cmd,
   scissor.extent = target.extent;
   vkCmdSetScissor(cmd, 0, 1, &scissor);
 
+  VkGpuZone gpu_zone(gpu_timer, cmd, "geometry");
   vkCmdBeginRendering(cmd, &render_info);
-  _meshes.for_each([&](MeshAsset& model_mesh) {
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, model_mesh.pipeline);
-    auto image_set = frame.desc_alloc.allocate(_layouts.image_layout).value();
+  // Every mesh lives in the same pools, bind them once
+  vkCmdBindIndexBuffer(cmd, _index_pool.buffer(), 0, VK_INDEX_TYPE_UINT32);
+  _draw_count = 0;
+  if (_indirect.enabled) {
+    draw_indirect(cmd, indirect_frame, view, proj);
+  } else {
     {
-      VkDescWriter writer(vk.device());
-      writer.write_combined_image(0, _ctx->get_image(RenderContext::DEFAULT_IMAGE).view(),
-                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                  _ctx->get_sampler(RenderContext::SAMPLER_NEAREST));
-      writer.update_set(image_set);
+      KA_PROFILE_ZONE("write_instances");
+      write_instances(indirect_frame);
     }
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, model_mesh.layout, 0, 1,
-                            &image_set, 0, nullptr);
+    draw_direct(cmd, indirect_frame, view, proj);
+  }
+  vkCmdEndRendering(cmd);
+}
 
-    MeshConstants push_constants;
-    push_constants.world = model_mesh.transform;
-    push_constants.view = ran::Mat4f32::identity();
-    //  ran::translate(ran::Mat4f32::identity(), ran::Vec3f32(0.f, 0.f, -5.f));
-    push_constants.proj = ran::Mat4f32::identity();
-    //  ran::perspective(
-    //  ran::rad(70.f), (f32)draw_extent.width / (f32)draw_extent.height, 10000.f, .1f);
-    // push_constants.proj.y2 *= -1;
-    push_constants.vertex_buffer = model_mesh.vertex_buffer.addr(vk.device());
-    vkCmdPushConstants(cmd, model_mesh.layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+fn SceneData::write_instances(IndirectFrame& frame) -> void {
+  // Bucket the visible instances by mesh, so each mesh gets a contiguous range
+  for (auto& draw : _mesh_draws) {
+    draw.instance_count = 0;
+  }
+  for (const u32 id : _visible) {
+    ++_mesh_draws[(u32)_instances[id].mesh].instance_count;
+  }
+  u32 offset = 0;
+  for (auto& draw : _mesh_draws) {
+    draw.first_instance = offset;
+    offset += draw.instance_count;
+    draw.instance_count = 0;
+  }
+
+  auto* transforms = static_cast<ran::Mat4f32*>(frame.transforms.mapped_data());
+  for (const u32 id : _visible) {
+    const auto& instance = _instances[id];
+    auto& draw = _mesh_draws[(u32)instance.mesh];
+    transforms[draw.first_instance + draw.instance_count++] = instance.transform;
+  }
+}
+
+fn SceneData::write_objects(IndirectFrame& frame) -> u32 {
+  auto& vk = _ctx->get_vk();
+  // One draw command per mesh, the cull shader counts its survivors into it. The visible list
+  // gets a range per mesh as big as its CPU survivors, the GPU only fills part of it
+  for (auto& draw : _mesh_draws) {
+    draw.instance_count = 0;
+  }
+  for (const u32 id : _visible) {
+    ++_mesh_draws[(u32)_instances[id].mesh].instance_count;
+  }
+
+  auto* buckets = static_cast<VkDrawIndexedIndirectCommand*>(frame.buckets.mapped_data());
+  std::array<u32, MAX_MESHES> mesh_buckets;
+  u32 bucket_count = 0;
+  u32 offset = 0;
+  for (u32 i = 0; i < MAX_MESHES; ++i) {
+    mesh_buckets[i] = UINT32_MAX;
+    const u32 instance_count = _mesh_draws[i].instance_count;
+    if (!instance_count || !vk_upload_done(vk, _meshes[(Mesh)i].upload)) {
+      continue;
+    }
+    const auto& mesh = _meshes[(Mesh)i];
+    auto& bucket = buckets[bucket_count];
+    bucket.indexCount = mesh.indices.count;
+    bucket.instanceCount = 0;
+    bucket.firstIndex = mesh.indices.offset;
+    bucket.vertexOffset = (i32)mesh.vertices.offset;
+    bucket.firstInstance = offset;
+    mesh_buckets[i] = bucket_count++;
+    offset += instance_count;
+  }
+  _indirect.bucket_count = bucket_count;
+
+  auto* objects = static_cast<GpuObject*>(frame.objects.mapped_data());
+  u32 count = 0;
+  for (const u32 id : _visible) {
+    const auto& instance = _instances[id];
+    const u32 bucket = mesh_buckets[(u32)instance.mesh];
+    if (bucket == UINT32_MAX) {
+      continue;
+    }
+    const auto& mesh = _meshes[instance.mesh];
+    auto& obj = objects[count++];
+    obj.world = instance.transform;
+    obj.bbox_min = ran::Vec4f32(mesh.bbox_min.x, mesh.bbox_min.y, mesh.bbox_min.z, 1.f);
+    obj.bbox_max = ran::Vec4f32(mesh.bbox_max.x, mesh.bbox_max.y, mesh.bbox_max.z, 1.f);
+    obj.bucket = bucket;
+    obj.texture_index = _ctx->get_image_index(mesh.texture);
+  }
+  return count;
+}
+
+fn SceneData::cull_objects(VkCommandBuffer cmd, IndirectFrame& frame,
+                           const ran::Mat4f32& view_proj) -> void {
+  auto& vk = _ctx->get_vk();
+  vkCmdFillBuffer(cmd, frame.count.buffer(), 0, sizeof(u32), 0);
+  vkcmd_buffer_barrier(cmd, frame.count.buffer(), VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+                       VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  if (_indirect.object_count) {
+    CullConstants push_constants;
+    push_constants.view_proj = view_proj;
+    push_constants.object_buffer = frame.objects.addr(vk.device());
+    push_constants.bucket_buffer = frame.buckets.addr(vk.device());
+    push_constants.visible_buffer = frame.visible.addr(vk.device());
+    push_constants.draw_buffer = frame.draws.addr(vk.device());
+    push_constants.count_buffer = frame.count.addr(vk.device());
+    push_constants.object_count = _indirect.object_count;
+    push_constants.bucket_count = _indirect.bucket_count;
+    push_constants.pass = 0;
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _indirect.cull_pipeline);
+    vkCmdPushConstants(cmd, _indirect.cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
                        sizeof(push_constants), &push_constants);
-    vkCmdBindIndexBuffer(cmd, model_mesh.index_buffer.buffer(), model_mesh.index_start,
-                         VK_INDEX_TYPE_UINT32);
-    vkCmdDrawIndexed(cmd, model_mesh.index_count, 1, 0, 0, 0);
-  });
+    vkCmdDispatch(cmd, (_indirect.object_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // The per mesh counts have to be final before the commands get emitted
+    vkcmd_buffer_barrier(cmd, frame.buckets.buffer(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                         VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+    push_constants.pass = 1;
+    vkCmdPushConstants(cmd, _indirect.cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(push_constants), &push_constants);
+    vkCmdDispatch(cmd, (_indirect.bucket_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+  }
 
-  vkCmdEndRendering(cmd);
+  vkcmd_buffer_barrier(cmd, frame.visible.buffer(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+  vkcmd_buffer_barrier(cmd, frame.draws.buffer(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+                       VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+  vkcmd_buffer_barrier(cmd, frame.count.buffer(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+                       VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+}
+
+fn SceneData::draw_indirect(VkCommandBuffer cmd, IndirectFrame& frame, const ran::Mat4f32& view,
+                            const ran::Mat4f32& proj) -> void {
+  if (!_indirect.object_count) {
+    return;
+  }
+  auto& vk = _ctx->get_vk();
+  const auto texture_set = _ctx->get_bindless().set();
+
+  // Everything shares a single pipeline here, per mesh pipelines only apply to the CPU path
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _indirect.draw_pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _indirect.draw_layout, 0, 1,
+                          &texture_set, 0, nullptr);
+
+  IndirectConstants push_constants;
+  push_constants.view = view;
+  push_constants.proj = proj;
+  push_constants.position_buffer = _vertex_pool.stream_addr(vk.device(), VERTEX_STREAM_POSITION);
+  push_constants.uv_buffer = _vertex_pool.stream_addr(vk.device(), VERTEX_STREAM_UV);
+  push_constants.object_buffer = frame.objects.addr(vk.device());
+  push_constants.visible_buffer = frame.visible.addr(vk.device());
+  vkCmdPushConstants(cmd, _indirect.draw_layout,
+                     VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                     sizeof(push_constants), &push_constants);
+  // One instanced command per mesh with survivors
+  vkCmdDrawIndexedIndirectCount(cmd, frame.draws.buffer(), 0, frame.count.buffer(), 0,
+                                _indirect.bucket_count, sizeof(VkDrawIndexedIndirectCommand));
+  _draw_count = _indirect.bucket_count;
+}
+
+fn SceneData::draw_direct(VkCommandBuffer cmd, IndirectFrame& frame, const ran::Mat4f32& view,
+                          const ran::Mat4f32& proj) -> void {
+  auto& vk = _ctx->get_vk();
+  const auto position_addr = _vertex_pool.stream_addr(vk.device(), VERTEX_STREAM_POSITION);
+  const auto uv_addr = _vertex_pool.stream_addr(vk.device(), VERTEX_STREAM_UV);
+  const auto instance_addr = frame.transforms.addr(vk.device());
+  VkPipeline bound_pipeline = VK_NULL_HANDLE;
+  VkPipelineLayout bound_layout = VK_NULL_HANDLE;
+  const auto texture_set = _ctx->get_bindless().set();
+  for (u32 i = 0; i < MAX_MESHES; ++i) {
+    const auto& draw = _mesh_draws[i];
+    if (!draw.instance_count) {
+      continue;
+    }
+    const auto& model_mesh = _meshes[(Mesh)i];
+    if (!vk_upload_done(vk, model_mesh.upload)) {
+      continue;
+    }
+    if (model_mesh.pipeline != bound_pipeline) {
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, model_mesh.pipeline);
+      bound_pipeline = model_mesh.pipeline;
+    }
+    // All textures live in one set, it only needs binding again if the layout changes
+    if (model_mesh.layout != bound_layout) {
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, model_mesh.layout, 0, 1,
+                              &texture_set, 0, nullptr);
+      bound_layout = model_mesh.layout;
+    }
+
+    MeshConstants push_constants;
+    push_constants.view = view;
+    push_constants.proj = proj;
+    push_constants.position_buffer = position_addr;
+    push_constants.uv_buffer = uv_addr;
+    push_constants.instance_buffer = instance_addr;
+    push_constants.texture_index = _ctx->get_image_index(model_mesh.texture);
+    vkCmdPushConstants(cmd, model_mesh.layout,
+                       VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(push_constants), &push_constants);
+    // gl_VertexIndex and gl_InstanceIndex already include the offsets
+    vkCmdDrawIndexed(cmd, model_mesh.indices.count, draw.instance_count,
+                     model_mesh.indices.offset, (i32)model_mesh.vertices.offset,
+                     draw.first_instance);
+    ++_draw_count;
+  }
 }
 
 fn SceneData::render_imgui(const VkFrameContext& frame, f64 dt, f64 alpha) -> void {
@@ -368,7 +770,58 @@ fn SceneData::render_imgui(const VkFrameContext& frame, f64 dt, f64 alpha) -> vo
 #endif
 
   if (ImGui::Begin("meshes")) {
-    _meshes.for_each([&](MeshAsset& mesh) { ImGui::Text("Mesh: %s", mesh.name.c_str()); });
+    if (_indirect.supported) {
+      ImGui::Checkbox("GPU culling", &_indirect.enabled);
+    }
+    if (_indirect.enabled) {
+      ImGui::Text("GPU objects: %u / Meshes: %u", _indirect.object_count,
+                  _indirect.bucket_count);
+    }
+    ImGui::Text("Drawn instances: %u / Culled: %u", _cull_stats.visible,
+                _cull_stats.tested - _cull_stats.visible);
+    ImGui::Text("Vertex pool: %u / %u", _vertex_pool.used(), _vertex_pool.capacity());
+    ImGui::Text("Index pool: %u / %u", _index_pool.used(), _index_pool.capacity());
+    ImGui::Text("Heap allocations last frame: %llu", (unsigned long long)_ctx->get_frame_allocs());
+    _meshes.for_each([&](MeshAsset& mesh) {
+      const bool ready = vk_upload_done(_ctx->get_vk(), mesh.upload);
+      ImGui::Text("Mesh: %s (%u instances)%s", mesh.name.c_str(), mesh.instance_count,
+                  ready ? "" : " (uploading)");
+    });
+  }
+  ImGui::End();
+
+  if (ImGui::Begin("memory")) {
+    const auto heap = alloc_stats();
+    ImGui::Text("Heap: %llu allocations, %.2f MiB total", (unsigned long long)heap.count,
+                heap.bytes / (1024. * 1024.));
+    for (u32 i = 0; i < (u32)MemTag::count; ++i) {
+      const auto stats = mem_tag_stats((MemTag)i);
+      ImGui::Text("%-14s %9.2f MiB (peak %.2f MiB, %llu live)", mem_tag_name((MemTag)i),
+                  stats.current / (1024. * 1024.), stats.peak / (1024. * 1024.),
+                  (unsigned long long)stats.count);
+    }
+  }
+  ImGui::End();
+
+  if (ImGui::Begin("profiler")) {
+    const auto gpu_zones = _ctx->get_gpu_zones();
+    u64 gpu_end = 0;
+    for (const auto& zone : gpu_zones) {
+      gpu_end = std::max(gpu_end, zone.end);
+    }
+    ImGui::Text("GPU frame: %.3fms", gpu_end / 1e6);
+    for (const auto& zone : gpu_zones) {
+      ImGui::Text("  %s: %.3fms", zone.name, (zone.end - zone.begin) / 1e6);
+    }
+#if KA_PROFILE
+    if (ImGui::Button("Dump trace (last 120 frames)")) {
+      profiler::request_dump(120);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Dump trace (everything)")) {
+      profiler::request_dump(0);
+    }
+#endif
   }
   ImGui::End();
 }
@@ -1,10 +1,15 @@
 #pragma once
 
+#include "render/context.hpp"
+#include "render/culling.hpp"
 #include "render/vulkan/vk_buffer.hpp"
 #include "render/vulkan/vk_context.hpp"
+#include "render/vulkan/vk_upload.hpp"
 
 #include <ranmath/ran.hpp>
 
+#include <array>
+
 namespace kappa::render {
 
 class RenderContext;
@@ -17,12 +22,17 @@ public:
 };
 
 struct MeshAsset {
+  // Shared, owned by the RenderContext pipeline cache
   VkPipeline pipeline;
   VkPipelineLayout layout;
-  ran::Mat4f32 transform;
-  VkAllocBuff vertex_buffer;
-  VkAllocBuff index_buffer;
-  u32 index_start, index_count;
+  // Local space, instances carry the transforms
+  ran::Vec3f32 bbox_min, bbox_max;
+  // Ranges in the scene vertex and index pools
+  VkPoolRange vertices;
+  VkPoolRange indices;
+  Image texture;
+  VkUploadTicket upload;
+  u32 instance_count;
   BuffStr<256> name;
 };
 
@@ -32,7 +42,11 @@ private:
 
 public:
   static constexpr u32 MAX_MESHES = 128;
+  static constexpr u32 VERTEX_POOL_CAPACITY = 1u << 18;
+  static constexpr u32 INDEX_POOL_CAPACITY = 1u << 20;
+  static constexpr u32 MAX_GPU_OBJECTS = 1u << 16;
   using Mesh = FreelistSlot;
+  enum class Instance : u32 {};
 
   struct ComputeConstants {
     ran::Vec4f32 data1;
@@ -57,15 +71,54 @@ public:
     Span<const ran::Vec2f32> uvs;
     Span<const ran::Vec3f32> tangents;
     Span<const ran::Vec3f32> bitangents;
+    ran::Vec3f32 bbox_min;
+    ran::Vec3f32 bbox_max;
   };
 
   struct SceneLayouts {
     VkDescriptorSetLayout main_layout;
-    VkDescriptorSetLayout image_layout;
+  };
+
+  // Per frame buffers for both draw paths
+  struct IndirectFrame {
+    VkAllocBuff objects; // Written by the CPU every frame, persistently mapped
+    VkAllocBuff buckets; // A draw command per mesh with a zero count, also mapped
+    VkAllocBuff visible; // Object indices of the GPU survivors, packed per mesh
+    VkAllocBuff draws;
+    VkAllocBuff count;
+    VkAllocBuff transforms; // Instance transforms for the direct path, also mapped
+  };
+
+  using IndirectFrameArray = TypeArrayBuffer<IndirectFrame, MAX_FRAMES_IN_FLIGHT>;
+
+  struct IndirectData {
+    VkPipelineLayout cull_layout;
+    VkPipeline cull_pipeline;
+    VkPipelineLayout draw_layout;
+    VkPipeline draw_pipeline;
+    u32 object_count;
+    u32 bucket_count;
+    bool supported;
+    bool enabled;
+  };
+
+  struct InstanceData {
+    ran::Mat4f32 transform;
+    Mesh mesh;
+    u32 bounds_idx;
+    bool alive;
+  };
+
+  // Range of the frame transform buffer drawn with a mesh
+  struct MeshDraw {
+    u32 first_instance;
+    u32 instance_count;
   };
 
 public:
-  SceneData(create_t, RenderContext& ctx, ComputeData&& compute, SceneLayouts&& layouts);
+  SceneData(create_t, RenderContext& ctx, ComputeData&& compute, SceneLayouts&& layouts,
+            VkBufferPool&& vertex_pool, VkBufferPool&& index_pool, IndirectData&& indirect,
+            IndirectFrame* indirect_frames);
   ~SceneData();
 
 public:
@@ -73,18 +126,62 @@ public:
 
 public:
   fn add_mesh(const MeshData& mesh, std::string_view name) -> Mesh;
+  fn remove_mesh(Mesh mesh) -> void;
+  fn set_mesh_texture(Mesh mesh, Image texture) -> void;
+
+  // Every instance of a mesh gets drawn with a single instanced draw
+  fn add_instance(Mesh mesh, const ran::Mat4f32& transform) -> Instance;
+  fn remove_instance(Instance instance) -> void;
+  fn set_instance_transform(Instance instance, const ran::Mat4f32& transform) -> void;
+
   fn clear() -> void;
 
+  // Squeezes out the holes left by removed meshes
+  fn compact() -> void;
+
 public:
   fn render_geometry(VkImageLayout& target_layout, VkCommandBuffer cmd, f64 dt, f64 alpha)
     -> void override;
   fn render_imgui(const VkFrameContext& frame, f64 dt, f64 alpha) -> void override;
 
+public:
+  fn cull_stats() const -> CullStats { return _cull_stats; }
+
+  // Draw commands recorded last frame, one per mesh. The indirect path counts the meshes sent to
+  // the GPU, the ones it culls entirely don't get drawn
+  fn draw_count() const -> u32 { return _draw_count; }
+
+private:
+  fn write_instances(IndirectFrame& frame) -> void;
+  fn write_objects(IndirectFrame& frame) -> u32;
+  fn cull_objects(VkCommandBuffer cmd, IndirectFrame& frame, const ran::Mat4f32& view_proj)
+    -> void;
+  fn draw_indirect(VkCommandBuffer cmd, IndirectFrame& frame, const ran::Mat4f32& view,
+                   const ran::Mat4f32& proj) -> void;
+  fn draw_direct(VkCommandBuffer cmd, IndirectFrame& frame, const ran::Mat4f32& view,
+                   const ran::Mat4f32& proj) -> void;
+
+  fn allocate_range(VkBufferPool& pool, VkPoolRange MeshAsset::*member, u32 count)
+    -> VkPoolRange;
+  fn compact_pool(VkBufferPool& pool, VkPoolRange MeshAsset::*member, u32 capacity) -> void;
+
 private:
   RenderContext* _ctx;
   ComputeData _compute;
   FixedFreelist<MeshAsset, MAX_MESHES> _meshes;
   SceneLayouts _layouts;
+  VkBufferPool _vertex_pool;
+  VkBufferPool _index_pool;
+  IndirectData _indirect;
+  IndirectFrameArray _indirect_frames;
+  Vec<InstanceData> _instances;
+  Vec<u32> _free_instances;
+  std::array<MeshDraw, MAX_MESHES> _mesh_draws;
+  // World space bounds for every instance
+  AabbSoA _bounds;
+  Vec<u32> _visible;
+  CullStats _cull_stats;
+  u32 _draw_count;
 };
 
 } // namespace kappa::render
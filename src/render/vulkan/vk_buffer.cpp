@@ -3,6 +3,8 @@
 
 #include "./vk_private.hpp"
 
+#include <memory>
+
 namespace kappa::render {
 
 struct VkAllocBuff::Self {
@@ -66,4 +68,134 @@ fn VkAllocBuff::allocation() const -> VkAllocationMem {
   return (VkAllocationMem)self->alloc;
 }
 
+VkBufferPool::VkBufferPool(create_t, VkAllocBuff&& buffer, VkVirtualBlock block,
+                           const VkBufferPoolArgs& args) :
+    _buffer(std::move(buffer)), _block(block), _capacity(args.capacity), _stride(args.stride),
+    _used(0), _usage(args.usage), _streams(args.streams), _stream_offsets(), _stream_count(0) {
+  u32 offset = 0;
+  while (_stream_count < KA_VK_POOL_MAX_STREAMS && _streams[_stream_count]) {
+    _stream_offsets[_stream_count] = offset;
+    offset += _streams[_stream_count++];
+  }
+  if (!_stream_count) {
+    _streams[0] = _stride;
+    _stream_offsets[0] = 0;
+    _stream_count = 1;
+  }
+}
+
+fn VkBufferPool::create(VkMemAllocator alloc, const VkBufferPoolArgs& args)
+  -> VkExpect<VkBufferPool> {
+  ka_assert(args.capacity > 0 && args.stride > 0);
+  if (args.streams[0]) {
+    u32 total = 0;
+    for (const u32 stream : args.streams) {
+      total += stream;
+    }
+    ka_assert(total == args.stride, "Pool streams don't add up to the stride");
+  }
+  const VkBufferArgs buffer_args{
+    .size = (size_t)args.capacity * args.stride,
+    .usage = args.usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    .mem_usage = KA_VK_MEM_USAGE_GPU_ONLY,
+  };
+  auto buffer = VkAllocBuff::create(alloc, buffer_args);
+  if (!buffer) {
+    return {unexpect, buffer.error()};
+  }
+
+  // Work in elements, saves us from non power of two strides
+  VmaVirtualBlockCreateInfo block_info{};
+  block_info.size = args.capacity;
+  VmaVirtualBlock block;
+  if (auto ret = vmaCreateVirtualBlock(&block_info, &block); ret != VK_SUCCESS) {
+    vk_destroy_buffer(alloc, *buffer);
+    return {unexpect, ret};
+  }
+  return {in_place, create_t(), *std::move(buffer), (VkVirtualBlock)block, args};
+}
+
+fn VkBufferPool::allocate(u32 count) -> Optional<VkPoolRange> {
+  if (!count) {
+    return VkPoolRange{nullptr, 0, 0};
+  }
+  VmaVirtualAllocationCreateInfo alloc_info{};
+  alloc_info.size = count;
+  alloc_info.alignment = 1;
+  VmaVirtualAllocation alloc;
+  VkDeviceSize offset;
+  if (vmaVirtualAllocate((VmaVirtualBlock)_block, &alloc_info, &alloc, &offset) != VK_SUCCESS) {
+    return nullopt;
+  }
+  _used += count;
+  return VkPoolRange{(VkVirtualAlloc)alloc, (u32)offset, count};
+}
+
+fn VkBufferPool::free(VkPoolRange& range) -> void {
+  if (range.alloc) {
+    vmaVirtualFree((VmaVirtualBlock)_block, (VmaVirtualAllocation)range.alloc);
+    _used -= range.count;
+  }
+  range = {nullptr, 0, 0};
+}
+
+fn VkBufferPool::compact(VkContext_Impl& vk, Span<VkPoolRange* const> ranges, u32 new_capacity)
+  -> VkExpect<void> {
+  const auto alloc = (VkMemAllocator)vk.vmalloc;
+  ka_assert(new_capacity >= _used);
+  auto pool = VkBufferPool::create(alloc, {new_capacity, _stride, _usage, _streams});
+  if (!pool) {
+    return {unexpect, pool.error()};
+  }
+
+  // The new block is empty, so everything gets placed back to back
+  ScratchScope scratch;
+  ArenaVec<VkPoolRange> packed(scratch.arena());
+  ArenaVec<VkBufferCopy> copies(scratch.arena());
+  packed.reserve(ranges.size());
+  copies.reserve(ranges.size() * _stream_count);
+  for (const auto* range : ranges) {
+    auto new_range = pool->allocate(range->count).value();
+    // Streams move independently, the capacity changes where each one starts
+    for (u32 stream = 0; range->count && stream < _stream_count; ++stream) {
+      VkBufferCopy copy{};
+      copy.srcOffset = byte_offset(*range, stream);
+      copy.dstOffset = pool->byte_offset(new_range, stream);
+      copy.size = (VkDeviceSize)range->count * _streams[stream];
+      copies.push_back(copy);
+    }
+    packed.push_back(new_range);
+  }
+
+  if (!copies.empty()) {
+    auto ret = vk_submit_immediate(vk, [&](VkCommandBuffer cmd) -> void {
+      vkCmdCopyBuffer(cmd, _buffer.buffer(), pool->buffer(), (u32)copies.size(), copies.data());
+    });
+    if (!ret) {
+      pool->destroy(alloc);
+      return {unexpect, ret.error()};
+    }
+  }
+
+  // The old block gets cleared, no need to free each range
+  destroy(alloc);
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    *ranges[i] = packed[i];
+  }
+  std::destroy_at(this);
+  std::construct_at(this, *std::move(pool));
+  return {};
+}
+
+fn VkBufferPool::destroy(VkMemAllocator alloc) -> void {
+  if (!_block) {
+    return;
+  }
+  vmaClearVirtualBlock((VmaVirtualBlock)_block);
+  vmaDestroyVirtualBlock((VmaVirtualBlock)_block);
+  vk_destroy_buffer(alloc, _buffer);
+  _block = nullptr;
+  _used = 0;
+}
+
 } // namespace kappa::render
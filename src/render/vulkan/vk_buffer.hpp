@@ -2,6 +2,8 @@
 
 #include "render/vulkan/vk_common.hpp"
 
+#include <array>
+
 namespace kappa::render {
 
 // Same as VmaMemoryUsage
@@ -51,4 +53,81 @@ private:
 
 fn vk_destroy_buffer(VkMemAllocator alloc, VkAllocBuff::Self& buff) noexcept -> void;
 
+constexpr u32 KA_VK_POOL_MAX_STREAMS = 4;
+
+struct VkBufferPoolArgs {
+  u32 capacity; // In elements
+  u32 stride;
+  VkBufferUsageFlags usage;
+  // Optionally split each element into streams, every stream gets its own array of capacity
+  // entries in the buffer. Leave empty for a single interleaved stream
+  std::array<u32, KA_VK_POOL_MAX_STREAMS> streams{};
+};
+
+// Offset and count are in elements, not bytes
+struct VkPoolRange {
+  VkVirtualAlloc alloc;
+  u32 offset;
+  u32 count;
+};
+
+// Suballocates a single GPU buffer, so many meshes can share one binding
+class VkBufferPool {
+private:
+  struct create_t {};
+
+public:
+  VkBufferPool(create_t, VkAllocBuff&& buffer, VkVirtualBlock block, const VkBufferPoolArgs& args);
+
+public:
+  static fn create(VkMemAllocator alloc, const VkBufferPoolArgs& args) -> VkExpect<VkBufferPool>;
+
+public:
+  fn allocate(u32 count) -> Optional<VkPoolRange>;
+  fn free(VkPoolRange& range) -> void;
+
+  // Packs the live ranges at the start of a new buffer, updating them in place. Nothing can be
+  // using the old buffer on the GPU
+  fn compact(VkContext_Impl& vk, Span<VkPoolRange* const> ranges, u32 new_capacity)
+    -> VkExpect<void>;
+
+  fn destroy(VkMemAllocator alloc) -> void;
+
+public:
+  fn buffer() const -> VkBuffer { return _buffer.buffer(); }
+
+  fn addr(VkDevice device) const -> VkDeviceAddress { return _buffer.addr(device); }
+
+  // Where a stream starts in the buffer, changes when the pool gets compacted
+  fn stream_base(u32 stream) const -> VkDeviceSize {
+    ka_assert(stream < _stream_count);
+    return (VkDeviceSize)_capacity * _stream_offsets[stream];
+  }
+
+  fn stream_addr(VkDevice device, u32 stream) const -> VkDeviceAddress {
+    return addr(device) + stream_base(stream);
+  }
+
+  fn byte_offset(const VkPoolRange& range, u32 stream = 0) const -> VkDeviceSize {
+    return stream_base(stream) + (VkDeviceSize)range.offset * _streams[stream];
+  }
+
+  fn capacity() const -> u32 { return _capacity; }
+
+  fn used() const -> u32 { return _used; }
+
+  fn stride() const -> u32 { return _stride; }
+
+  fn stream_count() const -> u32 { return _stream_count; }
+
+private:
+  VkAllocBuff _buffer;
+  VkVirtualBlock _block;
+  u32 _capacity, _stride, _used;
+  VkBufferUsageFlags _usage;
+  std::array<u32, KA_VK_POOL_MAX_STREAMS> _streams;
+  std::array<u32, KA_VK_POOL_MAX_STREAMS> _stream_offsets; // Per element, scaled by capacity
+  u32 _stream_count;
+};
+
 } // namespace kappa::render
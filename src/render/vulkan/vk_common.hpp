@@ -11,6 +11,8 @@ struct VkContext_Impl;
 typedef struct VkMemAllocator_T* VkMemAllocator;
 typedef struct VkHandle_T* VkHandle;
 typedef struct VkAllocationMem_T* VkAllocationMem;
+typedef struct VkVirtualBlock_T* VkVirtualBlock;
+typedef struct VkVirtualAlloc_T* VkVirtualAlloc;
 
 constexpr size_t MAX_FRAMES_IN_FLIGHT = 2;
 
@@ -2,6 +2,7 @@
 #include "./vk_private.hpp"
 
 #include "./vk_context.hpp"
+#include "profiler.hpp"
 
 namespace kappa::render {
 
@@ -45,7 +46,7 @@ VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
 
   switch (msg_severity) {
     case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
-      log_verbose("[VK_LAYERS][{}] {}", kind, callback_data->pMessage);
+      KA_LOG(verbose, "[VK_LAYERS][{}] {}", kind, callback_data->pMessage);
       break;
     case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
       log_info("[VK_LAYERS][{}] {}", kind, callback_data->pMessage);
@@ -57,7 +58,7 @@ VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
       log_error("[VK_LAYERS][{}] {}", kind, callback_data->pMessage);
       break;
     default:
-      log_verbose("[VK_LAYERS][{}] {}", kind, callback_data->pMessage);
+      KA_LOG(verbose, "[VK_LAYERS][{}] {}", kind, callback_data->pMessage);
       break;
   }
 
@@ -188,6 +189,7 @@ fn create_vma_alloc(VkInstance vk, VkDevice device, VkPhysicalDevice physical_de
   vma_info.device = device;
   vma_info.physicalDevice = physical_device;
   vma_info.vulkanApiVersion = KA_VULKAN_VERSION;
+  vma_info.pAllocationCallbacks = vkalloc;
   vma_info.flags = VMA_ALLOCATOR_CREATE_EXTERNALLY_SYNCHRONIZED_BIT |
                    VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
 
@@ -238,15 +240,19 @@ VkContext_Impl::VkContext_Impl(VkInstance vk_, VkDebugUtilsMessengerEXT messenge
                                VmaAllocator vmalloc_, VkSurfaceKHR surface_,
                                VkContextDevice&& device_, VkSwapchain&& swapchain_,
                                VkFrameData&& framedata_, ImDrawData&& imdrawdata_,
+                               VkUploadQueue&& upload_, VkPipelineCacheData&& pipcache_,
                                VkDelQueue&& delqueue_,
                                Optional<VkUpdateSurfExtFn>&& update_surf_) :
     vk(vk_), messenger(messenger_), vmalloc(vmalloc_), surface(surface_),
     imdrawdata(std::move(imdrawdata_)), device(std::move(device_)),
     swapchain(std::move(swapchain_)), framedata(std::move(framedata_)),
-    delqueue(std::move(delqueue_)), update_surf(std::move(update_surf_)) {}
+    upload(std::move(upload_)), pipcache(std::move(pipcache_)), delqueue(std::move(delqueue_)),
+    update_surf(std::move(update_surf_)) {}
 
 VkContext_Impl::~VkContext_Impl() {
   device.wait_idle();
+  vk_save_pipeline_cache(device.device(), device.physical_device(), pipcache);
+  upload.flush();
   swapchain.destroy(device.device());
   delqueue.flush();
 }
@@ -263,16 +269,20 @@ fn VkContext::create(const VkContextArgs& args) -> VkMsgExpect<VkContext> {
     return {unexpect, _msg, _name.error().code()}; \
   }
 
-  auto surface_data = args.surface.value();
-  Vec<const char*> extensions;
+  const bool headless = !args.surface.has_value();
+  auto surface_data = args.surface;
+  ScratchScope scratch;
+  ArenaVec<const char*> extensions(scratch.arena());
   u32 extension_count = 1;
-  if (!surface_data.extensions.empty()) {
-    extension_count += (u32)surface_data.extensions.size();
+  if (headless) {
+    KA_VK_LOG(debug, "No surface, running headless");
+  } else if (!surface_data->extensions.empty()) {
+    extension_count += (u32)surface_data->extensions.size();
     extensions.reserve(extension_count);
-    KA_VK_LOG(debug, "Required Vulkan surface extensions ({}):", surface_data.extensions.size());
-    for (size_t i = 0; i < surface_data.extensions.size(); ++i) {
-      KA_VK_LOG(debug, "- {}", surface_data.extensions[i]);
-      extensions.push_back(surface_data.extensions[i]);
+    KA_VK_LOG(debug, "Required Vulkan surface extensions ({}):", surface_data->extensions.size());
+    for (size_t i = 0; i < surface_data->extensions.size(); ++i) {
+      KA_VK_LOG(debug, "- {}", surface_data->extensions[i]);
+      extensions.push_back(surface_data->extensions[i]);
     }
   } else {
     KA_VK_LOG(warn, "No Vulkan extensions provided for surface creation");
@@ -301,7 +311,7 @@ fn VkContext::create(const VkContextArgs& args) -> VkMsgExpect<VkContext> {
 #endif
 
   const fn create_surface = [&](VkInstance vk, VkSurfaceKHR* surf) -> VkExpect<void> {
-    const auto res = surface_data.create(vk, surf, vkalloc);
+    const auto res = surface_data->create(vk, surf, vkalloc);
     if (res != VK_SUCCESS || surf == VK_NULL_HANDLE) {
       return {unexpect, res == VK_SUCCESS ? VK_ERROR_INITIALIZATION_FAILED : res};
     }
@@ -309,9 +319,11 @@ fn VkContext::create(const VkContextArgs& args) -> VkMsgExpect<VkContext> {
   };
 
   VkSurfaceKHR surface = VK_NULL_HANDLE;
-  KA_VK_UNEX_CODE(create_surface(vk, &surface), "Failed to create surface");
-  delqueue.enqueue(surface, vk);
-  const auto swapchain_extent = surface_data.swapchain_extent;
+  if (!headless) {
+    KA_VK_UNEX_CODE(create_surface(vk, &surface), "Failed to create surface");
+    delqueue.enqueue(surface, vk);
+  }
+  const auto swapchain_extent = headless ? args.headless_extent : surface_data->swapchain_extent;
 
   KA_VK_UNEX_CODE_RET(device, VkContextDevice::create(vk, surface), "Failed to create device");
   device->add_to_delqueue(delqueue);
@@ -321,8 +333,13 @@ fn VkContext::create(const VkContextArgs& args) -> VkMsgExpect<VkContext> {
   delqueue.enqueue((VkMemAllocator)*vmalloc, device->device());
   const u32 graphics_queue = device->queues().graphics;
 
-  const auto swargs = make_swapchain_args(*device, surface, swapchain_extent);
-  KA_VK_UNEX_CODE_RET(swapchain, VkSwapchain::create(swargs), "Failed to create swapchain");
+  const auto create_swapchain = [&]() -> VkExpect<VkSwapchain> {
+    if (headless) {
+      return {in_place, VkSwapchain::create_headless(swapchain_extent)};
+    }
+    return VkSwapchain::create(make_swapchain_args(*device, surface, swapchain_extent));
+  };
+  KA_VK_UNEX_CODE_RET(swapchain, create_swapchain(), "Failed to create swapchain");
   DeferFn swapchain_err = [&]() {
     swapchain->destroy(device->device());
   };
@@ -337,9 +354,23 @@ fn VkContext::create(const VkContextArgs& args) -> VkMsgExpect<VkContext> {
   delqueue.enqueue(imdraw.cmdpool, device->device());
   delqueue.enqueue(imdraw.fence, device->device());
 
+  KA_VK_UNEX_CODE_RET(upload,
+                      VkUploadQueue::create(device->device(), (VkMemAllocator)*vmalloc,
+                                            device->queues().transfer, graphics_queue),
+                      "Failed to create upload queue");
+  upload->add_to_delqueue(delqueue, (VkMemAllocator)*vmalloc);
+
+  KA_VK_UNEX_CODE_RET(pipcache,
+                      vk_create_pipeline_cache(device->device(), device->physical_device(),
+                                               args.cache_dir),
+                      "Failed to create pipeline cache");
+  delqueue.enqueue(pipcache->cache, device->device());
+
   new (ctx) VkContext_Impl(vk, messenger, *vmalloc, surface, *std::move(device),
                            *std::move(swapchain), *std::move(framedata), std::move(imdraw),
-                           std::move(delqueue), std::move(surface_data.update_extent));
+                           *std::move(upload), *std::move(pipcache), std::move(delqueue),
+                           headless ? Optional<VkUpdateSurfExtFn>{}
+                                    : std::move(surface_data->update_extent));
 
   swapchain_err.disengage();
   ctx_err.disengage();
@@ -367,6 +398,23 @@ fn VkContext::allocator() const -> VkMemAllocator {
   return (VkMemAllocator)_vk->vmalloc;
 }
 
+fn VkContext::is_headless() const -> bool {
+  return _vk->surface == VK_NULL_HANDLE;
+}
+
+fn VkContext::has_draw_indirect_count() const -> bool {
+  return _vk->device.has_draw_indirect_count();
+}
+
+fn VkContext::pipeline_stats() const -> VkPipelineStats {
+  const auto& pipcache = _vk->pipcache;
+  return {
+    .compiled = pipcache.compile_count,
+    .compile_ms = pipcache.compile_ns / 1e6,
+    .warm_cache = pipcache.warm,
+  };
+}
+
 fn vk_rebuild_swapchain(VkContext_Impl& vk, VkExtent2D extent) -> VkExpect<void> {
   const auto swargs = make_swapchain_args(vk.device, vk.surface, extent);
   return VkSwapchain::create(swargs, vk.swapchain.swapchain())
@@ -377,12 +425,14 @@ fn vk_rebuild_swapchain(VkContext_Impl& vk, VkExtent2D extent) -> VkExpect<void>
 }
 
 fn vk_draw_frame_fn(VkContext_Impl& vk, VkFrameFn func) -> VkMsgExpect<void> {
+  KA_PROFILE_ZONE("vk_draw_frame");
   auto& frame = vk.framedata.curr_frame();
   const auto cmd = frame.cmdbuf;
   const auto device = vk.device.device();
   const auto graphics_queue = vk.device.graphics_queue();
   const auto present_queue = vk.device.present_queue();
   auto swapchain = vk.swapchain.swapchain();
+  const bool headless = vk.swapchain.is_headless();
 
   const fn rebuild_swapchain = [&]() -> VkMsgExpect<void> {
     VkExtent2D new_extent{};
@@ -395,13 +445,25 @@ fn vk_draw_frame_fn(VkContext_Impl& vk, VkFrameFn func) -> VkMsgExpect<void> {
   };
 
   // Wait for the previous rendering commands to finish
-  KA_VK_ASSERT(vkWaitForFences(device, 1, &frame.render_fen, true, 1000000000));
-  KA_VK_ASSERT(vkResetFences(device, 1, &frame.render_fen));
+  {
+    KA_PROFILE_ZONE("wait_frame_fence");
+    KA_VK_ASSERT(vkWaitForFences(device, 1, &frame.render_fen, true, 1000000000));
+    KA_VK_ASSERT(vkResetFences(device, 1, &frame.render_fen));
+  }
+
+  // Release staging memory and see which uploads landed, anything drawn this frame is
+  // at most as new as this value
+  vk.upload.collect();
+  const u64 upload_value = vk.upload.completed();
 
   // Acquire swapchain image. Will signal the swapchain semaphore when we acquire an image.
+  // Headless frames only render into the draw target, there's nothing to acquire
   VkResult ret = VK_SUCCESS;
-  ret = vkAcquireNextImageKHR(device, swapchain, 1000000000, frame.swapchain_sem, nullptr,
-                              &frame.swapchain_idx);
+  if (!headless) {
+    KA_PROFILE_ZONE("acquire_image");
+    ret = vkAcquireNextImageKHR(device, swapchain, 1000000000, frame.swapchain_sem, nullptr,
+                                &frame.swapchain_idx);
+  }
   if (ret == VK_ERROR_OUT_OF_DATE_KHR) {
     if (vk.update_surf) {
       if (auto res = rebuild_swapchain(); !res) {
@@ -411,8 +473,10 @@ fn vk_draw_frame_fn(VkContext_Impl& vk, VkFrameFn func) -> VkMsgExpect<void> {
   } else if (ret != VK_SUCCESS && ret != VK_SUBOPTIMAL_KHR) {
     return {unexpect, "Failed to acquire swapchain image", ret};
   }
-  const auto swapchain_image = vk.swapchain.images()[frame.swapchain_idx];
-  const auto swapchain_view = vk.swapchain.image_views()[frame.swapchain_idx];
+  const auto swapchain_image =
+    headless ? VK_NULL_HANDLE : vk.swapchain.images()[frame.swapchain_idx];
+  const auto swapchain_view =
+    headless ? VK_NULL_HANDLE : vk.swapchain.image_views()[frame.swapchain_idx];
   const auto swapchain_extent = vk.swapchain.extent();
 
   //  Initialize command buffer
@@ -432,18 +496,35 @@ fn vk_draw_frame_fn(VkContext_Impl& vk, VkFrameFn func) -> VkMsgExpect<void> {
   KA_VK_ASSERT(vkEndCommandBuffer(cmd));
 
   // Wait until the swapchain semaphore is signaled (when we acquire an image)
-  const auto wait_info = vkmk_semaphore_submit_info(
-    VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, frame.swapchain_sem);
+  // The upload timeline value is already signaled, this just orders the memory accesses
+  std::array<VkSemaphoreSubmitInfo, 2> wait_infos;
+  wait_infos[0] = vkmk_semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+                                             frame.swapchain_sem);
+  wait_infos[1] =
+    vkmk_semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, vk.upload.timeline());
+  wait_infos[1].value = upload_value;
 
   // Signal the render semaphore when the commands finish
   const auto signal_info =
     vkmk_semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, frame.render_sem);
 
   const auto cmdinfo = vkmk_command_buffer_submit_info(cmd);
-  const auto submit = vkmk_submit_info(cmdinfo, &signal_info, &wait_info);
+  auto submit = vkmk_submit_info(cmdinfo, &signal_info, wait_infos.data());
+  submit.waitSemaphoreInfoCount = (u32)wait_infos.size();
+  if (headless) {
+    // Only the uploads to wait for, and nobody is going to wait on the render semaphore
+    submit = vkmk_submit_info(cmdinfo, nullptr, &wait_infos[1]);
+  }
 
   // The render fence will block until the commands finish excecuting (on the next call)
-  KA_VK_ASSERT(vkQueueSubmit2(graphics_queue, 1, &submit, frame.render_fen));
+  {
+    KA_PROFILE_ZONE("queue_submit");
+    KA_VK_ASSERT(vkQueueSubmit2(graphics_queue, 1, &submit, frame.render_fen));
+  }
+  if (headless) {
+    vk.framedata.next_frame();
+    return {};
+  }
 
   auto present_info = vkmk_zero<VkPresentInfoKHR>();
   present_info.pSwapchains = &swapchain;
@@ -454,7 +535,10 @@ fn vk_draw_frame_fn(VkContext_Impl& vk, VkFrameFn func) -> VkMsgExpect<void> {
   present_info.pWaitSemaphores = &frame.render_sem;
   present_info.waitSemaphoreCount = 1;
 
-  ret = vkQueuePresentKHR(present_queue, &present_info);
+  {
+    KA_PROFILE_ZONE("queue_present");
+    ret = vkQueuePresentKHR(present_queue, &present_info);
+  }
   vk.framedata.next_frame();
   if (ret == VK_ERROR_OUT_OF_DATE_KHR || ret == VK_SUBOPTIMAL_KHR) {
     return vk.update_surf ? rebuild_swapchain()
@@ -19,9 +19,17 @@ struct VkSurfaceArgs {
 };
 
 struct VkContextArgs {
-  Optional<VkSurfaceArgs> surface;
+  Optional<VkSurfaceArgs> surface; // nullopt to run headless, without presenting anything
   const char* app_name;
   u32 app_ver;
+  const char* cache_dir;      // nullptr to skip the on-disk pipeline cache
+  VkExtent2D headless_extent; // Frame extent when there's no surface
+};
+
+struct VkPipelineStats {
+  u32 compiled;
+  f64 compile_ms;
+  bool warm_cache;
 };
 
 class VkContext {
@@ -37,6 +45,9 @@ public:
   fn device() const -> VkDevice;
   fn physical_device() const -> VkPhysicalDevice;
   fn allocator() const -> VkMemAllocator;
+  fn pipeline_stats() const -> VkPipelineStats;
+  fn is_headless() const -> bool;
+  fn has_draw_indirect_count() const -> bool;
 
 public:
   VkContext_Impl& get() { return *_vk; }
@@ -51,6 +62,7 @@ fn vk_destroy_context(VkContext_Impl& vk) noexcept -> void;
 
 fn vk_rebuild_swapchain(VkContext_Impl& vk, VkExtent2D extent) -> VkExpect<void>;
 
+// The swapchain image and view are null when headless
 struct VkFrameContext {
   VkCommandBuffer cmd;
   VkImage swapchain_image;
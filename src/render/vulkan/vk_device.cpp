@@ -14,23 +14,36 @@ constexpr auto base_device_extensions = std::to_array<const char*>({
   VK_KHR_DEVICE_GROUP_EXTENSION_NAME,
 });
 
+// Nothing gets presented, lavapipe on a box without a display is fine
+constexpr auto headless_device_extensions = std::to_array<const char*>({
+  VK_KHR_DEVICE_GROUP_EXTENSION_NAME,
+});
+
 } // namespace
 
 VkContextDevice::VkContextDevice(create_t, VkDevice device, VkPhysicalDevice physical_device,
                                  QueueIndices queues, Vec<VkSurfaceFormatKHR>&& surface_formats,
-                                 Vec<VkPresentModeKHR>&& surface_present_modes) :
+                                 Vec<VkPresentModeKHR>&& surface_present_modes,
+                                 bool draw_indirect_count) :
     _device(device), _physical_device(physical_device), _queues(queues),
     _surface_formats(std::move(surface_formats)),
-    _surface_present_modes(std::move(surface_present_modes)) {
+    _surface_present_modes(std::move(surface_present_modes)),
+    _draw_indirect_count(draw_indirect_count) {
   ka_assert(_device != VK_NULL_HANDLE);
   ka_assert(_physical_device != VK_NULL_HANDLE);
-  ka_assert(!_surface_formats.empty());
-  ka_assert(!_surface_present_modes.empty());
+  // Both empty when headless
+  ka_assert(_surface_formats.empty() == _surface_present_modes.empty());
 }
 
 fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkContextDevice> {
   ka_assert(vk != VK_NULL_HANDLE);
-  ka_assert(surface != VK_NULL_HANDLE);
+  // No surface means headless, the device doesn't need to present anything
+  const bool headless = surface == VK_NULL_HANDLE;
+  const Span<const char* const> device_extensions =
+    headless
+      ? Span<const char* const>{headless_device_extensions.data(),
+                                headless_device_extensions.size()}
+      : Span<const char* const>{base_device_extensions.data(), base_device_extensions.size()};
 
   u32 device_count{};
   VkResult res = vkEnumeratePhysicalDevices(vk, &device_count, nullptr);
@@ -50,6 +63,9 @@ fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkCo
     queue_families.resize(queue_family_count);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families.data());
 
+    graphics = nullopt;
+    present = nullopt;
+    transfer = nullopt;
     for (u32 i = 0; const auto& family : queue_families) {
       // Require a device with a queue family that supports graphics commands
       if (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
@@ -68,8 +84,11 @@ fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkCo
 
       // Require a device with a queue family that supports presentation
       // (might not be the same queue as the graphics one, so we store another index)
-      VkBool32 present_support{false};
-      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+      // Headless just takes the graphics family
+      VkBool32 present_support = headless && (family.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+      if (!headless) {
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+      }
       if (present_support) {
         present.emplace(i);
       }
@@ -80,6 +99,12 @@ fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkCo
 
       ++i;
     }
+
+    // No dedicated transfer family, uploads will go through the graphics queue
+    if (graphics.has_value() && present.has_value()) {
+      transfer.emplace(graphics.value());
+      return true;
+    }
     return false;
   };
 
@@ -94,7 +119,7 @@ fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkCo
 
     // auto required_extensions = make_scratch_set<std::string_view>(arena);
     std::unordered_set<std::string_view> required_extensions;
-    required_extensions.insert(base_device_extensions.begin(), base_device_extensions.end());
+    required_extensions.insert(device_extensions.begin(), device_extensions.end());
     for (const auto& ext : avail_ext) {
       required_extensions.erase(ext.extensionName);
     }
@@ -108,6 +133,9 @@ fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkCo
     // Get supported formats and present modes from a device
     swapchain_formats.clear();
     swapchain_formats.clear();
+    if (headless) {
+      return true;
+    }
 
     VkSurfaceCapabilitiesKHR caps;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &caps);
@@ -131,6 +159,19 @@ fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkCo
     return swapchain_adequate;
   };
 
+  auto avail_vk12feats = vkmk_zero<VkPhysicalDeviceVulkan12Features>();
+  const fn check_feature_support = [&](VkPhysicalDevice device) -> bool {
+    avail_vk12feats = vkmk_zero<VkPhysicalDeviceVulkan12Features>();
+    auto feats = vkmk_zero<VkPhysicalDeviceFeatures2>(&avail_vk12feats);
+    vkGetPhysicalDeviceFeatures2(device, &feats);
+
+    // drawIndirectCount is optional, the scene falls back to direct draws without it
+    return avail_vk12feats.bufferDeviceAddress && avail_vk12feats.descriptorIndexing &&
+           avail_vk12feats.timelineSemaphore && avail_vk12feats.descriptorBindingPartiallyBound &&
+           avail_vk12feats.descriptorBindingSampledImageUpdateAfterBind &&
+           avail_vk12feats.descriptorBindingUpdateUnusedWhilePending;
+  };
+
   Vec<VkPhysicalDevice> devices;
   devices.resize(device_count);
   vkEnumeratePhysicalDevices(vk, &device_count, devices.data());
@@ -141,7 +182,8 @@ fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkCo
     const bool has_queue_indices = find_queue_indices(dev);
     const bool ext_supported = check_extension_support(dev);
     const bool swapchain_adequate = query_swapchain_support(dev);
-    if (has_queue_indices && ext_supported && swapchain_adequate) {
+    const bool feats_supported = check_feature_support(dev);
+    if (has_queue_indices && ext_supported && swapchain_adequate && feats_supported) {
       physical_device = dev;
       break;
     }
@@ -181,6 +223,12 @@ fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkCo
   auto vk12feats = vkmk_zero<VkPhysicalDeviceVulkan12Features>(&vk13feats);
   vk12feats.bufferDeviceAddress = true;
   vk12feats.descriptorIndexing = true;
+  vk12feats.timelineSemaphore = true;
+  vk12feats.drawIndirectCount = avail_vk12feats.drawIndirectCount;
+  // For the bindless texture table
+  vk12feats.descriptorBindingPartiallyBound = true;
+  vk12feats.descriptorBindingSampledImageUpdateAfterBind = true;
+  vk12feats.descriptorBindingUpdateUnusedWhilePending = true;
 
   // Which physical device features are we going to use?
   VkPhysicalDeviceFeatures features{}; // all VK_FALSE for now
@@ -192,8 +240,8 @@ fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkCo
   create_info.pNext = &vk12feats;
 
   // Specify extensions and validation layers (device specific this time)
-  create_info.enabledExtensionCount = static_cast<u32>(base_device_extensions.size());
-  create_info.ppEnabledExtensionNames = base_device_extensions.data();
+  create_info.enabledExtensionCount = static_cast<u32>(device_extensions.size());
+  create_info.ppEnabledExtensionNames = device_extensions.data();
 
 #ifndef NDEBUG
   create_info.enabledLayerCount = static_cast<u32>(validation_layers.size());
@@ -215,7 +263,8 @@ fn VkContextDevice::create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkCo
           physical_device,
           QueueIndices(graphics.value(), present.value(), transfer.value()),
           std::move(swapchain_formats),
-          std::move(swapchain_present_modes)};
+          std::move(swapchain_present_modes),
+          (bool)avail_vk12feats.drawIndirectCount};
 }
 
 fn VkContextDevice::add_to_delqueue(VkDelQueue& queue) -> void {
@@ -16,7 +16,7 @@ public:
 public:
   VkContextDevice(create_t, VkDevice device, VkPhysicalDevice physical_device, QueueIndices queues,
                   Vec<VkSurfaceFormatKHR>&& surface_formats,
-                  Vec<VkPresentModeKHR>&& surface_present_modes);
+                  Vec<VkPresentModeKHR>&& surface_present_modes, bool draw_indirect_count);
 
 public:
   static fn create(VkInstance vk, VkSurfaceKHR surface) -> VkExpect<VkContextDevice>;
@@ -33,6 +33,9 @@ public:
 
   fn queues() const -> QueueIndices { return _queues; }
 
+  // Optional, the GPU driven draw path needs it
+  fn has_draw_indirect_count() const -> bool { return _draw_indirect_count; }
+
   fn surface_formats() const -> Span<const VkSurfaceFormatKHR> {
     return {_surface_formats.data(), _surface_formats.size()};
   }
@@ -51,6 +54,7 @@ private:
   QueueIndices _queues;
   Vec<VkSurfaceFormatKHR> _surface_formats;
   Vec<VkPresentModeKHR> _surface_present_modes;
+  bool _draw_indirect_count;
 };
 
 } // namespace kappa::render
@@ -4,11 +4,17 @@
 #include "./vk_util.hpp"
 #include <vulkan/vulkan_core.h>
 
+#include <bit>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
 namespace kappa::render {
 
 fn VkDescAlloc::create(VkDevice device, u32 max_sets, Span<const VkDescPoolRatio> ratios)
   -> VkExpect<VkDescAlloc> {
-  Vec<VkDescriptorPoolSize> pool_sizes;
+  ScratchScope scratch;
+  ArenaVec<VkDescriptorPoolSize> pool_sizes(scratch.arena());
   pool_sizes.reserve(ratios.size());
   for (const auto& [type, ratio] : ratios) {
     pool_sizes.push_back(VkDescriptorPoolSize{
@@ -58,7 +64,9 @@ fn dyn_desc_create_pool(VkDevice device, u32 set_count, Span<const VkDescPoolRat
   -> VkExpect<VkDescriptorPool> {
   ka_assert(device != VK_NULL_HANDLE);
 
-  Vec<VkDescriptorPoolSize> pool_sizes;
+  // Called whenever the frame allocators run out of sets, keep it off the heap
+  ScratchScope scratch;
+  ArenaVec<VkDescriptorPoolSize> pool_sizes(scratch.arena());
   pool_sizes.reserve(ratios.size());
   for (const auto& [type, ratio] : ratios) {
     VkDescriptorPoolSize size{};
@@ -172,7 +180,8 @@ VkGfxPipelineBuilder::VkGfxPipelineBuilder() {
   clear();
 }
 
-VkDescWriter::VkDescWriter(VkDevice device) : _device(device) {}
+VkDescWriter::VkDescWriter(VkDevice device, LinearArena& arena) :
+    _device(device), _image_infos(arena), _buff_infos(arena), _writes(arena) {}
 
 fn VkDescWriter::write_image(i32 binding, VkImageView view, VkImageLayout layout,
                              VkSampler sampler, VkDescImageType type) -> void {
@@ -211,6 +220,82 @@ fn VkDescWriter::update_set(VkDescriptorSet set) -> void {
   vkUpdateDescriptorSets(_device, (u32)_writes.size(), _writes.data(), 0, nullptr);
 }
 
+VkBindlessTable::VkBindlessTable(create_t, VkDevice device, VkDescriptorPool pool,
+                                 VkDescriptorSetLayout layout, VkDescriptorSet set,
+                                 u32 max_images) :
+    _device(device), _pool(pool), _layout(layout), _set(set), _max_images(max_images) {}
+
+fn VkBindlessTable::create(VkContext_Impl& vk, u32 max_images) -> VkExpect<VkBindlessTable> {
+  const auto device = vk.device.device();
+
+  // Slots get rewritten while frames are in flight, and most of them stay empty
+  const VkDescriptorBindingFlags binding_flags =
+    VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+    VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+  auto flags_info = vkmk_zero<VkDescriptorSetLayoutBindingFlagsCreateInfo>();
+  flags_info.bindingCount = 1;
+  flags_info.pBindingFlags = &binding_flags;
+
+  VkDescLayoutBuilder builder;
+  auto layout =
+    builder.add_binding(BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, max_images)
+      .build(vk, VK_SHADER_STAGE_FRAGMENT_BIT, &flags_info,
+             VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+  if (!layout) {
+    return {unexpect, layout.error()};
+  }
+  DeferFn layout_err = [&]() {
+    vkDestroyDescriptorSetLayout(device, *layout, vkalloc);
+  };
+
+  VkDescriptorPoolSize pool_size{};
+  pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  pool_size.descriptorCount = max_images;
+  auto pool_info = vkmk_zero<VkDescriptorPoolCreateInfo>();
+  pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+  pool_info.maxSets = 1;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  VkDescriptorPool pool;
+  KA_VK_UNEX(vkCreateDescriptorPool(device, &pool_info, vkalloc, &pool));
+  DeferFn pool_err = [&]() {
+    vkDestroyDescriptorPool(device, pool, vkalloc);
+  };
+
+  auto alloc_info = vkmk_zero<VkDescriptorSetAllocateInfo>();
+  alloc_info.descriptorPool = pool;
+  alloc_info.descriptorSetCount = 1;
+  alloc_info.pSetLayouts = &*layout;
+  VkDescriptorSet set;
+  KA_VK_UNEX(vkAllocateDescriptorSets(device, &alloc_info, &set));
+
+  pool_err.disengage();
+  layout_err.disengage();
+  return {in_place, create_t(), device, pool, *layout, set, max_images};
+}
+
+fn VkBindlessTable::add_to_delqueue(VkDelQueue& queue) -> void {
+  queue.enqueue(_layout, _device);
+  queue.enqueue(_pool, _device);
+}
+
+fn VkBindlessTable::write_image(u32 index, VkImageView view, VkSampler sampler) -> void {
+  ka_assert(index < _max_images);
+  VkDescriptorImageInfo info{};
+  info.sampler = sampler;
+  info.imageView = view;
+  info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  auto write = vkmk_zero<VkWriteDescriptorSet>();
+  write.dstSet = _set;
+  write.dstBinding = BINDING;
+  write.dstArrayElement = index;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &info;
+  vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+}
+
 namespace {
 
 fn stage_idx(VkShaderStageFlagBits stage) -> u32 {
@@ -254,6 +339,28 @@ fn collect_stages(
 
 } // namespace
 
+namespace {
+
+using PipelineClock = std::chrono::steady_clock;
+
+fn track_compile(VkPipelineCacheData& data, PipelineClock::time_point start) -> void {
+  const auto elapsed = PipelineClock::now() - start;
+  data.compile_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  ++data.compile_count;
+}
+
+// Length first, so different splits of the same bytes don't compare equal
+fn push_key_bytes(VkBuilderKey& key, const void* data, size_t size) -> void {
+  key.push_back(size);
+  const size_t start = key.size();
+  key.resize(start + (size + sizeof(u64) - 1) / sizeof(u64), 0);
+  if (size) {
+    std::memcpy(key.data() + start, data, size);
+  }
+}
+
+} // namespace
+
 fn VkGfxPipelineBuilder::build(VkContext_Impl& vk) -> VkExpect<VkPipeline> {
   // Dynamic viewport & scissor
   static constexpr auto dynamic_state =
@@ -292,11 +399,53 @@ fn VkGfxPipelineBuilder::build(VkContext_Impl& vk) -> VkExpect<VkPipeline> {
   pipeline_info.pDynamicState = &dynamic_info;
 
   VkPipeline pipeline;
-  KA_VK_UNEX(vkCreateGraphicsPipelines(vk.device.device(), VK_NULL_HANDLE, 1, &pipeline_info,
+  const auto start = PipelineClock::now();
+  KA_VK_UNEX(vkCreateGraphicsPipelines(vk.device.device(), vk.pipcache.cache, 1, &pipeline_info,
                                        vkalloc, &pipeline));
+  track_compile(vk.pipcache, start);
   return {in_place, pipeline};
 }
 
+fn VkGfxPipelineBuilder::key() const -> VkBuilderKey {
+  VkBuilderKey key;
+  const fn mix = [&](u64 value) {
+    key.push_back(value);
+  };
+  for (const auto& [shader, entrypoint] : _shader_stages) {
+    mix((u64)shader);
+    push_key_bytes(key, entrypoint, entrypoint ? std::strlen(entrypoint) : 0);
+  }
+  mix(_input_assembly.topology);
+  mix(_input_assembly.primitiveRestartEnable);
+
+  mix(_rasterizer.polygonMode);
+  mix(_rasterizer.cullMode);
+  mix(_rasterizer.frontFace);
+  mix(std::bit_cast<u32>(_rasterizer.lineWidth));
+
+  // No padding in there, and it gets memset on clear()
+  push_key_bytes(key, &_blend_attachment, sizeof(_blend_attachment));
+
+  mix(_multisampling.rasterizationSamples);
+  mix(_multisampling.sampleShadingEnable);
+  mix(std::bit_cast<u32>(_multisampling.minSampleShading));
+  mix(_multisampling.alphaToCoverageEnable);
+  mix(_multisampling.alphaToOneEnable);
+
+  mix(_depth_stencil.depthTestEnable);
+  mix(_depth_stencil.depthWriteEnable);
+  mix(_depth_stencil.depthCompareOp);
+  mix(_depth_stencil.depthBoundsTestEnable);
+  mix(_depth_stencil.stencilTestEnable);
+
+  mix((u64)_layout);
+  mix(_rendering_info.colorAttachmentCount);
+  mix(_rendering_info.colorAttachmentCount ? _color_format : VK_FORMAT_UNDEFINED);
+  mix(_rendering_info.depthAttachmentFormat);
+  mix(_rendering_info.stencilAttachmentFormat);
+  return key;
+}
+
 fn VkGfxPipelineBuilder::clear() -> void {
   _input_assembly = vkmk_zero<decltype(_input_assembly)>();
   _rasterizer = vkmk_zero<decltype(_rasterizer)>();
@@ -460,7 +609,7 @@ fn VkDescLayoutBuilder::build(VkContext_Impl& vk, VkShaderStageFlags stages, voi
   info.flags = flags;
 
   VkDescriptorSetLayout set;
-  KA_VK_UNEX(vkCreateDescriptorSetLayout(vk.device.device(), &info, nullptr, &set));
+  KA_VK_UNEX(vkCreateDescriptorSetLayout(vk.device.device(), &info, vkalloc, &set));
   return {in_place, set};
 }
 
@@ -468,10 +617,11 @@ fn VkDescLayoutBuilder::clear() -> void {
   _bindings.clear();
 }
 
-fn VkDescLayoutBuilder::add_binding(u32 binding, VkDescriptorType type) -> VkDescLayoutBuilder& {
+fn VkDescLayoutBuilder::add_binding(u32 binding, VkDescriptorType type, u32 count)
+  -> VkDescLayoutBuilder& {
   VkDescriptorSetLayoutBinding bind{};
   bind.binding = binding;
-  bind.descriptorCount = 1;
+  bind.descriptorCount = count;
   bind.descriptorType = type;
   _bindings.push_back(bind);
   return *this;
@@ -506,6 +656,15 @@ fn VkPipelineLayoutBuilder::clear() -> void {
   _con_range.clear();
 }
 
+fn VkPipelineLayoutBuilder::key() const -> VkBuilderKey {
+  VkBuilderKey key;
+  push_key_bytes(key, _con_range.data(), _con_range.size() * sizeof(VkPushConstantRange));
+  for (const auto layout : _set_layouts) {
+    key.push_back((u64)layout);
+  }
+  return key;
+}
+
 fn VkPipelineLayoutBuilder::add_push_range(VkShaderStageFlags flags, u32 size, u32 offset)
   -> VkPipelineLayoutBuilder& {
   VkPushConstantRange range{};
@@ -544,9 +703,221 @@ fn vk_create_compute_pipeline(VkContext_Impl& vk, VkPipelineLayout layout, VkSha
   compute_info.stage = stage_info;
 
   VkPipeline pip;
-  KA_VK_UNEX(
-    vkCreateComputePipelines(vk.device.device(), VK_NULL_HANDLE, 1, &compute_info, vkalloc, &pip));
+  const auto start = PipelineClock::now();
+  KA_VK_UNEX(vkCreateComputePipelines(vk.device.device(), vk.pipcache.cache, 1, &compute_info,
+                                      vkalloc, &pip));
+  track_compile(vk.pipcache, start);
   return {in_place, pip};
 }
 
+namespace {
+
+// Same layout as VkPipelineCacheHeaderVersionOne
+struct PipelineCacheHeader {
+  u32 header_size;
+  u32 header_version;
+  u32 vendor_id;
+  u32 device_id;
+  u8 uuid[VK_UUID_SIZE];
+};
+
+fn check_cache_header(const VkPhysicalDeviceProperties& props, Span<const u8> data) -> bool {
+  if (data.size() < sizeof(PipelineCacheHeader)) {
+    return false;
+  }
+  PipelineCacheHeader header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  return header.header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendor_id == props.vendorID && header.device_id == props.deviceID &&
+         std::memcmp(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+fn load_cache_file(VkDevice device, const char* path, VkPhysicalDeviceProperties* props,
+                   bool* loaded = nullptr) -> VkExpect<VkPipelineCache> {
+  MappedFile data;
+  if (path) {
+    data = MappedFile::open(path);
+  }
+  auto cache_info = vkmk_zero<VkPipelineCacheCreateInfo>();
+  if (props && !data.empty() && check_cache_header(*props, data.span())) {
+    cache_info.initialDataSize = data.size();
+    cache_info.pInitialData = data.data();
+  } else if (!data.empty()) {
+    KA_VK_LOG(warn, "Discarding incompatible pipeline cache \"{}\"", path);
+  }
+  if (loaded) {
+    *loaded = cache_info.initialDataSize > 0;
+  }
+  VkPipelineCache cache;
+  KA_VK_UNEX(vkCreatePipelineCache(device, &cache_info, vkalloc, &cache));
+  return {in_place, cache};
+}
+
+} // namespace
+
+fn vk_create_pipeline_cache(VkDevice device, VkPhysicalDevice physical_device,
+                            const char* cache_dir) -> VkExpect<VkPipelineCacheData> {
+  VkPipelineCacheData data{};
+  if (!cache_dir) {
+    KA_VK_LOG(debug, "No cache directory provided, pipeline cache won't be persisted");
+    auto cache = load_cache_file(device, nullptr, nullptr);
+    if (!cache) {
+      return {unexpect, cache.error()};
+    }
+    data.cache = *cache;
+    return {in_place, data};
+  }
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(physical_device, &props);
+
+  // The driver rejects foreign blobs anyway, but keying the file name avoids having
+  // two devices fighting over the same one
+  char uuid[2 * VK_UUID_SIZE + 1];
+  for (u32 i = 0; i < VK_UUID_SIZE; ++i) {
+    fmt::format_to_n(&uuid[2 * i], 2, "{:02x}", props.pipelineCacheUUID[i]);
+  }
+  uuid[2 * VK_UUID_SIZE] = '\0';
+  data.path.format_from("{}/pipelines_{:04x}_{:04x}_{:08x}_{}.bin", cache_dir, props.vendorID,
+                        props.deviceID, props.driverVersion, uuid);
+
+  std::error_code err;
+  std::filesystem::create_directories(cache_dir, err);
+  if (err) {
+    KA_VK_LOG(warn, "Failed to create cache directory \"{}\": {}", cache_dir, err.message());
+  }
+
+  auto cache = load_cache_file(device, data.path.c_str(), &props, &data.warm);
+  if (!cache) {
+    return {unexpect, cache.error()};
+  }
+  data.cache = *cache;
+  KA_VK_LOG(debug, "Pipeline cache \"{}\" ({})", data.path.c_str(), data.warm ? "warm" : "cold");
+  return {in_place, data};
+}
+
+fn vk_save_pipeline_cache(VkDevice device, VkPhysicalDevice physical_device,
+                          VkPipelineCacheData& data) -> void {
+  if (data.cache == VK_NULL_HANDLE || !data.path.len) {
+    return;
+  }
+  KA_VK_LOG(debug, "Compiled {} pipelines in {:.3f}ms ({} cache)", data.compile_count,
+            data.compile_ns / 1e6, data.warm ? "warm" : "cold");
+
+  // Pick up whatever another instance might have written since we started
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(physical_device, &props);
+  if (auto disk_cache = load_cache_file(device, data.path.c_str(), &props); disk_cache) {
+    vkMergePipelineCaches(device, data.cache, 1, &*disk_cache);
+    vkDestroyPipelineCache(device, *disk_cache, vkalloc);
+  }
+
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device, data.cache, &size, nullptr) != VK_SUCCESS || !size) {
+    return;
+  }
+  auto blob = make_unique_array<u8>(uninitialized, size);
+  if (vkGetPipelineCacheData(device, data.cache, &size, blob.data()) != VK_SUCCESS) {
+    KA_VK_LOG(warn, "Failed to retrieve pipeline cache data");
+    return;
+  }
+
+  // Write to a temp file first, so a crash can't leave a truncated cache behind
+  const auto tmp_path = buffer_str_fmt<520>("{}.tmp", data.path.as_view());
+  {
+    std::ofstream file(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      KA_VK_LOG(warn, "Failed to open \"{}\" for writing", tmp_path.c_str());
+      return;
+    }
+    file.write((const char*)blob.data(), (std::streamsize)size);
+    if (!file) {
+      KA_VK_LOG(warn, "Failed to write pipeline cache");
+      return;
+    }
+  }
+  std::error_code err;
+  std::filesystem::rename(tmp_path.c_str(), data.path.c_str(), err);
+  if (err) {
+    KA_VK_LOG(warn, "Failed to save pipeline cache: {}", err.message());
+    return;
+  }
+  KA_VK_LOG(debug, "Saved pipeline cache ({} bytes)", size);
+}
+
+fn VkShaderCache::get_shader(VkContext_Impl& vk, const char* path) -> VkExpect<VkShaderModule> {
+  ka_assert(path);
+  std::string key{path};
+  if (auto it = _shaders.find(key); it != _shaders.end()) {
+    return {in_place, it->second};
+  }
+
+  // SPIR-V only needs 4 byte alignment, mappings are page aligned and the read fallback buffer
+  // comes from the heap
+  const auto src = MappedFile::open(path);
+  if (src.empty()) {
+    KA_VK_LOG(error, "Failed to load shader source \"{}\"", path);
+    return {unexpect, VK_ERROR_INITIALIZATION_FAILED};
+  }
+  auto shader = vk_create_shader(vk, src.span());
+  if (!shader) {
+    return {unexpect, shader.error()};
+  }
+  KA_VK_LOG(verbose, "Cached shader module \"{}\"", path);
+  _shaders.emplace(std::move(key), *shader);
+  return shader;
+}
+
+fn VkShaderCache::destroy(VkContext_Impl& vk) -> void {
+  for (auto& [_, shader] : _shaders) {
+    vk_destroy_shader(vk, shader);
+  }
+  _shaders.clear();
+}
+
+fn VkGfxPipelineCache::get_layout(VkContext_Impl& vk, VkPipelineLayoutBuilder& builder,
+                                  VkPipelineLayoutCreateFlags flags)
+  -> VkExpect<VkPipelineLayout> {
+  auto key = builder.key();
+  key.push_back(flags);
+  if (auto it = _layouts.find(key); it != _layouts.end()) {
+    return {in_place, it->second};
+  }
+
+  auto layout = builder.build(vk, flags);
+  if (!layout) {
+    return {unexpect, layout.error()};
+  }
+  _layouts.emplace(std::move(key), *layout);
+  return layout;
+}
+
+fn VkGfxPipelineCache::get_pipeline(VkContext_Impl& vk, VkGfxPipelineBuilder& builder)
+  -> VkExpect<VkPipeline> {
+  auto key = builder.key();
+  if (auto it = _pipelines.find(key); it != _pipelines.end()) {
+    return {in_place, it->second};
+  }
+
+  auto pipeline = builder.build(vk);
+  if (!pipeline) {
+    return {unexpect, pipeline.error()};
+  }
+  KA_VK_LOG(verbose, "Cached graphics pipeline {:#018x} ({} total)", VkBuilderKeyHash{}(key),
+            _pipelines.size() + 1);
+  _pipelines.emplace(std::move(key), *pipeline);
+  return pipeline;
+}
+
+fn VkGfxPipelineCache::destroy(VkContext_Impl& vk) -> void {
+  for (auto& [_, pipeline] : _pipelines) {
+    vk_destroy_pipeline(vk, pipeline);
+  }
+  for (auto& [_, layout] : _layouts) {
+    vk_destroy_pipeline_layout(vk, layout);
+  }
+  _pipelines.clear();
+  _layouts.clear();
+}
+
 } // namespace kappa::render
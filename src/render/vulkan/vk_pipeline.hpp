@@ -5,9 +5,13 @@
 #include <vulkan/vulkan_core.h>
 
 #include <array>
+#include <string>
+#include <unordered_map>
 
 namespace kappa::render {
 
+class VkDelQueue;
+
 class VkDescLayoutBuilder {
 public:
   VkDescLayoutBuilder();
@@ -18,7 +22,7 @@ public:
   fn clear() -> void;
 
 public:
-  fn add_binding(u32 binding, VkDescriptorType type) -> VkDescLayoutBuilder&;
+  fn add_binding(u32 binding, VkDescriptorType type, u32 count = 1) -> VkDescLayoutBuilder&;
 
 private:
   Vec<VkDescriptorSetLayoutBinding> _bindings;
@@ -93,9 +97,10 @@ enum VkDescBuffType {
   KA_VK_DESC_BUFF_TYPE_STORAGE_DYN = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
 };
 
+// Keeps the write lists in an arena, usually the frame or scratch one
 class VkDescWriter {
 public:
-  VkDescWriter(VkDevice device);
+  VkDescWriter(VkDevice device, LinearArena& arena);
 
 public:
   fn write_buffer(i32 binding, VkBuffer buffer, size_t size, size_t offset, VkDescBuffType type)
@@ -128,9 +133,52 @@ public:
 
 private:
   VkDevice _device;
-  Deque<VkDescriptorImageInfo> _image_infos;
-  Deque<VkDescriptorBufferInfo> _buff_infos;
-  Vec<VkWriteDescriptorSet> _writes;
+  ArenaDeque<VkDescriptorImageInfo> _image_infos;
+  ArenaDeque<VkDescriptorBufferInfo> _buff_infos;
+  ArenaVec<VkWriteDescriptorSet> _writes;
+};
+
+// A single descriptor set holding every texture, bound once and indexed from the shaders
+class VkBindlessTable {
+private:
+  struct create_t {};
+
+public:
+  static constexpr u32 BINDING = 0;
+
+public:
+  VkBindlessTable(create_t, VkDevice device, VkDescriptorPool pool, VkDescriptorSetLayout layout,
+                  VkDescriptorSet set, u32 max_images);
+
+public:
+  static fn create(VkContext_Impl& vk, u32 max_images) -> VkExpect<VkBindlessTable>;
+
+public:
+  fn add_to_delqueue(VkDelQueue& queue) -> void;
+  fn write_image(u32 index, VkImageView view, VkSampler sampler) -> void;
+
+public:
+  fn layout() const -> VkDescriptorSetLayout { return _layout; }
+
+  fn set() const -> VkDescriptorSet { return _set; }
+
+  fn max_images() const -> u32 { return _max_images; }
+
+private:
+  VkDevice _device;
+  VkDescriptorPool _pool;
+  VkDescriptorSetLayout _layout;
+  VkDescriptorSet _set;
+  u32 _max_images;
+};
+
+// Builder state flattened into words, equal keys build equal objects
+using VkBuilderKey = Vec<u64>;
+
+struct VkBuilderKeyHash {
+  fn operator()(const VkBuilderKey& key) const -> size_t {
+    return hash_bytes(key.data(), key.size() * sizeof(u64));
+  }
 };
 
 fn vk_create_shader(VkContext_Impl& vk, Span<const u8> src) -> VkExpect<VkShaderModule>;
@@ -144,6 +192,7 @@ public:
   fn build(VkContext_Impl& vk, VkPipelineLayoutCreateFlags flags = 0)
     -> VkExpect<VkPipelineLayout>;
   fn clear() -> void;
+  fn key() const -> VkBuilderKey;
 
 public:
   fn add_push_range(VkShaderStageFlags flags, u32 size, u32 offset) -> VkPipelineLayoutBuilder&;
@@ -183,6 +232,7 @@ public:
 public:
   fn build(VkContext_Impl& ctx) -> VkExpect<VkPipeline>;
   fn clear() -> void;
+  fn key() const -> VkBuilderKey;
 
 public:
   fn set_layout(VkPipelineLayout layout) -> VkGfxPipelineBuilder&;
@@ -214,8 +264,56 @@ private:
   VkFormat _color_format;
 };
 
+struct VkPipelineCacheData {
+  VkPipelineCache cache;
+  BuffStr<512> path; // empty if we don't persist it
+  bool warm;         // loaded from disk
+  u32 compile_count;
+  u64 compile_ns;
+};
+
+fn vk_create_pipeline_cache(VkDevice device, VkPhysicalDevice physical_device,
+                            const char* cache_dir) -> VkExpect<VkPipelineCacheData>;
+fn vk_save_pipeline_cache(VkDevice device, VkPhysicalDevice physical_device,
+                          VkPipelineCacheData& data) -> void;
+
 fn vk_create_compute_pipeline(VkContext_Impl& vk, VkPipelineLayout layout, VkShaderModule shader,
                               const char* entrypoint = nullptr) -> VkExpect<VkPipeline>;
 fn vk_destroy_pipeline(VkContext_Impl& vk, VkPipeline pip) noexcept -> void;
 
+// Shader modules keyed by path, alive until destroy()
+class VkShaderCache {
+public:
+  VkShaderCache() = default;
+
+public:
+  fn get_shader(VkContext_Impl& vk, const char* path) -> VkExpect<VkShaderModule>;
+  fn destroy(VkContext_Impl& vk) -> void;
+
+private:
+  std::unordered_map<std::string, VkShaderModule> _shaders;
+};
+
+// Layouts and graphics pipelines keyed by their full builder state. Handles returned from here
+// are owned by the cache, don't destroy them
+class VkGfxPipelineCache {
+public:
+  VkGfxPipelineCache() = default;
+
+public:
+  fn get_layout(VkContext_Impl& vk, VkPipelineLayoutBuilder& builder,
+                VkPipelineLayoutCreateFlags flags = 0) -> VkExpect<VkPipelineLayout>;
+  fn get_pipeline(VkContext_Impl& vk, VkGfxPipelineBuilder& builder) -> VkExpect<VkPipeline>;
+  fn destroy(VkContext_Impl& vk) -> void;
+
+public:
+  fn pipeline_count() const -> size_t { return _pipelines.size(); }
+
+  fn layout_count() const -> size_t { return _layouts.size(); }
+
+private:
+  std::unordered_map<VkBuilderKey, VkPipelineLayout, VkBuilderKeyHash> _layouts;
+  std::unordered_map<VkBuilderKey, VkPipeline, VkBuilderKeyHash> _pipelines;
+};
+
 } // namespace kappa::render
@@ -2,8 +2,7 @@
 
 #define KA_INTERNAL_
 
-#define KA_VK_LOG(_level, _msg, ...) \
-  ::kappa::log_##_level("[VULKAN] " _msg __VA_OPT__(, ) __VA_ARGS__)
+#define KA_VK_LOG(_level, _msg, ...) KA_LOG(_level, "[VULKAN] " _msg __VA_OPT__(, ) __VA_ARGS__)
 
 #define KA_VK_ASSERT(func)                                                             \
   {                                                                                    \
@@ -34,7 +33,9 @@
 
 #include "render/vulkan/vk_context.hpp"
 #include "render/vulkan/vk_device.hpp"
+#include "render/vulkan/vk_pipeline.hpp"
 #include "render/vulkan/vk_swapchain.hpp"
+#include "render/vulkan/vk_upload.hpp"
 #include "render/vulkan/vk_util.hpp"
 
 #include <vk_mem_alloc.h>
@@ -45,7 +46,12 @@
 #define KA_ENGINE_VER     VK_MAKE_VERSION(KA_VER_MAJ, KA_VER_MIN, KA_VER_REV)
 #define KA_ENGINE_NAME    "kappa"
 
+#if KA_ALLOC_STATS
+// Driver host allocations, tracked under MemTag::vulkan_host
+extern const VkAllocationCallbacks* const vkalloc;
+#else
 constexpr VkAllocationCallbacks* vkalloc = nullptr;
+#endif
 
 namespace kappa::render {
 
@@ -64,7 +70,8 @@ public:
 public:
   VkContext_Impl(VkInstance vk_, VkDebugUtilsMessengerEXT messenger_, VmaAllocator vmalloc_,
                  VkSurfaceKHR surface_, VkContextDevice&& device_, VkSwapchain&& swapchain_,
-                 VkFrameData&& framedata_, ImDrawData&& imdrawdata_, VkDelQueue&& delqueue_,
+                 VkFrameData&& framedata_, ImDrawData&& imdrawdata_,
+                 VkUploadQueue&& upload_, VkPipelineCacheData&& pipcache_, VkDelQueue&& delqueue_,
                  Optional<VkUpdateSurfExtFn>&& update_surf_);
   ~VkContext_Impl();
   NTF_NO_MOVE(VkContext_Impl);
@@ -79,6 +86,8 @@ public:
   VkContextDevice device;
   VkSwapchain swapchain;
   VkFrameData framedata;
+  VkUploadQueue upload;
+  VkPipelineCacheData pipcache;
   VkDelQueue delqueue;
   Optional<VkUpdateSurfExtFn> update_surf;
 };
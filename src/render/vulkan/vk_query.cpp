@@ -0,0 +1,101 @@
+#include "./vk_query.hpp"
+
+#include "./vk_private.hpp"
+#include "./vk_util.hpp"
+
+namespace kappa::render {
+
+VkGpuTimer::VkGpuTimer(create_t, VkDevice device, VkQueryPool pool, f64 period,
+                       u64 valid_mask) noexcept :
+    _device(device), _pool(pool), _period(period), _valid_mask(valid_mask), _names(),
+    _zone_count(0), _results(), _result_count(0) {}
+
+fn VkGpuTimer::create(VkContext_Impl& vk) -> VkExpect<VkGpuTimer> {
+  const auto device = vk.device.device();
+  const auto physical_device = vk.device.physical_device();
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(physical_device, &props);
+
+  u32 family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+  ScratchScope scratch;
+  ArenaVec<VkQueueFamilyProperties> families(family_count, scratch.arena());
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+  const u32 valid_bits = families[vk.device.queues().graphics].timestampValidBits;
+  if (!valid_bits || props.limits.timestampPeriod <= 0.f) {
+    KA_VK_LOG(warn, "No timestamp support on the graphics queue, GPU zones disabled");
+    return {in_place, create_t(), device, VK_NULL_HANDLE, 0., 0};
+  }
+
+  auto pool_info = vkmk_zero<VkQueryPoolCreateInfo>();
+  pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  pool_info.queryCount = MAX_ZONES * 2;
+  VkQueryPool pool;
+  KA_VK_UNEX(vkCreateQueryPool(device, &pool_info, vkalloc, &pool));
+
+  const u64 valid_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+  return {in_place, create_t(), device, pool, (f64)props.limits.timestampPeriod, valid_mask};
+}
+
+fn VkGpuTimer::destroy() -> void {
+  if (_pool) {
+    vkDestroyQueryPool(_device, _pool, vkalloc);
+    _pool = VK_NULL_HANDLE;
+  }
+}
+
+fn VkGpuTimer::collect() -> bool {
+  if (!_zone_count) {
+    return false;
+  }
+
+  std::array<u64, MAX_ZONES * 2> ticks;
+  const VkResult ret =
+    vkGetQueryPoolResults(_device, _pool, 0, _zone_count * 2, sizeof(ticks), ticks.data(),
+                          sizeof(u64), VK_QUERY_RESULT_64_BIT);
+  if (ret != VK_SUCCESS) {
+    // Never got submitted, keep the older ones
+    return false;
+  }
+
+  const u64 base = ticks[0] & _valid_mask;
+  const fn to_ns = [&](u64 tick) -> u64 {
+    return (u64)((((tick & _valid_mask) - base) & _valid_mask) * _period);
+  };
+  for (u32 i = 0; i < _zone_count; ++i) {
+    _results[i].name = _names[i];
+    _results[i].begin = to_ns(ticks[i * 2]);
+    _results[i].end = to_ns(ticks[i * 2 + 1]);
+  }
+  _result_count = _zone_count;
+  _zone_count = 0;
+  return true;
+}
+
+fn VkGpuTimer::begin_frame(VkCommandBuffer cmd) -> void {
+  _zone_count = 0;
+  if (enabled()) {
+    vkCmdResetQueryPool(cmd, _pool, 0, MAX_ZONES * 2);
+  }
+}
+
+fn VkGpuTimer::begin_zone(VkCommandBuffer cmd, const char* name) -> u32 {
+  if (!enabled() || _zone_count >= MAX_ZONES) {
+    return INVALID_ZONE;
+  }
+  const u32 zone = _zone_count++;
+  _names[zone] = name;
+  vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, _pool, zone * 2);
+  return zone;
+}
+
+fn VkGpuTimer::end_zone(VkCommandBuffer cmd, u32 zone) -> void {
+  if (zone == INVALID_ZONE) {
+    return;
+  }
+  // Written once everything recorded before it is done
+  vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _pool, zone * 2 + 1);
+}
+
+} // namespace kappa::render
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "render/vulkan/vk_common.hpp"
+
+#include <array>
+
+namespace kappa::render {
+
+struct VkGpuZoneTime {
+  const char* name;
+  // Nanoseconds since the first timestamp of the frame
+  u64 begin;
+  u64 end;
+};
+
+// Timestamp queries for a single frame in flight. Zones get written while recording, and read
+// back once the frame's fence signals, so reading them never stalls. Does nothing if the
+// graphics queue can't do timestamps
+class VkGpuTimer {
+private:
+  struct create_t {};
+
+public:
+  static constexpr u32 MAX_ZONES = 16;
+  static constexpr u32 INVALID_ZONE = UINT32_MAX;
+
+public:
+  VkGpuTimer(create_t, VkDevice device, VkQueryPool pool, f64 period, u64 valid_mask) noexcept;
+
+public:
+  static fn create(VkContext_Impl& vk) -> VkExpect<VkGpuTimer>;
+
+public:
+  fn destroy() -> void;
+
+  // Reads back whatever the last frame recorded with it wrote, its fence has to be signaled.
+  // False if there was nothing new
+  fn collect() -> bool;
+
+  // Resets the queries, has to be recorded before any zone and outside of a render pass
+  fn begin_frame(VkCommandBuffer cmd) -> void;
+
+  // INVALID_ZONE if disabled or out of queries, end_zone() ignores it
+  fn begin_zone(VkCommandBuffer cmd, const char* name) -> u32;
+  fn end_zone(VkCommandBuffer cmd, u32 zone) -> void;
+
+public:
+  fn enabled() const -> bool { return _pool != VK_NULL_HANDLE; }
+
+  fn results() const -> Span<const VkGpuZoneTime> { return {_results.data(), _result_count}; }
+
+private:
+  VkDevice _device;
+  VkQueryPool _pool;
+  f64 _period; // Nanoseconds per tick
+  u64 _valid_mask;
+  std::array<const char*, MAX_ZONES> _names;
+  u32 _zone_count;
+  std::array<VkGpuZoneTime, MAX_ZONES> _results;
+  u32 _result_count;
+};
+
+class VkGpuZone {
+public:
+  VkGpuZone(VkGpuTimer& timer, VkCommandBuffer cmd, const char* name) :
+      _timer(&timer), _cmd(cmd), _zone(timer.begin_zone(cmd, name)) {}
+
+  ~VkGpuZone() { _timer->end_zone(_cmd, _zone); }
+
+  VkGpuZone(const VkGpuZone&) = delete;
+  VkGpuZone& operator=(const VkGpuZone&) = delete;
+
+private:
+  VkGpuTimer* _timer;
+  VkCommandBuffer _cmd;
+  u32 _zone;
+};
+
+} // namespace kappa::render
@@ -16,6 +16,15 @@ VkSwapchain::VkSwapchain(create_t, VkSwapchainKHR swapchain, VkFormat format, Vk
   ka_assert(!_image_views.empty());
 }
 
+VkSwapchain::VkSwapchain(create_t, VkExtent2D extent) noexcept :
+    _swapchain(VK_NULL_HANDLE), _format(VK_FORMAT_UNDEFINED), _extent(extent), _images(),
+    _image_views() {}
+
+fn VkSwapchain::create_headless(VkExtent2D extent) -> VkSwapchain {
+  KA_VK_LOG(debug, "Creating headless swapchain: {}x{}", extent.width, extent.height);
+  return {create_t(), extent};
+}
+
 fn VkSwapchain::create(const VkSwapchainArgs& args, VkSwapchainKHR old_swapchain)
   -> VkExpect<VkSwapchain> {
   ka_assert(args.device != VK_NULL_HANDLE);
@@ -145,6 +154,9 @@ fn VkSwapchain::create(const VkSwapchainArgs& args, VkSwapchainKHR old_swapchain
 }
 
 fn VkSwapchain::destroy(VkDevice device) -> void {
+  if (is_headless()) {
+    return;
+  }
   for (size_t i = 0; i < _images.size(); ++i) {
     vkDestroyImageView(device, _image_views[i], vkalloc);
   }
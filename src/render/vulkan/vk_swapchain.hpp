@@ -23,11 +23,15 @@ private:
 public:
   VkSwapchain(create_t, VkSwapchainKHR swapchain, VkFormat format, VkExtent2D extent,
               UniqueArray<VkImage>&& images, UniqueArray<VkImageView>&& image_views);
+  VkSwapchain(create_t, VkExtent2D extent) noexcept;
 
 public:
   static fn create(const VkSwapchainArgs& args, VkSwapchainKHR old_swapchain = VK_NULL_HANDLE)
     -> VkExpect<VkSwapchain>;
 
+  // No images at all, only keeps the extent frames get rendered at
+  static fn create_headless(VkExtent2D extent) -> VkSwapchain;
+
 public:
   fn destroy(VkDevice device) -> void;
 
@@ -38,6 +42,8 @@ public:
 
   fn extent() const -> VkExtent2D { return _extent; }
 
+  fn is_headless() const -> bool { return _swapchain == VK_NULL_HANDLE; }
+
   fn images() const -> Span<const VkImage> { return {_images.data(), _images.size()}; }
 
   fn image_views() const -> Span<const VkImageView> {
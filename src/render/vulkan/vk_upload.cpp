@@ -0,0 +1,403 @@
+#include "./vk_upload.hpp"
+
+#include "./vk_buffer.hpp"
+#include "./vk_private.hpp"
+
+#include <cstring>
+
+namespace kappa::render {
+
+VkUploadCmd::VkUploadCmd(VkCommandBuffer cmd, VkUploadQueue& queue, VkDelQueue& retire,
+                         VkMemAllocator alloc) noexcept :
+    _cmd(cmd), _queue(&queue), _retire(&retire), _alloc(alloc) {}
+
+fn VkUploadCmd::stage(const void* data, VkDeviceSize size, VkDeviceSize align)
+  -> VkExpect<VkUploadStaging> {
+  VkUploadStaging staging;
+  if (auto offset = _queue->ring_alloc(size, align); offset.has_value()) {
+    staging.buffer = _queue->_ring.buffer();
+    staging.offset = *offset;
+    staging.ptr = (u8*)_queue->_ring.mapped_data() + *offset;
+  } else {
+    // Doesn't fit in the ring, pay for a dedicated buffer
+    KA_VK_LOG(debug, "Staging {} bytes outside of the upload ring", size);
+    const VkBufferArgs args{
+      .size = size,
+      .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      .mem_usage = KA_VK_MEM_USAGE_CPU_ONLY,
+    };
+    auto buff = VkAllocBuff::create(_alloc, args);
+    if (!buff) {
+      return {unexpect, buff.error()};
+    }
+    retire(*buff);
+    staging.buffer = buff->buffer();
+    staging.offset = 0;
+    staging.ptr = buff->mapped_data();
+  }
+  if (data) {
+    std::memcpy(staging.ptr, data, size);
+  }
+  return {in_place, staging};
+}
+
+fn VkUploadCmd::copy_buffer(VkBuffer src, VkBuffer dst, const VkBufferCopy& region) -> void {
+  vkCmdCopyBuffer(_cmd, src, dst, 1, &region);
+
+  auto barrier = vkmk_zero<VkBufferMemoryBarrier2>();
+  barrier.buffer = dst;
+  barrier.offset = region.dstOffset;
+  barrier.size = region.size;
+  _queue->_buffer_barriers.push_back(barrier);
+}
+
+fn VkUploadCmd::copy_buffer_to_image(VkBuffer src, VkDeviceSize src_offset, VkImage dst,
+                                     VkExtent3D extent) -> void {
+  vkcmd_transition_image(_cmd, dst, VK_IMAGE_LAYOUT_UNDEFINED,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+  VkBufferImageCopy region{};
+  region.bufferOffset = src_offset;
+  region.bufferRowLength = 0;
+  region.bufferImageHeight = 0;
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.mipLevel = 0;
+  region.imageSubresource.baseArrayLayer = 0;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent = extent;
+  vkCmdCopyBufferToImage(_cmd, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+  // The layout transition happens as part of the queue ownership transfer
+  auto barrier = vkmk_zero<VkImageMemoryBarrier2>();
+  barrier.image = dst;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.subresourceRange = vkmk_image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+  _queue->_image_barriers.push_back(barrier);
+}
+
+fn VkUploadCmd::retire(VkAllocBuff& staging) -> void {
+  _retire->enqueue(staging, _alloc);
+}
+
+VkUploadQueue::VkUploadQueue(create_t, VkDevice device, VkSemaphore timeline,
+                             VkCommandPool transfer_pool, VkCommandPool acquire_pool,
+                             SlotArray&& slots, VkAllocBuff&& ring, u32 transfer_family,
+                             u32 graphics_family) :
+    _device(device), _timeline(timeline), _transfer_pool(transfer_pool),
+    _acquire_pool(acquire_pool), _slots(std::move(slots)), _ring(std::move(ring)), _ring_head(0),
+    _ring_tail(0), _ring_regions(), _transfer_family(transfer_family),
+    _graphics_family(graphics_family), _next_slot(0), _next_value(0), _completed(0) {}
+
+fn VkUploadQueue::create(VkDevice device, VkMemAllocator alloc, u32 transfer_family,
+                         u32 graphics_family, VkDeviceSize ring_size)
+  -> VkExpect<VkUploadQueue> {
+  // Persistently mapped, every upload that fits gets staged here
+  const VkBufferArgs ring_args{
+    .size = ring_size,
+    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    .mem_usage = KA_VK_MEM_USAGE_CPU_ONLY,
+  };
+  auto ring = VkAllocBuff::create(alloc, ring_args);
+  if (!ring) {
+    return {unexpect, ring.error()};
+  }
+  DeferFn ring_err = [&]() {
+    vk_destroy_buffer(alloc, *ring);
+  };
+
+
+  auto timeline_info = vkmk_zero<VkSemaphoreTypeCreateInfo>();
+  timeline_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  timeline_info.initialValue = 0;
+  auto sem_info = vkmk_semaphore_info(0);
+  sem_info.pNext = &timeline_info;
+
+  VkSemaphore timeline;
+  KA_VK_UNEX(vkCreateSemaphore(device, &sem_info, vkalloc, &timeline));
+  DeferFn timeline_err = [&]() {
+    vkDestroySemaphore(device, timeline, vkalloc);
+  };
+
+  const auto transfer_pool_info =
+    vkmk_cmdpool_info(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+                        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                      transfer_family);
+  VkCommandPool transfer_pool;
+  KA_VK_UNEX(vkCreateCommandPool(device, &transfer_pool_info, vkalloc, &transfer_pool));
+  DeferFn transfer_pool_err = [&]() {
+    vkDestroyCommandPool(device, transfer_pool, vkalloc);
+  };
+
+  const auto acquire_pool_info =
+    vkmk_cmdpool_info(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+                        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                      graphics_family);
+  VkCommandPool acquire_pool;
+  KA_VK_UNEX(vkCreateCommandPool(device, &acquire_pool_info, vkalloc, &acquire_pool));
+  DeferFn acquire_pool_err = [&]() {
+    vkDestroyCommandPool(device, acquire_pool, vkalloc);
+  };
+
+  std::array<VkCommandBuffer, MAX_UPLOADS_IN_FLIGHT> transfer_cmds;
+  auto transfer_alloc_info =
+    vkmk_cmdbuf_alloc_info(transfer_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  transfer_alloc_info.commandBufferCount = MAX_UPLOADS_IN_FLIGHT;
+  KA_VK_UNEX(vkAllocateCommandBuffers(device, &transfer_alloc_info, transfer_cmds.data()));
+
+  std::array<VkCommandBuffer, MAX_UPLOADS_IN_FLIGHT> acquire_cmds;
+  auto acquire_alloc_info = vkmk_cmdbuf_alloc_info(acquire_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  acquire_alloc_info.commandBufferCount = MAX_UPLOADS_IN_FLIGHT;
+  KA_VK_UNEX(vkAllocateCommandBuffers(device, &acquire_alloc_info, acquire_cmds.data()));
+
+  SlotArray slots;
+  for (u32 i = 0; i < MAX_UPLOADS_IN_FLIGHT; ++i) {
+    slots[i].transfer_cmd = transfer_cmds[i];
+    slots[i].acquire_cmd = acquire_cmds[i];
+    slots[i].ticket = KA_VK_UPLOAD_NONE;
+  }
+
+  if (transfer_family != graphics_family) {
+    KA_VK_LOG(debug, "Uploading through transfer queue family {}", transfer_family);
+  } else {
+    KA_VK_LOG(debug, "No dedicated transfer queue family, uploading through the graphics queue");
+  }
+
+  acquire_pool_err.disengage();
+  transfer_pool_err.disengage();
+  timeline_err.disengage();
+  ring_err.disengage();
+  return {in_place,        create_t(),       device,        timeline,
+          transfer_pool,   acquire_pool,     std::move(slots), *std::move(ring),
+          transfer_family, graphics_family};
+}
+
+fn VkUploadQueue::add_to_delqueue(VkDelQueue& queue, VkMemAllocator alloc) -> void {
+  queue.enqueue(_ring, alloc);
+  queue.enqueue(_transfer_pool, _device);
+  queue.enqueue(_acquire_pool, _device);
+  queue.enqueue(_timeline, _device);
+}
+
+fn VkUploadQueue::is_done(VkUploadTicket ticket) -> bool {
+  if (ticket <= _completed) {
+    return true;
+  }
+  u64 value = 0;
+  if (vkGetSemaphoreCounterValue(_device, _timeline, &value) == VK_SUCCESS) {
+    _completed = value;
+  }
+  return ticket <= _completed;
+}
+
+fn VkUploadQueue::wait(VkUploadTicket ticket, u64 timeout) -> VkExpect<void> {
+  if (is_done(ticket)) {
+    return {};
+  }
+  auto wait_info = vkmk_zero<VkSemaphoreWaitInfo>();
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &_timeline;
+  wait_info.pValues = &ticket;
+  KA_VK_UNEX(vkWaitSemaphores(_device, &wait_info, timeout));
+  _completed = std::max(_completed, ticket);
+  return {};
+}
+
+fn VkUploadQueue::collect() -> void {
+  for (auto& slot : _slots) {
+    if (slot.ticket != KA_VK_UPLOAD_NONE && is_done(slot.ticket)) {
+      slot.retire.flush();
+      slot.ticket = KA_VK_UPLOAD_NONE;
+    }
+  }
+  ring_reclaim();
+}
+
+fn VkUploadQueue::flush() -> void {
+  for (auto& slot : _slots) {
+    slot.retire.flush();
+    slot.ticket = KA_VK_UPLOAD_NONE;
+  }
+  _ring_regions.clear();
+  _ring_tail = _ring_head;
+}
+
+fn VkUploadQueue::ring_reclaim() -> void {
+  while (!_ring_regions.empty() && is_done(_ring_regions.front().ticket)) {
+    _ring_tail = _ring_regions.front().end;
+    _ring_regions.pop_front();
+  }
+}
+
+fn VkUploadQueue::ring_alloc(VkDeviceSize size, VkDeviceSize align) -> Optional<VkDeviceSize> {
+  const VkDeviceSize capacity = _ring.size();
+  ka_assert(align > 0 && capacity % align == 0);
+  if (size > capacity) {
+    return nullopt;
+  }
+
+  // Allocations never wrap around, skip to the start of the ring instead
+  VkDeviceSize pos = (_ring_head + align - 1) / align * align;
+  if (pos % capacity + size > capacity) {
+    pos += capacity - pos % capacity;
+  }
+
+  ring_reclaim();
+  while (pos + size - _ring_tail > capacity) {
+    if (_ring_regions.empty()) {
+      // The rest of the ring belongs to the upload being recorded
+      return nullopt;
+    }
+    const auto region = _ring_regions.front();
+    if (!wait(region.ticket, UINT64_MAX)) {
+      return nullopt;
+    }
+    _ring_tail = region.end;
+    _ring_regions.pop_front();
+  }
+  _ring_head = pos + size;
+  return pos % capacity;
+}
+
+fn VkUploadQueue::release_barriers(VkCommandBuffer cmd) -> void {
+  const bool transfer = needs_ownership_transfer();
+  const fn setup = [&](auto& barrier) {
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    if (transfer) {
+      // Release half, the graphics queue does the rest
+      barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+      barrier.dstAccessMask = VK_ACCESS_2_NONE;
+      barrier.srcQueueFamilyIndex = _transfer_family;
+      barrier.dstQueueFamilyIndex = _graphics_family;
+    } else {
+      barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+      barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+      barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    }
+  };
+  for (auto& barrier : _buffer_barriers) {
+    setup(barrier);
+  }
+  for (auto& barrier : _image_barriers) {
+    setup(barrier);
+  }
+
+  auto dep_info = vkmk_zero<VkDependencyInfo>();
+  dep_info.bufferMemoryBarrierCount = (u32)_buffer_barriers.size();
+  dep_info.pBufferMemoryBarriers = _buffer_barriers.data();
+  dep_info.imageMemoryBarrierCount = (u32)_image_barriers.size();
+  dep_info.pImageMemoryBarriers = _image_barriers.data();
+  vkCmdPipelineBarrier2(cmd, &dep_info);
+}
+
+fn VkUploadQueue::acquire_barriers(VkCommandBuffer cmd) -> void {
+  // Has to match the release barriers
+  const fn setup = [&](auto& barrier) {
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+    barrier.srcAccessMask = VK_ACCESS_2_NONE;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+  };
+  for (auto& barrier : _buffer_barriers) {
+    setup(barrier);
+  }
+  for (auto& barrier : _image_barriers) {
+    setup(barrier);
+  }
+
+  auto dep_info = vkmk_zero<VkDependencyInfo>();
+  dep_info.bufferMemoryBarrierCount = (u32)_buffer_barriers.size();
+  dep_info.pBufferMemoryBarriers = _buffer_barriers.data();
+  dep_info.imageMemoryBarrierCount = (u32)_image_barriers.size();
+  dep_info.pImageMemoryBarriers = _image_barriers.data();
+  vkCmdPipelineBarrier2(cmd, &dep_info);
+}
+
+fn VkUploadQueue::submit(VkQueue transfer_queue, VkQueue graphics_queue, VkMemAllocator alloc,
+                         VkUploadFn func) -> VkExpect<VkUploadTicket> {
+  auto& slot = _slots[_next_slot];
+  _next_slot = (_next_slot + 1) % MAX_UPLOADS_IN_FLIGHT;
+
+  // Only blocks if we have too many uploads in flight
+  if (slot.ticket != KA_VK_UPLOAD_NONE) {
+    if (auto ret = wait(slot.ticket, UINT64_MAX); !ret) {
+      return {unexpect, ret.error()};
+    }
+    slot.ticket = KA_VK_UPLOAD_NONE;
+  }
+  slot.retire.flush();
+
+  const bool transfer = needs_ownership_transfer();
+  const u64 transfer_value = _next_value + 1;
+  const u64 ticket = transfer ? transfer_value + 1 : transfer_value;
+
+  _buffer_barriers.clear();
+  _image_barriers.clear();
+  const VkDeviceSize ring_mark = _ring_head;
+  DeferFn ring_rollback = [&]() {
+    // Nothing got submitted, give the staging space back
+    _ring_head = ring_mark;
+  };
+
+  const auto cmd_begin_info = vkmk_cmdbuf_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  KA_VK_UNEX(vkResetCommandBuffer(slot.transfer_cmd, 0));
+  KA_VK_UNEX(vkBeginCommandBuffer(slot.transfer_cmd, &cmd_begin_info));
+  VkUploadCmd upload{slot.transfer_cmd, *this, slot.retire, alloc};
+  func(upload);
+  release_barriers(slot.transfer_cmd);
+  KA_VK_UNEX(vkEndCommandBuffer(slot.transfer_cmd));
+
+  auto transfer_signal =
+    vkmk_semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, _timeline);
+  transfer_signal.value = transfer_value;
+  const auto transfer_cmdinfo = vkmk_command_buffer_submit_info(slot.transfer_cmd);
+  const auto transfer_submit = vkmk_submit_info(transfer_cmdinfo, &transfer_signal, nullptr);
+  KA_VK_UNEX(vkQueueSubmit2(transfer_queue, 1, &transfer_submit, VK_NULL_HANDLE));
+  // The value is signaled now, and the staging buffers are in use. Even if the acquire half
+  // fails the next upload can't reuse either
+  _next_value = transfer_value;
+  slot.ticket = transfer_value;
+  ring_rollback.disengage();
+  if (_ring_head != ring_mark) {
+    // Staging is free as soon as the copies are done
+    _ring_regions.push_back({transfer_value, _ring_head});
+  }
+
+  if (transfer) {
+    KA_VK_UNEX(vkResetCommandBuffer(slot.acquire_cmd, 0));
+    KA_VK_UNEX(vkBeginCommandBuffer(slot.acquire_cmd, &cmd_begin_info));
+    acquire_barriers(slot.acquire_cmd);
+    KA_VK_UNEX(vkEndCommandBuffer(slot.acquire_cmd));
+
+    auto acquire_wait =
+      vkmk_semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _timeline);
+    acquire_wait.value = transfer_value;
+    auto acquire_signal =
+      vkmk_semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _timeline);
+    acquire_signal.value = ticket;
+    const auto acquire_cmdinfo = vkmk_command_buffer_submit_info(slot.acquire_cmd);
+    const auto acquire_submit = vkmk_submit_info(acquire_cmdinfo, &acquire_signal, &acquire_wait);
+    KA_VK_UNEX(vkQueueSubmit2(graphics_queue, 1, &acquire_submit, VK_NULL_HANDLE));
+  }
+
+  _next_value = ticket;
+  slot.ticket = ticket;
+  return {in_place, ticket};
+}
+
+fn vk_submit_upload_fn(VkContext_Impl& vk, VkUploadFn func) -> VkExpect<VkUploadTicket> {
+  return vk.upload.submit(vk.device.transfer_queue(), vk.device.graphics_queue(),
+                          (VkMemAllocator)vk.vmalloc, func);
+}
+
+fn vk_upload_done(VkContext_Impl& vk, VkUploadTicket ticket) -> bool {
+  return vk.upload.is_done(ticket);
+}
+
+fn vk_upload_wait(VkContext_Impl& vk, VkUploadTicket ticket, u64 timeout) -> VkExpect<void> {
+  return vk.upload.wait(ticket, timeout);
+}
+
+} // namespace kappa::render
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "render/vulkan/vk_buffer.hpp"
+#include "render/vulkan/vk_util.hpp"
+
+#include <array>
+
+namespace kappa::render {
+
+// Timeline value signaled once an upload is visible to the graphics queue
+using VkUploadTicket = u64;
+
+constexpr VkUploadTicket KA_VK_UPLOAD_NONE = 0; // Always complete
+
+class VkUploadQueue;
+
+struct VkUploadStaging {
+  VkBuffer buffer;
+  VkDeviceSize offset;
+  void* ptr;
+};
+
+class VkUploadCmd {
+private:
+  friend VkUploadQueue;
+
+  VkUploadCmd(VkCommandBuffer cmd, VkUploadQueue& queue, VkDelQueue& retire,
+              VkMemAllocator alloc) noexcept;
+
+public:
+  // Reserves staging memory for this upload, copying data into it if not null
+  fn stage(const void* data, VkDeviceSize size, VkDeviceSize align = 16)
+    -> VkExpect<VkUploadStaging>;
+
+  fn copy_buffer(VkBuffer src, VkBuffer dst, const VkBufferCopy& region) -> void;
+
+  // Leaves the image in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+  fn copy_buffer_to_image(VkBuffer src, VkDeviceSize src_offset, VkImage dst, VkExtent3D extent)
+    -> void;
+
+  // Destroyed once the upload completes
+  fn retire(VkAllocBuff& staging) -> void;
+
+public:
+  fn cmd() const -> VkCommandBuffer { return _cmd; }
+
+private:
+  VkCommandBuffer _cmd;
+  VkUploadQueue* _queue;
+  VkDelQueue* _retire;
+  VkMemAllocator _alloc;
+};
+
+using VkUploadFn = FnRef<void(VkUploadCmd&)>;
+
+// Records copies on the transfer queue and hands them over to the graphics queue, without
+// blocking the render thread
+class VkUploadQueue {
+private:
+  struct create_t {};
+
+public:
+  static constexpr u32 MAX_UPLOADS_IN_FLIGHT = 16;
+  static constexpr VkDeviceSize STAGING_RING_SIZE = 32u << 20;
+
+  struct Slot {
+    VkCommandBuffer transfer_cmd;
+    VkCommandBuffer acquire_cmd;
+    VkUploadTicket ticket;
+    VkDelQueue retire;
+  };
+
+  using SlotArray = std::array<Slot, MAX_UPLOADS_IN_FLIGHT>;
+
+  // Ring bytes in [prev end, end) are free again once ticket completes
+  struct RingRegion {
+    VkUploadTicket ticket;
+    VkDeviceSize end;
+  };
+
+public:
+  VkUploadQueue(create_t, VkDevice device, VkSemaphore timeline, VkCommandPool transfer_pool,
+                VkCommandPool acquire_pool, SlotArray&& slots, VkAllocBuff&& ring,
+                u32 transfer_family, u32 graphics_family);
+
+public:
+  static fn create(VkDevice device, VkMemAllocator alloc, u32 transfer_family,
+                   u32 graphics_family, VkDeviceSize ring_size = STAGING_RING_SIZE)
+    -> VkExpect<VkUploadQueue>;
+
+public:
+  fn add_to_delqueue(VkDelQueue& queue, VkMemAllocator alloc) -> void;
+
+  fn submit(VkQueue transfer_queue, VkQueue graphics_queue, VkMemAllocator alloc,
+            VkUploadFn func) -> VkExpect<VkUploadTicket>;
+  fn is_done(VkUploadTicket ticket) -> bool;
+  fn wait(VkUploadTicket ticket, u64 timeout) -> VkExpect<void>;
+
+  // Releases staging memory and ring regions from finished uploads
+  fn collect() -> void;
+  fn flush() -> void;
+
+public:
+  fn timeline() const -> VkSemaphore { return _timeline; }
+
+  fn completed() const -> VkUploadTicket { return _completed; }
+
+  fn needs_ownership_transfer() const -> bool { return _transfer_family != _graphics_family; }
+
+private:
+  fn ring_alloc(VkDeviceSize size, VkDeviceSize align) -> Optional<VkDeviceSize>;
+  fn ring_reclaim() -> void;
+  fn release_barriers(VkCommandBuffer cmd) -> void;
+  fn acquire_barriers(VkCommandBuffer cmd) -> void;
+
+private:
+  friend VkUploadCmd;
+
+  VkDevice _device;
+  VkSemaphore _timeline;
+  VkCommandPool _transfer_pool;
+  VkCommandPool _acquire_pool;
+  SlotArray _slots;
+  VkAllocBuff _ring;
+  VkDeviceSize _ring_head, _ring_tail; // Monotonic, wrapped with the ring size
+  Deque<RingRegion> _ring_regions;
+  u32 _transfer_family, _graphics_family;
+  u32 _next_slot;
+  VkUploadTicket _next_value;
+  VkUploadTicket _completed;
+  Vec<VkBufferMemoryBarrier2> _buffer_barriers;
+  Vec<VkImageMemoryBarrier2> _image_barriers;
+};
+
+fn vk_submit_upload_fn(VkContext_Impl& vk, VkUploadFn func) -> VkExpect<VkUploadTicket>;
+
+template<typename Fn>
+requires(std::invocable<std::remove_cvref_t<Fn>, VkUploadCmd&>)
+fn vk_submit_upload(VkContext_Impl& vk, Fn&& func) -> VkExpect<VkUploadTicket> {
+  return vk_submit_upload_fn(vk, VkUploadFn{func});
+}
+
+fn vk_upload_done(VkContext_Impl& vk, VkUploadTicket ticket) -> bool;
+fn vk_upload_wait(VkContext_Impl& vk, VkUploadTicket ticket, u64 timeout = UINT64_MAX)
+  -> VkExpect<void>;
+
+} // namespace kappa::render
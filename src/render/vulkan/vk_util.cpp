@@ -41,6 +41,7 @@ fn handle_name(VkDelQueue::HandleType type) -> const char* {
     STR(PIPELINE);
     STR(SHADER);
     STR(SAMPLER);
+    STR(PIPCACHE);
     default:
       return "UNKNOWN";
   }
@@ -103,6 +104,9 @@ fn destroy_handle(VkDelQueue::HandleType type, VkHandle parent, VkHandle other_p
     case TYPE_SHADER: {
       vkDestroyShaderModule((VkDevice)parent, (VkShaderModule)handle, vkalloc);
     } break;
+    case TYPE_PIPCACHE: {
+      vkDestroyPipelineCache((VkDevice)parent, (VkPipelineCache)handle, vkalloc);
+    } break;
     case TYPE_DELETER:
       break;
   }
@@ -204,6 +208,27 @@ fn vkcmd_transition_image(VkCommandBuffer cmd, VkImage img, VkImageLayout curr_l
   return new_layout;
 }
 
+fn vkcmd_buffer_barrier(VkCommandBuffer cmd, VkBuffer buffer, VkPipelineStageFlags2 src_stage,
+                        VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stage,
+                        VkAccessFlags2 dst_access) -> void {
+  auto barrier = vkmk_zero<VkBufferMemoryBarrier2>();
+  barrier.srcStageMask = src_stage;
+  barrier.srcAccessMask = src_access;
+  barrier.dstStageMask = dst_stage;
+  barrier.dstAccessMask = dst_access;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = buffer;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+
+  auto dep_info = vkmk_zero<VkDependencyInfo>();
+  dep_info.bufferMemoryBarrierCount = 1;
+  dep_info.pBufferMemoryBarriers = &barrier;
+
+  vkCmdPipelineBarrier2(cmd, &dep_info);
+}
+
 fn vkmk_semaphore_submit_info(VkPipelineStageFlags2 mask, VkSemaphore sem)
   -> VkSemaphoreSubmitInfo {
   auto submit = vkmk_zero<VkSemaphoreSubmitInfo>();
@@ -386,4 +411,90 @@ fn vkmk_pipeline_layout_info() -> VkPipelineLayoutCreateInfo {
   return info;
 }
 
+#if KA_ALLOC_STATS
+namespace {
+
+// Vulkan doesn't pass the size back on free, so it lives right before the returned pointer
+struct VkHostHeader {
+  size_t size;
+  size_t align; // Also the distance to the start of the allocation
+};
+
+constexpr size_t VK_HOST_MIN_ALIGN = alignof(std::max_align_t);
+static_assert(sizeof(VkHostHeader) <= VK_HOST_MIN_ALIGN);
+
+fn vk_host_header(void* ptr) -> VkHostHeader* {
+  return reinterpret_cast<VkHostHeader*>(static_cast<u8*>(ptr) - sizeof(VkHostHeader));
+}
+
+VKAPI_ATTR void* VKAPI_CALL vk_host_alloc(void*, size_t size, size_t align,
+                                          VkSystemAllocationScope) {
+  align = std::max(align, VK_HOST_MIN_ALIGN);
+  try {
+    // Skipping a whole alignment keeps the returned pointer aligned and leaves room for the header
+    u8* base = static_cast<u8*>(tagged_alloc(MemTag::vulkan_host, size + align, align));
+    u8* ptr = base + align;
+    *vk_host_header(ptr) = {size, align};
+    return ptr;
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+VKAPI_ATTR void VKAPI_CALL vk_host_free(void*, void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  const auto header = *vk_host_header(ptr);
+  tagged_free(MemTag::vulkan_host, static_cast<u8*>(ptr) - header.align,
+              header.size + header.align, header.align);
+}
+
+VKAPI_ATTR void* VKAPI_CALL vk_host_realloc(void* user, void* ptr, size_t size, size_t align,
+                                            VkSystemAllocationScope scope) {
+  if (!ptr) {
+    return vk_host_alloc(user, size, align, scope);
+  }
+  if (!size) {
+    vk_host_free(user, ptr);
+    return nullptr;
+  }
+  const size_t old_size = vk_host_header(ptr)->size;
+  void* new_ptr = vk_host_alloc(user, size, align, scope);
+  if (!new_ptr) {
+    // The spec wants the old allocation left alone
+    return nullptr;
+  }
+  std::memcpy(new_ptr, ptr, std::min(size, old_size));
+  vk_host_free(user, ptr);
+  return new_ptr;
+}
+
+// The driver telling us about executable memory it allocated on its own
+VKAPI_ATTR void VKAPI_CALL vk_host_internal_alloc(void*, size_t size, VkInternalAllocationType,
+                                                  VkSystemAllocationScope) {
+  mem_track_alloc(MemTag::vulkan_host, size);
+}
+
+VKAPI_ATTR void VKAPI_CALL vk_host_internal_free(void*, size_t size, VkInternalAllocationType,
+                                                 VkSystemAllocationScope) {
+  mem_track_free(MemTag::vulkan_host, size);
+}
+
+constexpr VkAllocationCallbacks vk_host_callbacks{
+  .pUserData = nullptr,
+  .pfnAllocation = vk_host_alloc,
+  .pfnReallocation = vk_host_realloc,
+  .pfnFree = vk_host_free,
+  .pfnInternalAllocation = vk_host_internal_alloc,
+  .pfnInternalFree = vk_host_internal_free,
+};
+
+} // namespace
+#endif
+
 } // namespace kappa::render
+
+#if KA_ALLOC_STATS
+const VkAllocationCallbacks* const vkalloc = &kappa::render::vk_host_callbacks;
+#endif
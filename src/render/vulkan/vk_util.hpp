@@ -47,6 +47,7 @@ KA_VK_STRUCT(VkDescriptorPoolCreateInfo, DESCRIPTOR_POOL_CREATE_INFO);
 KA_VK_STRUCT(VkDeviceQueueCreateInfo, DEVICE_QUEUE_CREATE_INFO);
 KA_VK_STRUCT(VkPhysicalDeviceVulkan13Features, PHYSICAL_DEVICE_VULKAN_1_3_FEATURES);
 KA_VK_STRUCT(VkPhysicalDeviceVulkan12Features, PHYSICAL_DEVICE_VULKAN_1_2_FEATURES);
+KA_VK_STRUCT(VkPhysicalDeviceFeatures2, PHYSICAL_DEVICE_FEATURES_2);
 KA_VK_STRUCT(VkDeviceCreateInfo, DEVICE_CREATE_INFO);
 KA_VK_STRUCT(VkSwapchainCreateInfoKHR, SWAPCHAIN_CREATE_INFO_KHR);
 KA_VK_STRUCT(VkPipelineLayoutCreateInfo, PIPELINE_LAYOUT_CREATE_INFO);
@@ -64,6 +65,12 @@ KA_VK_STRUCT(VkPipelineDynamicStateCreateInfo, PIPELINE_DYNAMIC_STATE_CREATE_INF
 KA_VK_STRUCT(VkBufferCreateInfo, BUFFER_CREATE_INFO);
 KA_VK_STRUCT(VkBufferDeviceAddressInfo, BUFFER_DEVICE_ADDRESS_INFO);
 KA_VK_STRUCT(VkSamplerCreateInfo, SAMPLER_CREATE_INFO);
+KA_VK_STRUCT(VkPipelineCacheCreateInfo, PIPELINE_CACHE_CREATE_INFO);
+KA_VK_STRUCT(VkBufferMemoryBarrier2, BUFFER_MEMORY_BARRIER_2);
+KA_VK_STRUCT(VkSemaphoreTypeCreateInfo, SEMAPHORE_TYPE_CREATE_INFO);
+KA_VK_STRUCT(VkDescriptorSetLayoutBindingFlagsCreateInfo,
+             DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO);
+KA_VK_STRUCT(VkSemaphoreWaitInfo, SEMAPHORE_WAIT_INFO);
 
 template<typename T>
 requires(VkStructTraits<T>::is_specialized)
@@ -108,6 +115,7 @@ public:
     TYPE_PIPLAYOUT,
     TYPE_PIPELINE,
     TYPE_SHADER,
+    TYPE_PIPCACHE,
   };
 
   struct HandleSet {
@@ -202,6 +210,10 @@ public:
     enqueue_handle((VkHandle)shader, (VkHandle)device, TYPE_SHADER);
   }
 
+  fn enqueue(VkPipelineCache cache, VkDevice device) -> void {
+    enqueue_handle((VkHandle)cache, (VkHandle)device, TYPE_PIPCACHE);
+  }
+
 private:
   Vec<DelData> _queue;
 };
@@ -209,6 +221,10 @@ private:
 fn vkcmd_transition_image(VkCommandBuffer cmd, VkImage img, VkImageLayout curr_layout,
                           VkImageLayout new_layout) -> VkImageLayout;
 
+fn vkcmd_buffer_barrier(VkCommandBuffer cmd, VkBuffer buffer, VkPipelineStageFlags2 src_stage,
+                        VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stage,
+                        VkAccessFlags2 dst_access) -> void;
+
 fn vkcmd_transfer_image(VkCommandBuffer cmdbuf, VkImage src, VkImage dst, VkExtent2D src_ext,
                         VkExtent2D dst_ext) -> void;
 